@@ -0,0 +1,42 @@
+#ifndef BRADLEYTERRY_H
+#define BRADLEYTERRY_H
+
+#include <cmath>
+#include <cstdint>
+
+#include <vector>
+
+/// @file
+/// @brief The Newton solver shared by the Bradley-Terry rating fits
+/// @details In the model, the first player scores 1 / (1 + exp(-(r1 - r2 +
+/// b))) on average, where b is the first player advantage, and a draw counts
+/// as half a win. The last player is the anchor with a fixed rating. The
+/// parameters are the ratings of the other players in order, then b, so a
+/// fit with n players has n parameters. MatchScheduler and
+/// corintho_ai/rating/rating_gd.cpp both use this layout.
+
+/// @brief Elo per natural unit of rating
+inline const double kEloPerUnit = 400.0 / std::log(10.0);
+
+/// @brief The largest change of a parameter in one Newton step
+/// @details This keeps the first steps stable when a player has only won or
+/// only lost.
+constexpr double kMaxNewtonStep = 1.0;
+
+/// @brief Factor a symmetric positive definite matrix as L L^T in place
+/// @details Only the lower triangle is used and overwritten with L.
+void cholesky(std::vector<double> &a, int32_t m) noexcept;
+
+/// @brief Solve L L^T x = b in place, with L from cholesky
+void choleskySolve(const std::vector<double> &l, int32_t m,
+                   double b[]) noexcept;
+
+/// @brief Turn the negative Hessian and gradient of a log-likelihood into a
+/// Newton step
+/// @details The Hessian is factored in place, and the gradient is replaced
+/// by the step, with each entry clamped to kMaxNewtonStep.
+/// @return The largest change of a parameter
+double newtonStep(std::vector<double> &hessian, std::vector<double> &gradient,
+                  int32_t m) noexcept;
+
+#endif
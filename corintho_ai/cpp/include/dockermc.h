@@ -3,9 +3,11 @@
 
 #include <cstdint>
 
+#include <chrono>
 #include <memory>
 #include <random>
 
+#include "evaltuner.h"
 #include "trainmc.h"
 
 /// @brief A wrapper for TrainMC that is used in the web app
@@ -28,6 +30,24 @@ class DockerMC {
   bool done() const noexcept;
   /// @brief Returns if the game is drawn.
   bool drawn() const noexcept;
+  /// @brief Returns the move that would be chosen now
+  int32_t bestMove() const noexcept;
+  /// @brief Returns the average evaluation of the root node
+  float value() const noexcept;
+  /// @brief Write the principal variation
+  /// @return The number of moves written
+  int32_t principalVariation(int32_t moves[], int32_t max_length) const;
+
+  /// @brief Stop searching after the given number of seconds from now
+  void setTimeLimit(float seconds) noexcept;
+  /// @brief Limit the number of searches for the current move
+  void setSearchBudget(int32_t search_budget) noexcept;
+  /// @brief Whether to tune the searches per evaluation as the search runs
+  /// @details The searches per evaluation is kept between 1 and the
+  /// constructor's searches_per_eval from the measured search and evaluation
+  /// times. See EvalTuner. The evaluation time is the time between calls to
+  /// doIteration.
+  void setAutotune(bool autotune) noexcept;
 
   /// @brief Write the game states for the positions we need to evaluate.
   void writeRequests(float *game_states) const noexcept;
@@ -39,6 +59,14 @@ class DockerMC {
   int32_t chooseMove() noexcept;
   /// @brief Do an iteration of searches
   bool doIteration(float eval[] = nullptr, float probs[] = nullptr);
+  /// @brief Move the root to the position sent by the web app
+  /// @details Pending requests are discarded first, so this can be called
+  /// while pondering. The tree is kept if the position follows from the root.
+  /// @return Whether the tree was reused
+  bool receivePosition(int32_t board[4 * kBoardSize], int32_t to_play,
+                       int32_t pieces[6]);
+  /// @brief Discard the positions waiting for an evaluation
+  void discardRequests() noexcept;
 
  private:
   std::unique_ptr<std::mt19937> generator_;
@@ -46,6 +74,13 @@ class DockerMC {
   /// @details The wrapper is primarily to control the lifetime of this array.
   std::unique_ptr<float[]> to_eval_;
   TrainMC trainmc_;
+  /// @brief Chooses the searches per evaluation. See DockerMC::setAutotune
+  EvalTuner tuner_;
+  bool autotune_{false};
+  /// @brief When the last iteration ended
+  std::chrono::steady_clock::time_point search_end_{};
+  /// @brief The seconds spent in the last iteration
+  double search_time_{0.0};
 };
 
 #endif
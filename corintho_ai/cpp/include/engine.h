@@ -0,0 +1,115 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <cstdint>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "trainmc.h"
+#include "util.h"
+
+class Evaluator;
+
+/// @brief A long-lived engine that speaks a line-based protocol
+/// @details The protocol is modelled on UCI. Each command is one line:
+///
+/// - isready: reply readyok
+/// - position startpos [moves m1 m2 ...]
+/// - position state <64 0/1 board characters> <to_play> <6 piece counts>
+///   [moves m1 m2 ...]
+/// - go [movetime ms] [nodes n] [infinite] [ponder]: search in the background
+///   and reply info (visits, value, principal variation) and bestmove when a
+///   limit is reached or on stop
+/// - stop: stop searching and reply bestmove
+/// - ponderhit: the predicted move was played, apply the go limits from now
+/// - eval: reply with the network and search evaluations of the position
+/// - legalmoves: reply with the legal moves of the position
+/// - quit
+///
+/// Moves use the notation of Move (for example Ba4 or b3R). The search tree
+/// is kept between commands, so a position that follows from the previous
+/// one reuses its searches.
+class Engine {
+ public:
+  Engine(Evaluator *evaluator, std::ostream &out,
+         int32_t searches_per_eval = 16, int32_t seed = 0);
+  Engine(const Engine &) = delete;
+  Engine(Engine &&) = delete;
+  Engine &operator=(const Engine &) = delete;
+  Engine &operator=(Engine &&) = delete;
+  ~Engine();
+
+  /// @brief Handle one line of input
+  /// @return False if the engine should quit
+  bool handleCommand(const std::string &line);
+  /// @brief Wait for the current search to finish on its own
+  void wait();
+
+ private:
+  /// @brief Limits for a search started with go
+  struct Limits {
+    /// @brief Time limit in milliseconds, or -1 for none
+    int64_t movetime{-1};
+    /// @brief Number of searches, or -1 for none
+    int32_t nodes{-1};
+    /// @brief Search until stop
+    bool infinite{false};
+  };
+
+  void position(std::istringstream &args);
+  void go(std::istringstream &args);
+  void ponderhit();
+  void eval();
+  void legalMoves();
+  /// @brief Stop the search thread and wait for it to reply bestmove
+  void stopSearch();
+  /// @brief The body of the search thread
+  void search();
+  /// @brief Pass the current limits to TrainMC
+  /// @details The limits can change during a search with ponderhit.
+  /// @return Whether the search should wait for stop or ponderhit instead of
+  /// finishing
+  bool applyLimits(int32_t start_searches);
+  /// @brief Write a line of output
+  void send(const std::string &line);
+
+  /// @brief The maximum number of searches per position
+  /// @details Visit counts are 16-bit.
+  static constexpr int32_t kMaxSearches = 32760;
+  /// @brief The default number of searches for go without limits
+  static constexpr int32_t kDefaultNodes = 1600;
+
+  Evaluator *evaluator_{nullptr};
+  std::ostream &out_;
+  const int32_t searches_per_eval_{16};
+  std::mt19937 generator_;
+  std::unique_ptr<float[]> to_eval_;
+  std::unique_ptr<float[]> eval_;
+  std::unique_ptr<float[]> probs_;
+  /// @brief Legal moves of the requests, so only their priors are returned
+  std::unique_ptr<uint32_t[]> legal_masks_;
+  /// @brief Only accessed by the search thread while it is running
+  TrainMC trainmc_;
+
+  std::thread search_thread_;
+  /// @brief Guards limits_, deadline_ and pondering_
+  mutable std::mutex mutex_;
+  std::condition_variable stop_condition_;
+  std::atomic<bool> stop_{false};
+  Limits limits_{};
+  std::chrono::steady_clock::time_point deadline_{};
+  /// @brief Whether the search ignores its limits until ponderhit
+  bool pondering_{false};
+  std::mutex out_mutex_;
+};
+
+#endif
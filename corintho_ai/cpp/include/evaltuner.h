@@ -0,0 +1,58 @@
+#ifndef EVALTUNER_H
+#define EVALTUNER_H
+
+#include <cstdint>
+
+/// @brief Chooses the number of searches per evaluation from measured costs
+/// @details Each batch costs a fixed overhead plus a cost per row for the
+/// neural network, and a cost per row for the search. The overhead is
+/// amortized over the rows, so larger batches evaluate more positions per
+/// second, up to 1 / (cost per row). But more searches per evaluation means
+/// more searches done without the evaluations of earlier ones, which weakens
+/// the search. The tuner picks the fewest searches per evaluation whose
+/// batches reach 1 - max_overhead of the best rate.
+///
+/// The costs are fitted by least squares over recent batches, with older
+/// batches weighted less so the estimates follow changes in load. Until the
+/// batches have had different sizes, the tuner alternates between the bounds
+/// to measure the fixed overhead.
+class EvalTuner {
+ public:
+  EvalTuner() = default;
+  /// @param min_searches The least searches per evaluation for each game
+  /// @param max_searches The most searches per evaluation for each game
+  /// @param max_overhead The share of batch time left to the fixed overhead
+  EvalTuner(int32_t min_searches, int32_t max_searches,
+            float max_overhead = 0.1);
+
+  /// @brief Return the searches per evaluation for each game
+  int32_t searches_per_eval() const noexcept;
+
+  /// @brief Record the costs of a batch and update the searches per
+  /// evaluation
+  /// @param num_rows The number of positions evaluated
+  /// @param search_time The seconds spent searching for the batch
+  /// @param eval_time The seconds spent evaluating the batch
+  /// @param num_games The number of games that will share the next batch
+  void record(int32_t num_rows, double search_time, double eval_time,
+              int32_t num_games) noexcept;
+
+ private:
+  /// @brief The weight of the previous batches when adding a batch
+  static constexpr double kDecay = 0.95;
+
+  int32_t min_searches_{1};
+  int32_t max_searches_{1};
+  float max_overhead_{0.1};
+  int32_t searches_per_eval_{1};
+  /// @brief Weighted sums for fitting eval time = overhead + rows * cost
+  double weight_{0.0};
+  double sum_rows_{0.0};
+  double sum_rows_sq_{0.0};
+  double sum_eval_{0.0};
+  double sum_rows_eval_{0.0};
+  /// @brief Weighted sums for the search time per row
+  double sum_search_{0.0};
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef EVALUATOR_H
+#define EVALUATOR_H
+
+#include <cstdint>
+
+#include "util.h"
+
+/// @brief Interface for the neural network used by the search
+/// @details The inputs and outputs have the layout used by TrainMC:
+/// game_states holds num_states rows of kGameStateSize floats written by
+/// Game::writeGameState, eval receives one evaluation per state and probs
+/// receives kNumMoves probabilities per state.
+class Evaluator {
+ public:
+  Evaluator() = default;
+  Evaluator(const Evaluator &) = default;
+  Evaluator(Evaluator &&) noexcept = default;
+  Evaluator &operator=(const Evaluator &) = default;
+  Evaluator &operator=(Evaluator &&) noexcept = default;
+  virtual ~Evaluator() = default;
+
+  /// @brief Evaluate a batch of game states
+  virtual void evaluate(const float game_states[], int32_t num_states,
+                        float eval[], float probs[]) = 0;
+  /// @brief Evaluate a batch of game states, with priors for legal moves only
+  /// @param legal_masks The legal moves of each state, as written by
+  /// TrainMC::writeLegalMasks
+  /// @param priors Receives the priors of the legal moves of each state in
+  /// increasing move order, one state after another
+  /// @details The default implementation calls evaluate and keeps the legal
+  /// moves. Evaluators that can mask their output should override this.
+  virtual void evaluateLegal(const float game_states[],
+                             const uint32_t legal_masks[], int32_t num_states,
+                             float eval[], float priors[]);
+};
+
+/// @brief An evaluator that does not need a neural network
+/// @details The outputs are pseudorandom but depend only on the game state
+/// and the seed, so searches are reproducible. This is used for testing and
+/// benchmarking the search.
+class MockEvaluator : public Evaluator {
+ public:
+  explicit MockEvaluator(uint32_t seed = 0) noexcept;
+
+  void evaluate(const float game_states[], int32_t num_states, float eval[],
+                float probs[]) override;
+
+ private:
+  uint32_t seed_{0};
+};
+
+#endif
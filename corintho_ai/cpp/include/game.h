@@ -9,6 +9,19 @@
 #include "move.h"
 #include "util.h"
 
+/// @brief A fixed-layout encoding of a game state
+/// @details This is used whenever a game state leaves the process (for
+/// example in saved search trees), since the layout of std::bitset is not
+/// specified by the standard.
+struct PackedGame {
+  /// @brief Bit i is entry i of the board bitset of Game
+  uint64_t board{0};
+  /// @brief The pieces available to each player (not canonized)
+  int8_t pieces[6]{};
+  int8_t to_play{0};
+  int8_t padding{0};
+};
+
 /// @brief Represents a Corintho game state
 /// @note The class is designed to be as memory efficient as possible
 /// since it is contained in each node of the Monte Carlo Search Tree
@@ -29,6 +42,11 @@ class Game {
   // Used in the web app to feed an arbitrary game state to the MCST
   Game(int32_t board[4 * kBoardSize], int32_t to_play,
        int32_t pieces[6]) noexcept;
+  /// @brief Unpack a game state written by Game::pack
+  explicit Game(const PackedGame &packed) noexcept;
+
+  /// @brief Returns the fixed-layout encoding of the game state
+  PackedGame pack() const noexcept;
 
   /// @brief Mutates legal_moves to indicate which moves are legal
   /// @param legal_moves A bitset of size kNumMoves
@@ -43,6 +61,9 @@ class Game {
   /// @param move_id The ID of the move to apply
   void doMove(int32_t move_id) noexcept;
 
+  bool operator==(const Game &other) const noexcept;
+  bool operator!=(const Game &other) const noexcept;
+
   friend std::ostream &operator<<(std::ostream &stream, const Game &game);
 
  private:
@@ -135,4 +156,12 @@ class Game {
   int8_t to_play_{};
 };
 
+/// @brief Expand packed game states into the input of the neural network
+/// @details The output is the same as Game::writeGameState for each state.
+/// Requests can be moved as 16-byte PackedGame records and only expanded
+/// where the neural network reads them. Uses AVX2 when the CPU supports it.
+/// @param game_states A float array of size num_states * kGameStateSize
+void expandGameStates(const PackedGame packed[], int32_t num_states,
+                      float game_states[]) noexcept;
+
 #endif
@@ -16,10 +16,11 @@ struct Player {
   Player() = default;
   Player(int32_t player_id, int32_t model_id, int32_t max_searches,
          int32_t searches_per_eval, float c_puct, float epsilon,
-         bool random = false)
+         bool random = false,
+         TrainMC::Rollout rollout = TrainMC::Rollout::kNone)
       : player_id{player_id}, model_id{model_id}, max_searches{max_searches},
         searches_per_eval{searches_per_eval}, c_puct{c_puct}, epsilon{epsilon},
-        random{random} {}
+        random{random}, rollout{rollout} {}
   int32_t player_id{};
   int32_t model_id{};
   int32_t max_searches{1600};
@@ -27,6 +28,9 @@ struct Player {
   float c_puct{1.0};
   float epsilon{0.25};
   bool random{false};
+  /// @brief How the player evaluates leaves. A player with rollouts needs no
+  /// model and never requests evaluations. See TrainMC::set_rollout
+  TrainMC::Rollout rollout{TrainMC::Rollout::kNone};
 };
 
 /// @brief A tournament match with 2 players
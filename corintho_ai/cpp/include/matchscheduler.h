@@ -0,0 +1,97 @@
+#ifndef MATCHSCHEDULER_H
+#define MATCHSCHEDULER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <utility>
+#include <vector>
+
+class Tourney;
+
+/// @brief Chooses tourney pairings that make the ratings certain with few
+/// games
+/// @details The ratings follow the Bradley-Terry model of bradleyterry.h,
+/// which rating_gd.cpp also fits: the first player scores
+/// 1 / (1 + exp(-(r1 - r2 + b))) on average, where b is the first player
+/// advantage, and a draw counts as half a win. The last player is the anchor
+/// with rating 0, and the other ratings and b have a normal prior centred
+/// on 0.
+///
+/// MatchScheduler::fit finds the most likely ratings by Newton's method and
+/// approximates the posterior with a normal distribution whose covariance is
+/// the inverse of the Hessian (the Laplace approximation). A game between i
+/// and j adds p (1 - p) times u u^T to the Hessian, where u is the direction
+/// of r_i - r_j + b, so the reduction of the variances of the ratings from
+/// one more game is known in closed form. MatchScheduler::nextPairings
+/// greedily picks the games with the largest reduction of the variances that
+/// are still above the target. Games whose outcome is nearly certain, or
+/// between players that are already well rated, reduce them little and are
+/// not picked.
+class MatchScheduler {
+ public:
+  /// @param prior_sd The standard deviation of the prior of the ratings and
+  /// the first player advantage, in Elo
+  explicit MatchScheduler(int32_t num_players, float prior_sd = 400.0);
+
+  int32_t num_players() const noexcept;
+  /// @brief Return the number of results added
+  int32_t num_games() const noexcept;
+  /// @brief Return the rating of a player in Elo, as of the last fit
+  float rating(int32_t player) const noexcept;
+  /// @brief Return the standard deviation of the rating of a player in Elo,
+  /// relative to the last player
+  float stddev(int32_t player) const noexcept;
+  /// @brief Return the first player advantage in Elo
+  float first_player_advantage() const noexcept;
+  /// @brief Return whether the standard deviation of every rating is at most
+  /// target_sd Elo
+  bool converged(float target_sd) const noexcept;
+
+  /// @brief Add the result of a game
+  /// @param score The score of the first player
+  void addResult(int32_t player1, int32_t player2, float score) noexcept;
+  /// @brief Add the results of a tourney finished since the last call
+  /// @details The tourney must be the same in every call, and its players
+  /// must be numbered from 0 to num_players - 1.
+  void addResults(const Tourney &tourney);
+  /// @brief Find the most likely ratings and their covariance
+  void fit();
+  /// @brief Return the games to play next, with the first player first
+  /// @param target_sd Only ratings with a larger standard deviation count,
+  /// unless every rating has reached it
+  /// @details Call MatchScheduler::fit after adding results. The pairings
+  /// are chosen one at a time, each as if the ones before had been played.
+  std::vector<std::pair<int32_t, int32_t>>
+  nextPairings(int32_t num_pairings, float target_sd = 0.0);
+  /// @brief Add the next pairings to a tourney
+  void schedule(Tourney &tourney, int32_t num_pairings,
+                float target_sd = 0.0);
+
+ private:
+  /// @brief Return the index of the rating of a player in the parameters,
+  /// or -1 for the anchor
+  int32_t index(int32_t player) const noexcept;
+  /// @brief Return the probability that player1 beats player2 moving first
+  double expectedScore(int32_t player1, int32_t player2) const noexcept;
+  /// @brief Compute the negative Hessian and gradient of the log posterior
+  void buildSystem(std::vector<double> &hessian,
+                   std::vector<double> &gradient) const;
+
+  int32_t num_players_{0};
+  /// @brief The precision of the prior, in natural units
+  double prior_precision_{0.0};
+  /// @brief The number of games and the total score of the first player for
+  /// each ordered pair of players
+  std::vector<int32_t> num_games_{};
+  std::vector<double> scores_{};
+  /// @brief The number of results taken from the tourney
+  size_t num_results_read_{0};
+  /// @brief The ratings of players 0 to num_players - 2, then the first
+  /// player advantage, in natural units
+  std::vector<double> params_{};
+  /// @brief The posterior covariance of the parameters
+  std::vector<double> covariance_{};
+};
+
+#endif
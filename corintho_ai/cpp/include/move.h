@@ -4,6 +4,7 @@
 #include <cstdint>
 
 #include <ostream>
+#include <string>
 
 #include "util.h"
 
@@ -65,5 +66,8 @@ int32_t encodePlace(Space space, PieceType piece_type) noexcept;
 int32_t encodeMove(Space spaceFrom, Space spaceTo) noexcept;
 // Convert column index to its name (a, b, c, d)
 char getColName(int32_t col);
+// Get the ID of a move from the notation written by operator<<
+// (for example Ba4 or b3R). Returns -1 if the notation is invalid.
+int32_t parseMove(const std::string &name) noexcept;
 
 #endif
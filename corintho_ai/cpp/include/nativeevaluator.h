@@ -0,0 +1,107 @@
+#ifndef NATIVEEVALUATOR_H
+#define NATIVEEVALUATOR_H
+
+#include <cstdint>
+
+#include <string>
+#include <vector>
+
+#include "evaluator.h"
+
+/// @brief The weights of a fully connected layer
+struct DenseLayer {
+  int32_t num_inputs{0};
+  int32_t num_outputs{0};
+  /// @brief num_inputs rows of num_outputs weights, as in a Keras kernel
+  std::vector<float> weights;
+  std::vector<float> bias;
+};
+
+/// @brief Header of a network file
+/// @details The layout is
+/// Header | (uint32_t num_inputs | uint32_t num_outputs |
+///           float weights[num_inputs][num_outputs] |
+///           float bias[num_outputs])[num_layers]
+///
+/// All layers but the last two are hidden layers with ReLU activations, each
+/// reading the output of the previous layer. The last two layers are the value
+/// head (one output, tanh) and the policy head (kNumMoves outputs, softmax),
+/// which both read the output of the last hidden layer. Batch normalization is
+/// folded into the layer that follows it when the network is exported.
+/// @note export_weights.py writes little-endian files, and they are read in
+/// the byte order of the machine.
+struct NetworkHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t num_layers;
+  uint32_t reserved[5];
+};
+
+constexpr char kNetworkMagic[4] = {'C', 'N', 'E', 'T'};
+constexpr uint32_t kNetworkVersion = 1;
+
+/// @brief Load the layers of a network file
+/// @return Whether the file was read and has the shape described in
+/// NetworkHeader
+bool loadNetwork(const std::string &filename, std::vector<DenseLayer> &layers);
+/// @brief Save layers in the format read by loadNetwork
+/// @return Whether the file was written successfully
+bool saveNetwork(const std::vector<DenseLayer> &layers,
+                 const std::string &filename);
+/// @brief Combine the value and policy heads into one layer
+/// @details The value is output 0 and the policy is outputs 1 to kNumMoves.
+DenseLayer mergeHeads(const DenseLayer &value, const DenseLayer &policy);
+/// @brief Apply tanh to the value and softmax to the policy of merged heads
+/// @param heads num_states rows of outputs of the merged heads, stride apart
+void activateHeads(const float heads[], int32_t stride, int32_t num_states,
+                   float eval[], float probs[]) noexcept;
+
+/// @brief Runs the exported Corintho network in C++
+/// @details The weights are exported from the Keras model by
+/// python/export_weights.py. Each layer is computed for the whole batch at
+/// once. The weights of each layer are padded to a multiple of
+/// kColumnBlock outputs and processed one block of columns at a time, so a
+/// block stays in the L1 cache while all the states in the batch use it. Uses
+/// AVX2 and FMA when the CPU supports them.
+///
+/// The value and policy heads are computed together as one layer. Buffers
+/// only grow, so evaluating does not allocate once the largest batch has been
+/// seen.
+class NativeEvaluator : public Evaluator {
+ public:
+  /// @brief Load a network file
+  /// @details Check NativeEvaluator::is_open to see if the file could be
+  /// loaded.
+  explicit NativeEvaluator(const std::string &filename);
+
+  /// @brief Returns if the network was loaded
+  bool is_open() const noexcept;
+
+  void evaluate(const float game_states[], int32_t num_states, float eval[],
+                float probs[]) override;
+
+  /// @brief The number of outputs computed at once
+  static constexpr int32_t kColumnBlock = 16;
+  /// @brief The number of states computed at once
+  static constexpr int32_t kRowBlock = 4;
+
+  /// @brief A layer with its outputs padded to a multiple of kColumnBlock
+  struct PaddedLayer {
+    int32_t num_inputs{0};
+    int32_t num_outputs{0};
+    /// @brief The padded number of outputs
+    int32_t stride{0};
+    std::vector<float> weights;
+    std::vector<float> bias;
+  };
+
+ private:
+  /// @brief Hidden layers, then the value and policy heads as one layer
+  std::vector<PaddedLayer> layers_;
+  /// @brief The widest padded layer
+  int32_t max_stride_{0};
+  /// @brief Outputs of alternate layers
+  std::vector<float> buffers_[2];
+};
+
+#endif
@@ -51,6 +51,12 @@ class alignas(64) Node {
   /// or 1 more than the depth of parent
   Node(const Game &game, Node *parent, Node *next_sibling, int32_t move_id,
        int32_t depth);
+  /// @brief Construct a node from a saved search tree
+  /// @details The edges are copied from the saved tree instead of being
+  /// generated from the game, so no legal move generation is done.
+  /// @param edges Packed edges, as returned by Node::packed_edge
+  Node(const Game &game, Node *parent, int32_t child_id, int32_t depth,
+       const uint16_t *edges, int32_t num_legal_moves);
 
   Game game() const noexcept;
   Node *parent() const noexcept;
@@ -65,6 +71,10 @@ class alignas(64) Node {
   bool all_visited() const noexcept;
   int32_t move_id(int32_t i) const noexcept;
   float probability(int32_t i) const noexcept;
+  /// @brief Edge i packed into 16 bits
+  /// @details The move ID is in the low 7 bits and the integer probability
+  /// weight is in the high 9 bits.
+  uint16_t packed_edge(int32_t i) const noexcept;
   /// @brief Whether the game is in a terminal position
   bool terminal() const noexcept;
   /// @brief Whether the game result is deduced
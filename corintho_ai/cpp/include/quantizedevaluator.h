@@ -0,0 +1,77 @@
+#ifndef QUANTIZEDEVALUATOR_H
+#define QUANTIZEDEVALUATOR_H
+
+#include <cstdint>
+
+#include <vector>
+
+#include "evaluator.h"
+#include "nativeevaluator.h"
+
+/// @brief Runs the exported network with 8-bit weights and activations
+/// @details Each output of a layer has its own weight scale, so each column of
+/// weights uses the full int8 range. The activations entering each layer are
+/// unsigned with one scale per layer. The scales are calibrated from the
+/// largest activations of the float network on sample positions, such as
+/// training samples from Trainer::writeSamples. Activations above the
+/// calibrated range are clipped.
+///
+/// Activations use 7 bits, so the sums of pairs of products fit in 16 bits
+/// and the AVX2 kernel cannot saturate. The kernels add 4 products of
+/// unsigned activations and signed weights into each 32-bit lane, with
+/// AVX-VNNI when the CPU supports it and AVX2 otherwise. The sums are exact,
+/// so every kernel gives the same outputs.
+///
+/// The entries of the game state are multiples of 0.25 from 0 to 1, so the
+/// input scale is 0.25 / 31 and the inputs are quantized exactly.
+class QuantizedEvaluator : public Evaluator {
+ public:
+  /// @param layers The layers of the network, as read by loadNetwork
+  /// @param game_states Positions to calibrate the activation scales with
+  QuantizedEvaluator(const std::vector<DenseLayer> &layers,
+                     const float game_states[], int32_t num_states);
+
+  void evaluate(const float game_states[], int32_t num_states, float eval[],
+                float probs[]) override;
+
+  /// @brief The number of outputs computed at once
+  static constexpr int32_t kColumnBlock = 16;
+  /// @brief The number of states computed at once
+  static constexpr int32_t kRowBlock = 4;
+  /// @brief The largest quantized activation
+  static constexpr int32_t kMaxActivation = 127;
+
+  /// @brief A layer with quantized weights
+  struct QuantizedLayer {
+    /// @brief The number of inputs, padded to a multiple of 4
+    int32_t num_inputs{0};
+    int32_t num_outputs{0};
+    /// @brief The number of outputs, padded to a multiple of kColumnBlock
+    int32_t stride{0};
+    /// @brief Weights in groups of 4 inputs
+    /// @details Group g holds, for each output j, the weights of inputs 4g to
+    /// 4g + 3 for output j, so the 4 weights of 8 outputs are 32 contiguous
+    /// bytes.
+    std::vector<int8_t> weights;
+    /// @brief The value of one unit of the sum of each output
+    /// @details This is the input scale times the weight scale of the output.
+    std::vector<float> scales;
+    std::vector<float> bias;
+    /// @brief The value of one unit of the inputs
+    float input_scale{1.0};
+  };
+
+ private:
+  /// @brief Hidden layers, then the value and policy heads as one layer
+  std::vector<QuantizedLayer> layers_;
+  /// @brief The widest padded layer
+  int32_t max_stride_{0};
+  /// @brief The quantized inputs of alternate layers
+  std::vector<uint8_t> activations_[2];
+  /// @brief The sums of the current layer
+  std::vector<int32_t> sums_;
+  /// @brief The outputs of the current layer
+  std::vector<float> outputs_;
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef REQUESTQUEUE_H
+#define REQUESTQUEUE_H
+
+#include <cstdint>
+
+#include <deque>
+#include <mutex>
+#include <vector>
+
+/// @brief A queue of evaluation requests for assembling batches of a fixed
+/// size
+/// @details Any number of threads can push requests. A single consumer pops
+/// them in order into batches. Each request is a group of rows, such as the
+/// positions requested by one game, and is never split between batches.
+class RequestQueue {
+ public:
+  /// @brief A group of rows to evaluate together
+  struct Request {
+    /// @brief The ID of the requester, such as a game index
+    int32_t id;
+    int32_t num_rows;
+  };
+
+  RequestQueue() = default;
+  RequestQueue(const RequestQueue &) = delete;
+  RequestQueue &operator=(const RequestQueue &) = delete;
+  ~RequestQueue() = default;
+
+  /// @brief Return the number of requests in the queue
+  int32_t size() const;
+  /// @brief Return the total number of rows in the queue
+  int32_t num_rows() const;
+
+  /// @brief Add a request to the back of the queue
+  void push(int32_t id, int32_t num_rows);
+  /// @brief Remove requests from the front of the queue while they fit in a
+  /// batch
+  /// @param max_rows The size of the batch
+  /// @param batch Receives the requests in order
+  /// @return The number of rows of the requests in the batch
+  int32_t popBatch(int32_t max_rows, std::vector<Request> &batch);
+
+ private:
+  mutable std::mutex mutex_;
+  std::deque<Request> requests_{};
+  int32_t num_rows_{0};
+};
+
+#endif
@@ -13,6 +13,8 @@
 #include "trainmc.h"
 #include "util.h"
 
+struct PackedGame;
+
 /// @brief A training sample for the neural network
 /// @details The evaluation sample is not store as it is computed only when the
 /// game is complete.
@@ -31,7 +33,8 @@ class SelfPlayer {
              int32_t searches_per_eval = 16, float c_puct = 1.0,
              float epsilon = 0.25,
              std::unique_ptr<std::ofstream> log_file = nullptr,
-             bool testing = false, int32_t parity = 0);
+             bool testing = false, int32_t parity = 0,
+             bool stop_futile = false);
   SelfPlayer(SelfPlayer &&other) = default;
   ~SelfPlayer() = default;
 
@@ -56,6 +59,28 @@ class SelfPlayer {
   /// @param game_states The array to write the game states to
   /// This is the input to the neural network
   void writeRequests(float *game_states) const noexcept;
+  /// @brief Write the game states for which evaluations are requested as
+  /// packed game states
+  void writePackedRequests(PackedGame packed[]) const noexcept;
+  /// @brief Write the game states for which evaluations are requested to a
+  /// different location
+  /// @details Trainer uses this to place the requests of each game straight
+  /// into the neural network input. See TrainMC::set_to_eval.
+  void set_to_eval(float *to_eval) noexcept;
+  /// @brief Change the number of searches per evaluation of both players
+  /// @details See TrainMC::set_searches_per_eval.
+  void set_searches_per_eval(int32_t searches_per_eval) noexcept;
+  /// @brief Evaluate the leaves of both players with playouts
+  /// @details See TrainMC::set_rollout. A game then plays to the end in its
+  /// first iteration.
+  void set_rollout(TrainMC::Rollout rollout,
+                   int32_t num_playouts = 1) noexcept;
+  /// @brief Set the virtual loss of both players
+  /// @details See TrainMC::set_virtual_loss.
+  void set_virtual_loss(float virtual_loss) noexcept;
+  /// @brief Return the number of search collisions of both players
+  /// @details See TrainMC::num_collisions.
+  int32_t num_collisions() const noexcept;
   /// @brief Write the training samples
   /// @details This includes the game state, game outcome, and final move
   /// probabilities
@@ -65,8 +90,28 @@ class SelfPlayer {
   /// @brief Do an iteration of searches for the current player
   /// @return If the game is complete
   bool doIteration(float eval[] = nullptr, float probs[] = nullptr);
+  /// @brief Stop the game without a result and free the search trees
+  void cancel() noexcept;
 
  private:
+  /// @brief Where the game is in the hand-off between turns
+  /// @details Between iterations, SelfPlayer is either searching or done.
+  /// The other states only last within chooseMoveAndContinue.
+  enum class State {
+    /// @brief The player to play is searching. The next iteration continues
+    /// its turn.
+    kSearching,
+    /// @brief The player to play finished its turn and chooses a move.
+    kChoosing,
+    /// @brief The opponent has no tree yet. It creates its root at the new
+    /// position and searches.
+    kFirstTurn,
+    /// @brief The opponent receives the chosen move. It needs an evaluation
+    /// if it has not searched the move, and otherwise searches.
+    kReceiving,
+    /// @brief The game ended or was cancelled.
+    kDone,
+  };
   /// @brief Write the evaluation of the given node
   void writeEval(Node *node) const noexcept;
   /// @brief Write the legal movesof the root
@@ -82,16 +127,23 @@ class SelfPlayer {
   /// @return The ID of the chosen move
   int32_t chooseMove();
   /// @brief Choose a move and then do an iteration of searches
+  /// @details Moves through SelfPlayer::State from kChoosing until a player
+  /// needs evaluations or the game ends.
+  /// @return If the game is complete
   bool chooseMoveAndContinue();
   /// @brief Random generator for all operations
   /// @details Shared with the TrainMC objects
   std::mt19937 generator_{};
   /// @brief Positions needing evaluation
+  /// @details Holds TrainMC::searches_per_eval_ positions. It is not used if
+  /// the requests are written elsewhere with SelfPlayer::set_to_eval.
   std::unique_ptr<float[]> to_eval_{};
   /// @brief Monte Carlo search trees for each player
   TrainMC players_[2];
   /// @brief Whose turn it is
   int32_t to_play_{0};
+  /// @brief See SelfPlayer::State
+  State state_{State::kSearching};
   /// @brief Training samples
   std::vector<Sample> samples_{};
   /// @brief Game result for the first player
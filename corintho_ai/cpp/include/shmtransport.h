@@ -0,0 +1,188 @@
+#ifndef SHMTRANSPORT_H
+#define SHMTRANSPORT_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "game.h"
+
+class Evaluator;
+
+/// @brief Shared memory that connects self-play workers in other processes
+/// to one inference process
+/// @details The segment is a POSIX shared memory object with one channel per
+/// worker. Each channel has a ring of request slots, written by the worker
+/// and read by the server, and a ring of response slots, written by the
+/// server and read by the worker. Each ring has a single producer and a
+/// single consumer, so it only needs an atomic head and tail. A request is up
+/// to max_rows packed game states, and its response has the evaluation and
+/// probabilities of each row.
+///
+/// The layout is
+/// Header | Channel[num_channels] |
+/// (request slots[num_slots] | response slots[num_slots])[num_channels]
+///
+/// The server only takes a request when the response ring of its channel has
+/// room, so a worker that stops reading blocks only itself. A worker that
+/// sends faster than the server evaluates finds its request ring full and
+/// waits.
+///
+/// A worker that restarts attaches to the same channel and continues from the
+/// indices of the rings. Attaching increments the epoch of the channel, and
+/// responses to requests sent under an older epoch are dropped, so the new
+/// worker never reads results meant for the old one.
+/// @note Each channel must have at most one worker attached at a time.
+class ShmSegment {
+ public:
+  /// @brief Segment header
+  struct Header {
+    char magic[4];
+    uint32_t version;
+    uint32_t num_channels;
+    uint32_t num_slots;
+    uint32_t max_rows;
+    uint32_t reserved[2];
+    /// @brief Set by the server once the channels are initialized
+    std::atomic<uint32_t> ready;
+  };
+  /// @brief A ring of slots with one producer and one consumer
+  /// @details The indices only increase. Slot i is at index i % num_slots.
+  /// The head and tail are on separate cache lines, so the producer and
+  /// consumer do not write to the same line.
+  struct Ring {
+    /// @brief The number of slots read by the consumer
+    alignas(64) std::atomic<uint64_t> head;
+    /// @brief The number of slots written by the producer
+    alignas(64) std::atomic<uint64_t> tail;
+  };
+  /// @brief The shared state of one worker
+  struct Channel {
+    Ring requests;
+    Ring responses;
+    /// @brief The number of times a worker has attached
+    alignas(64) std::atomic<uint32_t> epoch;
+    /// @brief Whether the attached worker has finished
+    std::atomic<uint32_t> done;
+  };
+  /// @brief The start of a request or response slot
+  /// @details A request slot continues with num_rows PackedGame rows. A
+  /// response slot continues with num_rows evaluations, then num_rows rows of
+  /// kNumMoves probabilities.
+  struct Slot {
+    /// @brief The epoch of the channel when the request was sent
+    uint32_t epoch;
+    int32_t num_rows;
+    uint64_t reserved;
+  };
+
+  static constexpr char kMagic[4] = {'C', 'S', 'H', 'M'};
+  static constexpr uint32_t kVersion = 1;
+
+  ShmSegment() = default;
+  ShmSegment(const ShmSegment &) = delete;
+  ShmSegment &operator=(const ShmSegment &) = delete;
+  ~ShmSegment();
+
+  /// @brief Returns if the segment is mapped and ready
+  bool is_open() const noexcept;
+  int32_t num_channels() const noexcept;
+  int32_t num_slots() const noexcept;
+  /// @brief Returns the most rows in one request
+  int32_t max_rows() const noexcept;
+
+ protected:
+  /// @brief Return the size of a segment in bytes
+  static size_t segmentSize(int32_t num_channels, int32_t num_slots,
+                            int32_t max_rows) noexcept;
+  /// @brief Map the shared memory object fd and close it
+  bool map(int fd, size_t size) noexcept;
+  Channel &channel(int32_t i) const noexcept;
+  /// @brief Return the request slot at index i of a ring
+  Slot *requestSlot(int32_t channel, uint64_t i) const noexcept;
+  /// @brief Return the response slot at index i of a ring
+  Slot *responseSlot(int32_t channel, uint64_t i) const noexcept;
+
+  /// @brief Start of the mapping, or nullptr if the segment is not mapped
+  char *data_{nullptr};
+  /// @brief Size of the mapping in bytes
+  size_t size_{0};
+  Header *header_{nullptr};
+  /// @brief Sizes of the slots in bytes
+  size_t request_size_{0};
+  size_t response_size_{0};
+};
+
+/// @brief The inference side of a shared memory segment
+/// @details The server creates the segment and removes it when destroyed.
+/// ShmServer::serve gathers the waiting requests of all channels into one
+/// batch for the evaluator.
+class ShmServer : public ShmSegment {
+ public:
+  /// @brief Create a segment
+  /// @param name The name of the shared memory object, starting with '/'
+  /// @details Check ShmServer::is_open to see if it could be created. An
+  /// existing segment with the same name is replaced.
+  ShmServer(const std::string &name, int32_t num_channels, int32_t num_slots,
+            int32_t max_rows);
+  ~ShmServer();
+
+  /// @brief Evaluate the waiting requests of all channels as one batch
+  /// @param max_batch The most rows to evaluate. Requests are never split.
+  /// @return The number of rows evaluated
+  /// @details Channels are visited round-robin, starting one after the
+  /// channel visited first in the last call, so no worker always waits
+  /// behind the others.
+  int32_t serve(Evaluator &evaluator, int32_t max_batch);
+  /// @brief Returns if every channel has a worker that has finished
+  bool all_done() const noexcept;
+
+ private:
+  /// @brief A request taken into the current batch
+  struct Taken {
+    int32_t channel;
+    uint32_t epoch;
+    int32_t num_rows;
+  };
+
+  std::string name_;
+  int32_t first_channel_{0};
+  std::vector<Taken> taken_;
+  std::vector<PackedGame> packed_;
+  std::vector<float> game_states_;
+  std::vector<float> eval_;
+  std::vector<float> probs_;
+};
+
+/// @brief The worker side of a shared memory segment
+class ShmClient : public ShmSegment {
+ public:
+  /// @brief Attach to a channel of a segment created by ShmServer
+  /// @details Check ShmClient::is_open to see if the segment exists and is
+  /// ready.
+  ShmClient(const std::string &name, int32_t channel);
+
+  /// @brief Try to send a request without waiting
+  /// @return False if the request ring is full
+  bool trySend(const PackedGame packed[], int32_t num_rows) noexcept;
+  /// @brief Try to receive the oldest response without waiting
+  /// @return The number of rows of the response, or 0 if none has arrived
+  /// @details Responses arrive in the order of the requests.
+  int32_t tryReceive(float eval[], float probs[]) noexcept;
+  /// @brief Send game states and wait for their evaluations
+  /// @details Any number of rows can be sent. They are split into requests
+  /// of at most max_rows, which are sent while the ring has room.
+  void evaluate(const PackedGame packed[], int32_t num_rows, float eval[],
+                float probs[]) noexcept;
+  /// @brief Tell the server that this worker has finished
+  void finish() noexcept;
+
+ private:
+  int32_t channel_{0};
+  uint32_t epoch_{0};
+};
+
+#endif
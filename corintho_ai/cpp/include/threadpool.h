@@ -0,0 +1,88 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <cstdint>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// @brief A persistent pool of threads for running batches of tasks
+/// @details Each thread has its own deque of task indices. A thread takes
+/// tasks from the back of its own deque and, when that is empty, steals from
+/// the front of the other deques. This keeps all threads busy when task costs
+/// are very uneven, as with self-play games where one call may play several
+/// turns and another returns almost immediately.
+///
+/// The thread calling ThreadPool::parallelFor also runs tasks, so a pool of n
+/// threads starts n - 1 worker threads. ThreadPool::start runs a batch on the
+/// worker threads only and returns at once.
+class ThreadPool {
+ public:
+  /// @param num_threads The number of threads, or 0 for the number of
+  /// hardware threads
+  explicit ThreadPool(int32_t num_threads);
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool(ThreadPool &&) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+  ThreadPool &operator=(ThreadPool &&) = delete;
+  ~ThreadPool();
+
+  int32_t num_threads() const noexcept;
+
+  /// @brief Run task(i) for every i in [0, num_tasks) and wait for all of them
+  /// @details Tasks must not call parallelFor.
+  void parallelFor(int32_t num_tasks,
+                   const std::function<void(int32_t)> &task);
+  /// @brief Start running task(i) for every i in [0, num_tasks) and return
+  /// @details The tasks run on the worker threads while the caller does
+  /// other work. Call ThreadPool::wait before starting another batch. A pool
+  /// with 1 thread has no workers, so it runs the tasks before returning.
+  void start(int32_t num_tasks, std::function<void(int32_t)> task);
+  /// @brief Wait for the tasks of the current batch to complete
+  void wait();
+
+ private:
+  /// @brief A deque of task indices with its own lock
+  struct Queue {
+    std::mutex mutex;
+    std::deque<int32_t> tasks;
+  };
+
+  /// @brief Give the tasks of a batch to the queues from first_queue on
+  /// and wake the workers
+  void distribute(int32_t num_tasks, const std::function<void(int32_t)> *task,
+                  int32_t first_queue);
+  /// @brief The body of the worker threads
+  void workerLoop(int32_t id);
+  /// @brief Run tasks until none can be found
+  void runTasks(int32_t id);
+  /// @brief Take a task from queue id, or steal one from another queue
+  /// @return The task index, or -1 if all queues are empty
+  int32_t takeTask(int32_t id);
+
+  std::vector<std::unique_ptr<Queue>> queues_{};
+  std::vector<std::thread> workers_{};
+  /// @brief The task of the current batch
+  const std::function<void(int32_t)> *task_{nullptr};
+  /// @brief The task of a batch started with ThreadPool::start
+  std::function<void(int32_t)> async_task_{};
+  /// @brief The number of tasks of the current batch that are not complete
+  std::atomic<int32_t> remaining_{0};
+  /// @brief Guards batch_ and stop_
+  std::mutex mutex_;
+  /// @brief Signals workers that a batch started or the pool is stopping
+  std::condition_variable start_;
+  /// @brief Signals the caller that the batch is complete
+  std::condition_variable done_;
+  /// @brief Incremented for each batch
+  int64_t batch_{0};
+  bool stop_{false};
+};
+
+#endif
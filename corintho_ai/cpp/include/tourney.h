@@ -7,43 +7,117 @@
 #include <memory>
 #include <random>
 #include <string>
+#include <vector>
 
 #include "match.h"
+#include "threadpool.h"
 
+/// @brief Plays matches between players that use different models
+/// @details Each iteration can advance the matches of one model, or of all
+/// models at once. When all models are advanced together, the requests are
+/// grouped by model into one buffer: the requests of each model form a
+/// contiguous region starting at Tourney::offset, with models in increasing
+/// order of ID. Each model evaluates its own region, and no match waits for
+/// the turn of another model.
+///
+/// Added matches are kept as small records until they are played. At most
+/// max_active matches are created at a time, in the order they were added.
+/// A finished match is destroyed as soon as its score is recorded, and the
+/// next waiting match takes its place, so a large tourney runs in a fixed
+/// amount of memory with steady batches. The seed of each match is drawn
+/// when it is added, so the results do not depend on max_active.
 class Tourney {
  public:
-  Tourney(int32_t num_threads, std::string log_folder)
-      : num_threads_{num_threads}, log_folder_{log_folder} {
-    assert(num_threads > 0);
-  }
+  /// @brief The result of a finished match
+  struct MatchResult {
+    int32_t player1;
+    int32_t player2;
+    /// @brief The score of the first player
+    float score;
+  };
+
+  /// @param max_active The most matches played at a time, or 0 for no limit
+  Tourney(int32_t num_threads, std::string log_folder,
+          int32_t max_active = 0);
   ~Tourney() = default;
 
   /// @brief Return true if all games are done
   bool all_done() const noexcept;
-  /// @brief Return the number of requests for evaluations for a given model
-  int32_t num_requests(int32_t id) const noexcept;
+  /// @brief Return the number of requests for evaluations for a given model,
+  /// or for all models if id is -1
+  int32_t num_requests(int32_t id = -1) const noexcept;
+  /// @brief Return the first row of the requests of a model in the buffer of
+  /// all models
+  int32_t offset(int32_t id) const noexcept;
+  /// @brief Return the IDs of the models with requests, in increasing order
+  std::vector<int32_t> model_ids() const;
+  /// @brief Return the number of matches being played
+  int32_t num_active() const noexcept;
+  /// @brief Return the results of the finished matches, in the order they
+  /// finished
+  const std::vector<MatchResult> &results() const noexcept;
+  /// @brief Return the average score of a player in its finished matches
+  /// @details 0.5 if the player has not finished a match
+  float score(int32_t player_id) const noexcept;
 
   /// @brief Write completed game results into a file
   void writeScores(const std::string &filename) const;
   /// @brief Write the game states for which evaluations are requested for a
-  /// given model
-  void writeRequests(float *game_states, int32_t id) noexcept;
+  /// given model, or for all models grouped by model if id is -1
+  void writeRequests(float *game_states, int32_t id = -1) noexcept;
 
   /// @brief Iterate the games until an evaluation is needed
-  void doIteration(float eval[], float probs[], int32_t id);
+  /// @details If id is -1, every match is advanced, and the evaluations are
+  /// read in the layout of Tourney::writeRequests for all models. Otherwise
+  /// only the matches where model id is to play are advanced.
+  void doIteration(float eval[], float probs[], int32_t id = -1);
+  /// @param rollout A TrainMC::Rollout. A player with rollouts needs no
+  /// model, like a random player, so it can play before any model exists.
   void addPlayer(int32_t player_id, int32_t model_id,
                  int32_t max_searches = 1600, int32_t searches_per_eval = 16,
                  float c_puct = 1.0, float epsilon = 0.25,
-                 bool random = false);
+                 bool random = false, int32_t rollout = 0);
   void addMatch(int32_t player1, int32_t player2, bool logging = false);
 
  private:
+  /// @brief A match that was added to the tourney
+  struct MatchRecord {
+    int32_t seed;
+    int32_t player1;
+    int32_t player2;
+    bool logging;
+  };
+
+  /// @brief Create the next waiting matches while there is room
+  void startMatches();
+  /// @brief Return the number of requests of each model
+  std::map<int32_t, int32_t> countRequests() const;
+  /// @brief Set the row of the requests of each match in the buffer of all
+  /// models
+  void groupRequests();
+
+  /// @brief Every added match, in the order they were added
+  std::vector<MatchRecord> records_{};
+  /// @brief The index of the next match to create
+  size_t next_match_{0};
+  std::vector<MatchResult> results_{};
+  /// @brief The matches being played
   std::vector<std::unique_ptr<Match>> matches_{};
-  std::vector<bool> is_done_{};
+  /// @brief The record of each match being played
+  std::vector<int32_t> record_ids_{};
+  /// @brief Whether each match being played has finished in this iteration
+  /// @details This is not a std::vector<bool>, as matches finish on different
+  /// threads.
+  std::vector<uint8_t> is_done_{};
+  /// @brief The row of the requests of each match being played. See
+  /// Tourney::groupRequests
+  std::vector<int32_t> offsets_{};
   std::map<int32_t, Player> players_{};
   std::mt19937 generator_{};
   int32_t num_threads_{1};
   std::string log_folder_{};
+  int32_t max_active_{0};
+  std::unique_ptr<ThreadPool> pool_{};
 };
 
 #endif
\ No newline at end of file
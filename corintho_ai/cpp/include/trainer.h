@@ -3,17 +3,28 @@
 
 #include <cstdint>
 
+#include <chrono>
 #include <memory>
 #include <random>
 #include <string>
 #include <vector>
 
+#include "evaltuner.h"
+#include "requestqueue.h"
 #include "selfplayer.h"
+#include "threadpool.h"
+#include "trainmc.h"
 #include "util.h"
 
+class Evaluator;
+struct PackedGame;
+
 /// @brief Orchestrates many SelfPlayer objects to generate training samples
 /// from self-play games
-/// @details This is the class that is used by Cython
+/// @details This is the class that is used by Cython. At most num_slots
+/// games are played at a time. When a game finishes, a new game with a new
+/// seed starts in its slot, until num_games games have started. This keeps
+/// the batches full instead of ending with a long tail of few games.
 class Trainer {
  public:
   /// @brief Default constructor
@@ -22,14 +33,28 @@ class Trainer {
   Trainer(int32_t num_games, const std::string &log_folder, int32_t seed,
           int32_t max_searches = 1600, int32_t searches_per_eval = 16,
           float c_puct = 1.0, float epsilon = 0.25, int32_t num_logged = 10,
-          int32_t num_threads = 1, bool testing = false);
+          int32_t num_threads = 1, bool testing = false,
+          bool stop_futile = false, int32_t num_cohorts = 1,
+          int32_t num_slots = 0);
   ~Trainer() = default;
 
   /// @brief Return the number of requests for evaluations
+  /// @details In training, this is Trainer::batch_size of the first cohort.
   int32_t num_requests(int32_t to_play = -1) const noexcept;
+  /// @brief Return the number of rows of the batch of a cohort in training
+  /// @details This is the total number of requests of the cohort. See
+  /// Trainer::requests.
+  int32_t batch_size(int32_t cohort) const noexcept;
+  /// @brief Return the number of games started so far
+  int32_t num_games() const noexcept;
   /// @brief Return the number of training samples
   int32_t num_samples() const noexcept;
+  /// @brief Return the number of search collisions in all games
+  /// @details See TrainMC::num_collisions.
+  int64_t num_collisions() const noexcept;
   /// @brief Average score of first player
+  /// @details Only finished games count, and after the test decides, only
+  /// the games it counted. See Trainer::set_sprt.
   float score() const noexcept;
   /// @brief Return the average mate length
   float avg_mate_length() const noexcept;
@@ -37,7 +62,24 @@ class Trainer {
   /// @brief Write the game states for which evaluations are requested
   /// @param game_states The array to write the game states to
   /// @return The number of requests for evaluations
+  /// @details In training, Trainer::requests avoids this copy.
   void writeRequests(float *game_states, int32_t to_play = -1) const noexcept;
+  /// @brief Write the game states for which evaluations are requested as
+  /// packed game states
+  /// @details This has the same layout as Trainer::writeRequests, with one
+  /// 16-byte PackedGame per row instead of kGameStateSize floats. Use
+  /// expandGameStates where the neural network reads them.
+  void writePackedRequests(PackedGame packed[],
+                           int32_t to_play = -1) const noexcept;
+  /// @brief Return the game states for which evaluations are requested in
+  /// training
+  /// @details The games write their requests straight into this batch, so it
+  /// can be passed to the neural network as is. The requests of the games
+  /// of the cohort that searched in the last iteration follow each other
+  /// in the order of the games, with no unused rows. The evaluations for a
+  /// row are expected at the same index in the arrays passed to the next
+  /// doIteration or submit.
+  float *requests(int32_t cohort = 0) noexcept;
   /// @brief Write the training samples
   void writeSamples(float *game_states, float *eval_samples,
                     float *prob_samples) const noexcept;
@@ -50,19 +92,206 @@ class Trainer {
   /// @brief This is the main function that runs the self-play games. It is
   /// called by Cython in a loop.
   /// @return If all games are done
+  /// @details In training, this requires a single cohort.
   bool doIteration(float eval[], float probs[], int32_t to_play = -1);
+  /// @brief Evaluate training requests in batches of a fixed size
+  /// @details Games that need evaluations queue their requests, and each
+  /// batch takes requests from the front of the queue while they fit. A
+  /// game searches again once its batch is evaluated. Batches then stay
+  /// within searches_per_eval rows of the size however many games are left,
+  /// instead of shrinking at the end of a generation. Games start over the
+  /// first iterations as without the queue (see Trainer::startGames). This
+  /// requires a single cohort and must be called before the first
+  /// iteration.
+  /// @param batch_size The number of rows per batch, at least
+  /// searches_per_eval. 0 turns the queue off.
+  void set_batch_size(int32_t batch_size) noexcept;
+  /// @brief Stop starting games once the finished games have this many
+  /// training samples
+  /// @details The games that are playing still finish, so there can be more
+  /// samples than this.
+  void set_target_samples(int32_t num_samples) noexcept;
+  /// @brief Whether to tune the searches per evaluation as the games run
+  /// @details The searches per evaluation of each game is kept between 1 and
+  /// the constructor's searches_per_eval from the measured search and
+  /// evaluation times. See EvalTuner. The evaluation time is the time
+  /// between calls to doIteration. Each game of the batch then has this
+  /// many rows. This requires training with a single cohort and without
+  /// Trainer::set_batch_size.
+  void set_autotune(bool autotune) noexcept;
+  /// @brief Stop testing early with a sequential probability ratio test
+  /// @details As test games finish, the log-likelihood ratio of the new
+  /// model (the player with to_play 0) being elo1 rather than elo0 Elo
+  /// stronger is updated. Games are counted in colour pairs (games 2k and
+  /// 2k + 1) in order of game index, once every game before them is
+  /// counted, so short games that finish first do not bias the test. Once
+  /// the ratio crosses a bound, the games that are still playing are
+  /// cancelled, their trees are freed, and no more games start. Finished
+  /// games after the counted pairs are left out like the cancelled ones.
+  /// The ratio uses the normal approximation of the score of a game, so
+  /// draws count as half a win. Playing the games in slots (see the
+  /// constructor's num_slots) keeps the work that is cancelled small. This
+  /// requires testing and must be called before the first iteration.
+  /// @param alpha The chance of accepting a model that is elo0 stronger
+  /// @param beta The chance of rejecting a model that is elo1 stronger
+  void set_sprt(float elo0, float elo1, float alpha = 0.05,
+                float beta = 0.05) noexcept;
+  /// @brief Return 1 if the test accepted the new model, -1 if it rejected
+  /// it, and 0 if it did not decide
+  int32_t sprt_result() const noexcept;
+  /// @brief Return the log-likelihood ratio of the test so far
+  float llr() const noexcept;
+  /// @brief Return the number of games the test has counted
+  /// @details These are the first games by index, in whole colour pairs.
+  int32_t sprt_num_games() const noexcept;
+  /// @brief Evaluate the leaves of all games with playouts
+  /// @details See TrainMC::set_rollout. No evaluations are requested, so
+  /// each game plays to the end in its first iteration. This gives training
+  /// samples before there is a model, and a workload of the search alone.
+  /// This must be called before the first iteration.
+  void set_rollout(TrainMC::Rollout rollout,
+                   int32_t num_playouts = 1) noexcept;
+  /// @brief Set the virtual loss of the searches in all games
+  /// @details See TrainMC::set_virtual_loss. This must be called before the
+  /// first iteration.
+  void set_virtual_loss(float virtual_loss) noexcept;
+  /// @brief Play all games to the end, evaluating with an Evaluator
+  /// @details This is the loop that the Python training and testing drive,
+  /// for running the games without Python. In training with more than one
+  /// cohort, one cohort searches while the batch of another is evaluated.
+  /// In testing, the evaluator plays both sides.
+  void run(Evaluator &evaluator);
+  /// @brief Play all testing games to the end
+  /// @param first The network of the player that moves first in even games
+  /// @param second The network of the other player
+  void run(Evaluator &first, Evaluator &second);
+  /// @brief Start an iteration of a cohort of training games and return
+  /// @details The cohort searches on its own threads, so the batch of
+  /// another cohort can be evaluated meanwhile. The arrays must not change
+  /// until Trainer::complete returns for this cohort.
+  /// @param eval The evaluations of the last batch of the cohort
+  /// @param probs The probabilities of the last batch of the cohort
+  void submit(int32_t cohort, float eval[], float probs[]);
+  /// @brief Wait for the iteration of a cohort started with Trainer::submit
+  /// @return If all games of the cohort are done
+  bool complete(int32_t cohort);
 
  private:
-  // Initialize SelfPlayers (factored out of different version of constructor)
-  void initialize(int32_t num_games, const std::string &log_folder,
-                  int32_t max_searches, int32_t searches_per_eval,
-                  float c_puct, float epsilon, int32_t num_logged,
-                  bool testing);
+  /// @brief A group of games that search and are evaluated together
+  /// @details With more than one cohort, one cohort searches while the
+  /// batch of another is evaluated, so search and evaluation overlap.
+  /// Games join the cohort whose slot they start in.
+  struct Cohort {
+    /// @brief Indices of the games that are not done, in increasing order
+    std::vector<int32_t> active{};
+    /// @brief The maximum number of games of the cohort playing at a time
+    int32_t num_slots{0};
+    /// @brief The batch of game states to evaluate in training
+    /// @details Sized for searches_per_eval requests from every slot of the
+    /// cohort. See Trainer::requests.
+    std::unique_ptr<float[]> to_eval{};
+    /// @brief The number of rows of Cohort::to_eval in use
+    int32_t batch_size{0};
+    /// @brief The number of games that searched in the current iteration
+    int32_t num_ready{0};
+    /// @brief The number of iterations done so far
+    /// @details This is used to offset the start of the games.
+    int32_t searches_done{0};
+    /// @brief Threads that run the games
+    /// @details Created once, so threads are not started on every iteration
+    std::unique_ptr<ThreadPool> pool{};
+  };
+
+  /// @brief Run an iteration of the training games in the last batch and
+  /// assemble the next batch from the queue
+  /// @return If all games are done
+  bool doQueuedIteration(float eval[], float probs[]);
+  /// @brief Run an iteration of the training games of a cohort
+  /// @param wait Whether to return when the iteration is complete
+  void searchCohort(Cohort &cohort, float eval[], float probs[], bool wait);
+  /// @brief Update a cohort after its iteration is complete
+  /// @return If all games of the cohort are done
+  bool finishCohort(Cohort &cohort);
+  // Initialize the cohorts (factored out of different version of constructor)
+  void initialize(int32_t num_slots, int32_t num_cohorts);
+  /// @brief Start games in the free slots of a cohort
+  /// @details In training, the number of games playing grows with
+  /// Cohort::searches_done at first, so the memory peaks of the games do not
+  /// coincide. The new games are added to the end of Cohort::active and
+  /// search in the next iteration.
+  /// @return The number of games started
+  int32_t startGames(Cohort &cohort);
+  /// @brief Remove games that are done from Cohort::active
+  void removeDoneGames(Cohort &cohort) noexcept;
+  /// @brief Add a finished test game to the test and cancel the other games
+  /// once it decides
+  void updateSprt(Cohort &cohort);
 
-  /// @brief The self-play games
+  /// @brief The self-play games started so far
+  /// @details Reserved for all games, since the players point into their
+  /// SelfPlayer.
   std::vector<SelfPlayer> games_{};
   /// @brief Tracks which games are done
-  std::vector<bool> is_done_{};
+  /// @details Bytes rather than std::vector<bool>, so threads can set the
+  /// flags of different games without a data race.
+  std::vector<uint8_t> is_done_{};
+  /// @brief The first row of the requests of each game in the last batch
+  /// of its cohort
+  /// @details Only updated for the games that search, so this is maintained
+  /// for the active games only.
+  std::vector<int32_t> offsets_{};
+  /// @brief The cohorts of games
+  /// @details Testing uses a single cohort.
+  std::vector<Cohort> cohorts_{};
+  /// @brief The number of rows per batch with the request queue, or 0 if
+  /// the queue is not used
+  int32_t eval_batch_size_{0};
+  /// @brief Chooses the searches per evaluation. See Trainer::set_autotune
+  EvalTuner tuner_{};
+  bool autotune_{false};
+  /// @brief The most rows of each game in a batch
+  /// @details This is searches_per_eval_ unless it is tuned.
+  int32_t rows_per_game_{16};
+  /// @brief When the last training iteration ended
+  std::chrono::steady_clock::time_point search_end_{};
+  /// @brief The seconds spent in the last training iteration
+  double search_time_{0.0};
+  /// @brief Games waiting for an evaluation. See Trainer::set_batch_size
+  RequestQueue queue_{};
+  /// @brief The requests in the last batch of the queue
+  std::vector<RequestQueue::Request> batch_requests_{};
+  /// @brief The number of games to play
+  int32_t num_games_{0};
+  /// @brief The number of samples at which no more games are started, or -1
+  /// for none
+  int32_t target_samples_{-1};
+  /// @brief The number of samples of the games that are done
+  int32_t finished_samples_{0};
+  /// @brief Settings for the games that are started
+  std::string log_folder_{};
+  int32_t num_logged_{0};
+  float c_puct_{1.0};
+  float epsilon_{0.25};
+  bool testing_{false};
+  bool stop_futile_{false};
+  float virtual_loss_{1.0};
+  /// @brief See Trainer::set_rollout
+  TrainMC::Rollout rollout_{TrainMC::Rollout::kNone};
+  int32_t num_playouts_{1};
+  /// @brief The sequential probability ratio test. See Trainer::set_sprt
+  bool sprt_{false};
+  /// @brief The expected scores of the new model under each hypothesis
+  double sprt_score0_{0.5};
+  double sprt_score1_{0.5};
+  /// @brief The bounds of the log-likelihood ratio to reject and accept
+  double sprt_lower_{0.0};
+  double sprt_upper_{0.0};
+  int32_t sprt_result_{0};
+  /// @brief The wins, draws and losses of the new model in counted games
+  int32_t sprt_counts_[3]{0, 0, 0};
+  /// @brief The first game the test has not counted
+  /// @details This is always the start of a colour pair.
+  int32_t sprt_next_{0};
   /// @brief Maximum number of searches per turn for the players
   /// @details This is used to compute offsets for starting the games
   int32_t max_searches_{1600};
@@ -71,12 +300,9 @@ class Trainer {
   /// input and output
   int32_t searches_per_eval_{16};
   /// @brief The number of threads to use
-  /// @details If 0, then use the number of threads available (which OpenMP
-  /// will automatically do)
+  /// @details If 0, then use the number of threads available. With more
+  /// than one cohort, each cohort has this many threads.
   int32_t num_threads_{0};
-  /// @brief The number of searches done so far
-  /// TODO: Is this searches or evaluations?
-  int32_t searches_done_{0};
   /// @brief Random number generator
   std::mt19937 generator_{};
 };
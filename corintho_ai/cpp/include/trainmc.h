@@ -3,17 +3,31 @@
 
 #include <cstdint>
 
+#include <chrono>
 #include <random>
+#include <string>
 #include <vector>
 
 #include "util.h"
 
 class Game;
 class Node;
+struct PackedGame;
 
 /// @brief Class for Monte Carlo tree search
 class TrainMC {
  public:
+  /// @brief How leaves are evaluated. See TrainMC::set_rollout
+  enum class Rollout {
+    /// @brief The caller evaluates leaves with a neural network
+    kNone,
+    /// @brief Playouts choose uniformly random moves
+    kRandom,
+    /// @brief Playouts take a winning move when there is one, and otherwise
+    /// choose uniformly random moves
+    kHeuristic,
+  };
+
   /// @brief Constructor
   TrainMC(std::mt19937 *generator, float *to_eval, int32_t max_searches = 1600,
           int32_t searches_per_eval = 16, float c_puct = 1.0,
@@ -48,6 +62,72 @@ class TrainMC {
   /// @brief Returns if the game is drawn. This is used in the web app.
   bool drawn() const noexcept;
   int32_t max_searches() const noexcept { return max_searches_; }
+  /// @brief Returns the number of searches done for the current turn
+  int32_t searches_done() const noexcept { return searches_done_; }
+  /// @brief Returns the average evaluation of the root node
+  /// @details Searches waiting for an evaluation are excluded, so this can be
+  /// called between iterations.
+  float value() const noexcept;
+  /// @brief Returns the most visited line of play, starting with bestMove
+  std::vector<int32_t> principalVariation(int32_t max_length = 16) const;
+  /// @brief Returns the number of searches that only reached leaves waiting
+  /// for an evaluation
+  /// @details Leaves waiting for an evaluation are not searched again, so
+  /// such a search is undone. It stops the search from going through the
+  /// node where it found nothing to search until the evaluations arrive.
+  int32_t num_collisions() const noexcept { return num_collisions_; }
+  /// @brief Returns where the game states to evaluate are written
+  float *to_eval() const noexcept { return to_eval_; }
+
+  /// @brief Stop searching at the deadline
+  /// @details doIteration returns true once the deadline has passed and the
+  /// root has been evaluated. Searches that have not been sent for
+  /// evaluation when the deadline is noticed are discarded, so the deadline
+  /// is overshot by at most one neural network evaluation. The deadline is
+  /// kept until it is cleared, including after moving down the tree.
+  void set_deadline(std::chrono::steady_clock::time_point deadline) noexcept;
+  void clear_deadline() noexcept;
+  /// @brief Whether to stop searching once the move cannot change
+  /// @details The search for a turn ends when the most visited root child
+  /// leads the second by more than the remaining number of searches. This is
+  /// on by default in testing mode. In training, it never applies to the
+  /// opening moves, where the move is sampled from the visit counts.
+  void set_stop_futile(bool stop_futile) noexcept;
+  /// @brief Limit the number of searches for the current turn
+  /// @details This can only lower TrainMC::max_searches_. A negative budget
+  /// removes the limit.
+  void set_search_budget(int32_t search_budget) noexcept;
+  /// @brief Change the number of searches per neural network evaluation
+  /// @details This can only lower TrainMC::searches_per_eval_, which sizes
+  /// the requests. It applies from the next iteration.
+  void set_searches_per_eval(int32_t searches_per_eval) noexcept;
+  /// @brief Set the virtual loss of searches waiting for an evaluation
+  /// @details Each node on the path of a search gets a visit and this much
+  /// evaluation against it until the evaluation arrives. 1.0 (the default)
+  /// is the evaluation of a loss. Smaller losses let more searches go
+  /// through the same nodes, which suits many searches per evaluation. This
+  /// cannot be called while evaluations are requested.
+  void set_virtual_loss(float virtual_loss) noexcept;
+  /// @brief Write the game states to evaluate to a different location
+  /// @details This lets a caller place requests straight into a larger
+  /// batch. Requests already written are not moved, so this should be called
+  /// when they have been evaluated or are no longer needed. There must be
+  /// room for TrainMC::searches_per_eval_ game states.
+  void set_to_eval(float *to_eval) noexcept;
+  /// @brief Whether probabilities are received only for legal moves
+  /// @details If set, the probs passed to doIteration hold the priors of the
+  /// legal moves of each requested position in increasing move order, one
+  /// position after another. The sizes come from writeLegalMasks. Otherwise,
+  /// probs has kNumMoves probabilities per position.
+  void set_sparse_priors(bool sparse_priors) noexcept;
+  /// @brief Evaluate leaves with playouts instead of a neural network
+  /// @details A leaf is evaluated by the average result of num_playouts
+  /// games played from it to the end, and its legal moves get uniform
+  /// priors. doIteration then searches a whole turn in one call without
+  /// requests, so eval and probs are not read and nothing is written to
+  /// to_eval. This must be called before the first iteration or between
+  /// turns.
+  void set_rollout(Rollout rollout, int32_t num_playouts = 1) noexcept;
 
   /// @brief Set the root node to have the given game and depth
   void null_root() noexcept;
@@ -55,6 +135,16 @@ class TrainMC {
   /// @brief Write the game states for the positions we need to evaluate
   /// @details This is used when playing with the AI.
   void writeRequests(float *game_states) const noexcept;
+  /// @brief Write the legal moves of the positions we need to evaluate
+  /// @details Each position has kMoveMaskWords words. Bit j % 32 of word
+  /// j / 32 is set if move j is legal. This lets the neural network apply
+  /// its softmax over the legal moves only.
+  /// @return The total number of legal moves, which is the number of priors
+  /// expected with TrainMC::set_sparse_priors
+  int32_t writeLegalMasks(uint32_t masks[]) const noexcept;
+  /// @brief Write the positions we need to evaluate as packed game states
+  /// @details See expandGameStates.
+  void writePackedRequests(PackedGame packed[]) const noexcept;
   /// @brief Get the legal moves of the root node.
   /// @details This is used for the web app.
   void getLegalMoves(int32_t legal_moves[kNumMoves]) const noexcept;
@@ -64,11 +154,15 @@ class TrainMC {
   /// @return The ID of the best move
   int32_t chooseMove(float game_state[kGameStateSize] = nullptr,
                      float prob_sample[kNumMoves] = nullptr) noexcept;
+  /// @brief Returns the move TrainMC::chooseMove would choose in testing mode
+  /// @details Does not move down the tree, so the search can continue.
+  int32_t bestMove() const noexcept;
   /// @brief Do an iteration of searches
   /// @param eval The evaluations for the positions requested.
   /// For the first search, this is nullptr
   /// @param probs The probabilities for legal moves for the positions
-  /// requested For the first search, this is nullptr
+  /// requested For the first search, this is nullptr. See
+  /// TrainMC::set_sparse_priors for the layout.
   /// @return Whether the turn is done. This happens when the number of
   /// searches equals TrainMC::max_iterations_ Or when the root node's outcome
   /// is known.
@@ -88,8 +182,46 @@ class TrainMC {
   /// @details This is used when the opponent makes an unsearched move. Does
   /// not delete the old root (if it exists).
   void createRoot(const Game &game, int32_t depth);
+  /// @brief Move the root to the given position, reusing the tree if possible
+  /// @details This is used in the web app, where we are only sent the
+  /// position after the opponent's move. If the position is a child of the
+  /// root, or a grandchild after our move and the opponent's reply, we move
+  /// down with receiveOpponentMove. Otherwise, the tree is replaced by a new
+  /// root, which is evaluated on the next iteration.
+  /// @return Whether the tree was reused
+  bool receivePosition(const Game &game);
+  /// @brief Discard the positions waiting for an evaluation
+  /// @details The unevaluated leaves are removed from the tree and their
+  /// searches are undone. This allows a search to be stopped between neural
+  /// network evaluations.
+  void discardRequests() noexcept;
+  /// @brief Save the search tree to a file
+  /// @details See TreeFile for the format.
+  /// @return Whether the tree was saved
+  bool saveTree(const std::string &filename) const;
+  /// @brief Replace the search tree with a saved tree
+  /// @details Search continues from the saved tree. The search count for the
+  /// turn is reset.
+  /// @return Whether the tree was loaded. The current tree is kept otherwise.
+  bool loadTree(const std::string &filename);
 
  private:
+  /// @brief Where a turn is, which decides what doIteration does next
+  /// @details Between iterations, TrainMC is suspended in one of these
+  /// states until the evaluations it waits for arrive.
+  enum class State {
+    /// @brief There is no tree. The next iteration creates the root at the
+    /// starting position.
+    kNoTree,
+    /// @brief The root has not been evaluated. The next iteration requests
+    /// it.
+    kNewRoot,
+    /// @brief Evaluations are requested for TrainMC::searched_. The next
+    /// iteration receives them and continues searching.
+    kWaiting,
+    /// @brief Nothing is requested. The next iteration continues searching.
+    kSearching,
+  };
   /// @brief The output of chooseNext
   struct ChooseNextOutput {
     enum class Type { kVisited, kNew, kNone } type;
@@ -99,13 +231,26 @@ class TrainMC {
   /// @brief Apply legal move filter and normalize
   void getFilteredProbs(float probs[kNumMoves],
                         float filtered_probs[]) const noexcept;
+  /// @brief Normalize the priors of the legal moves
+  /// @details The priors are already in edge order, so no filter is needed.
+  void getSparseProbs(const float priors[],
+                      float filtered_probs[]) const noexcept;
   /// @brief Generate Dirichlet noise
   void generateDirichlet(float dirichlet[]) const noexcept;
 
   /// @brief Set integer probabilities to edges, sets denominator of cur_ node.
   void setProbs(float filtered_probs[], float dirichlet[]) noexcept;
+  /// @brief Request an evaluation of the root, counting it as a search
+  void requestRoot() noexcept;
   /// @brief Write the neural network outputs into the node
   void receiveEval(float eval[], float probs[]) noexcept;
+  /// @brief Evaluate the requested positions with playouts and receive the
+  /// evaluations
+  void receiveRollouts() noexcept;
+  /// @brief Play a game to the end from a position
+  /// @return The result for the player to move: 1.0 for a win, -1.0 for a
+  /// loss, and 0.0 for a draw
+  float playout(const Game &game) const noexcept;
   /// @brief Choose a move based on the probabilities of the root node.
   /// @details This is mostly used for one-search strategies.
   int32_t chooseHighProbMove() const noexcept;
@@ -130,6 +275,12 @@ class TrainMC {
   /// network evaluations. We use elementary game theory to deduce the results
   /// of nodes that are not terminal.
   void propagateTerminal() noexcept;
+  /// @brief Returns the number of searches allowed for the current turn
+  int32_t searchLimit() const noexcept;
+  /// @brief Returns if the deadline is set and has passed
+  bool pastDeadline() const noexcept;
+  /// @brief Returns if the remaining searches cannot change the chosen move
+  bool searchFutile() const noexcept;
   /// @brief Choose the next node in the Monte Carlo search
   /// @return The ID of the move to take or -1 if no move is available
   /// @details Sets cur_ to a child node of cur_.
@@ -148,12 +299,23 @@ class TrainMC {
   /// Compared to elsewhere where it is 0. This is a hyperparameter.
   /// Note that the average Corintho game lasts about 30 moves.
   static constexpr int32_t kNumOpeningMoves = 6;
+  /// @brief The maximum number of visits of the root node
+  /// @details Visit counts are 16-bit. When the tree is reused between moves,
+  /// the root can have visits from previous turns, so TrainMC::max_searches_
+  /// alone does not bound them.
+  static constexpr int32_t kMaxVisits = 32760;
+  /// @brief The number of moves after which a playout is counted as a draw
+  /// @details Pieces can move back and forth, so a random game does not
+  /// always end.
+  static constexpr int32_t kMaxPlayoutMoves = 200;
 
   /// @brief The root node of the Monte Carlo search tree
   Node *root_{nullptr};
   /// @brief The current node we are at when searching the Monte Carlo search
   /// tree
   Node *cur_{nullptr};
+  /// @brief See TrainMC::State
+  State state_{State::kNoTree};
   /// @brief The number of searches done for the current move
   int32_t searches_done_{0};
   /// @brief The maximum number of searches to do per move.
@@ -172,6 +334,23 @@ class TrainMC {
   /// probabilities
   /// @details 0.25 was used during training.
   const float epsilon_{0.25};
+  /// @brief The number of searches per evaluation set by the caller
+  int32_t eval_limit_{16};
+  /// @brief See TrainMC::set_virtual_loss
+  float virtual_loss_{1.0};
+  /// @brief See TrainMC::num_collisions
+  int32_t num_collisions_{0};
+  /// @brief Searches allowed per turn set by the caller, or -1 for no limit
+  int32_t search_budget_{-1};
+  bool has_deadline_{false};
+  /// @brief See TrainMC::set_stop_futile
+  bool stop_futile_{false};
+  /// @brief See TrainMC::set_sparse_priors
+  bool sparse_priors_{false};
+  /// @brief See TrainMC::set_rollout
+  Rollout rollout_{Rollout::kNone};
+  int32_t num_playouts_{1};
+  std::chrono::steady_clock::time_point deadline_{};
   /// @brief The nodes we have searched this cycle that need to be evaluated
   std::vector<Node *> searched_{};
   /// @brief The location to write the game position that needs to be evaluated
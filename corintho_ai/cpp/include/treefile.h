@@ -0,0 +1,109 @@
+#ifndef TREEFILE_H
+#define TREEFILE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <string>
+
+#include "game.h"
+#include "util.h"
+
+class Node;
+
+/// @brief A saved Monte Carlo search tree, mapped read-only into memory
+/// @details The file is pointer-free. Nodes are stored as fixed-size records
+/// in breadth-first order, so the children of a node are contiguous and are
+/// referred to by the index of the first child. Edges are stored in a separate
+/// array of 16-bit packed edges (7-bit move ID, 9-bit probability weight), in
+/// the same order as the records.
+///
+/// The layout is
+/// Header | Record[num_nodes] | uint16_t edges[num_edges]
+///
+/// Records are accessed in place from the mapping, so opening a tree does not
+/// allocate or copy anything. TreeFile::restore builds regular nodes from the
+/// records when search needs to extend the tree.
+/// @note The file uses the byte order of the machine that wrote it.
+class TreeFile {
+ public:
+  /// @brief File header
+  struct Header {
+    char magic[4];
+    uint32_t version;
+    uint32_t num_nodes;
+    uint32_t num_edges;
+    uint32_t reserved[4];
+  };
+  /// @brief A node of the saved tree
+  struct Record {
+    PackedGame game;
+    /// @brief Sum of evaluations, as in Node
+    float evaluation;
+    /// @brief Index of the first child record, or 0 if there are no children
+    /// @details The root is record 0, which is never a child.
+    uint32_t first_child;
+    /// @brief Index of the first edge of this node in the edge array
+    uint32_t first_edge;
+    int16_t visits;
+    int8_t child_id;
+    int8_t depth;
+    Result result;
+    int8_t num_legal_moves;
+    int8_t num_children;
+    /// @brief Bit 0 is Node::all_visited
+    uint8_t flags;
+    uint32_t reserved;
+  };
+
+  static constexpr char kMagic[4] = {'C', 'T', 'R', 'E'};
+  static constexpr uint32_t kVersion = 1;
+
+  /// @brief Map a saved tree into memory
+  /// @details Check TreeFile::is_open to see if the file could be mapped.
+  /// Every record is checked once here, so a truncated or corrupt file is
+  /// not opened.
+  explicit TreeFile(const std::string &filename);
+  TreeFile(const TreeFile &) = delete;
+  TreeFile(TreeFile &&other) noexcept;
+  TreeFile &operator=(const TreeFile &) = delete;
+  TreeFile &operator=(TreeFile &&other) noexcept;
+  ~TreeFile();
+
+  /// @brief Returns if the file was mapped and is a valid tree
+  bool is_open() const noexcept;
+  int32_t num_nodes() const noexcept;
+  /// @brief Returns record i, which points into the mapped file
+  const Record &record(int32_t i) const noexcept;
+  /// @brief Returns the move ID of edge j of record i
+  int32_t move_id(int32_t i, int32_t j) const noexcept;
+  /// @brief Returns the normalized probability of edge j of record i
+  float probability(int32_t i, int32_t j) const noexcept;
+
+  /// @brief Build a regular search tree from the saved tree
+  /// @return The root of the new tree. The caller takes ownership.
+  Node *restore() const;
+
+ private:
+  /// @brief Release the mapping
+  void close() noexcept;
+  /// @brief Returns if every record can be restored
+  /// @details The children of each node must follow the children of the
+  /// nodes before it, edges must be in the edge array, and games must be
+  /// valid. TreeFile::restore relies on this.
+  bool valid() const noexcept;
+  const uint16_t *edges() const noexcept;
+
+  /// @brief Start of the mapping, or nullptr if the file is not open
+  const char *data_{nullptr};
+  /// @brief Size of the mapping in bytes
+  size_t size_{0};
+  const Header *header_{nullptr};
+  const Record *records_{nullptr};
+};
+
+/// @brief Save the search tree under root
+/// @return Whether the file was written successfully
+bool saveTree(const Node *root, const std::string &filename);
+
+#endif
@@ -42,6 +42,8 @@ const float kNegInf = -std::numeric_limits<float>::infinity();
 const int32_t kGameStateSize = 70;
 // Number of possible legal moves
 const int32_t kNumMoves = 96;
+// Number of 32-bit words in a packed legal move mask
+const int32_t kMoveMaskWords = (kNumMoves + 31) / 32;
 // Number of spaces on the board
 const int32_t kBoardSize = 16;
 // Number of board symmetries (rotations and reflections)
@@ -0,0 +1,52 @@
+#include "bradleyterry.h"
+
+#include <cmath>
+#include <cstdint>
+
+#include <algorithm>
+#include <vector>
+
+void cholesky(std::vector<double> &a, int32_t m) noexcept {
+  for (int32_t j = 0; j < m; ++j) {
+    double diagonal = a[j * m + j];
+    for (int32_t k = 0; k < j; ++k) {
+      diagonal -= a[j * m + k] * a[j * m + k];
+    }
+    a[j * m + j] = std::sqrt(diagonal);
+    for (int32_t i = j + 1; i < m; ++i) {
+      double sum = a[i * m + j];
+      for (int32_t k = 0; k < j; ++k) {
+        sum -= a[i * m + k] * a[j * m + k];
+      }
+      a[i * m + j] = sum / a[j * m + j];
+    }
+  }
+}
+
+void choleskySolve(const std::vector<double> &l, int32_t m,
+                   double b[]) noexcept {
+  for (int32_t i = 0; i < m; ++i) {
+    for (int32_t k = 0; k < i; ++k) {
+      b[i] -= l[i * m + k] * b[k];
+    }
+    b[i] /= l[i * m + i];
+  }
+  for (int32_t i = m - 1; i >= 0; --i) {
+    for (int32_t k = i + 1; k < m; ++k) {
+      b[i] -= l[k * m + i] * b[k];
+    }
+    b[i] /= l[i * m + i];
+  }
+}
+
+double newtonStep(std::vector<double> &hessian, std::vector<double> &gradient,
+                  int32_t m) noexcept {
+  cholesky(hessian, m);
+  choleskySolve(hessian, m, gradient.data());
+  double max_step = 0.0;
+  for (int32_t i = 0; i < m; ++i) {
+    gradient[i] = std::clamp(gradient[i], -kMaxNewtonStep, kMaxNewtonStep);
+    max_step = std::max(max_step, std::abs(gradient[i]));
+  }
+  return max_step;
+}
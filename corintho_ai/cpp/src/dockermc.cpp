@@ -2,9 +2,13 @@
 
 #include <cstdint>
 
+#include <chrono>
 #include <memory>
 #include <random>
+#include <vector>
 
+#include "evaltuner.h"
+#include "game.h"
 #include "trainmc.h"
 #include "util.h"
 
@@ -15,7 +19,8 @@ DockerMC::DockerMC(int32_t seed, int32_t max_searches,
     : generator_(std::make_unique<std::mt19937>(seed)),
       to_eval_(std::make_unique<float[]>(searches_per_eval * kGameStateSize)),
       trainmc_(generator_.get(), to_eval_.get(), max_searches,
-               searches_per_eval, c_puct, epsilon, board, to_play, pieces) {}
+               searches_per_eval, c_puct, epsilon, board, to_play, pieces),
+      tuner_{1, searches_per_eval} {}
 
 float DockerMC::eval() const noexcept {
   return trainmc_.eval();
@@ -37,6 +42,38 @@ bool DockerMC::drawn() const noexcept {
   return trainmc_.drawn();
 }
 
+int32_t DockerMC::bestMove() const noexcept {
+  return trainmc_.bestMove();
+}
+
+float DockerMC::value() const noexcept {
+  return trainmc_.value();
+}
+
+int32_t DockerMC::principalVariation(int32_t moves[],
+                                     int32_t max_length) const {
+  std::vector<int32_t> line = trainmc_.principalVariation(max_length);
+  for (size_t i = 0; i < line.size(); ++i) {
+    moves[i] = line[i];
+  }
+  return line.size();
+}
+
+void DockerMC::setTimeLimit(float seconds) noexcept {
+  trainmc_.set_deadline(std::chrono::steady_clock::now() +
+                        std::chrono::duration_cast<
+                            std::chrono::steady_clock::duration>(
+                            std::chrono::duration<float>(seconds)));
+}
+
+void DockerMC::setSearchBudget(int32_t search_budget) noexcept {
+  trainmc_.set_search_budget(search_budget);
+}
+
+void DockerMC::setAutotune(bool autotune) noexcept {
+  autotune_ = autotune;
+}
+
 void DockerMC::writeRequests(float *game_states) const noexcept {
   trainmc_.writeRequests(game_states);
 }
@@ -50,5 +87,27 @@ int32_t DockerMC::chooseMove() noexcept {
 }
 
 bool DockerMC::doIteration(float eval[], float probs[]) {
-  return trainmc_.doIteration(eval, probs);
-}
\ No newline at end of file
+  const auto start = std::chrono::steady_clock::now();
+  // A search starts without requests, so these were evaluated since the
+  // last iteration
+  if (autotune_ && trainmc_.num_requests() > 0) {
+    tuner_.record(trainmc_.num_requests(), search_time_,
+                  std::chrono::duration<double>(start - search_end_).count(),
+                  1);
+    trainmc_.set_searches_per_eval(tuner_.searches_per_eval());
+  }
+  const bool done = trainmc_.doIteration(eval, probs);
+  search_end_ = std::chrono::steady_clock::now();
+  search_time_ = std::chrono::duration<double>(search_end_ - start).count();
+  return done;
+}
+
+bool DockerMC::receivePosition(int32_t board[4 * kBoardSize], int32_t to_play,
+                               int32_t pieces[6]) {
+  trainmc_.discardRequests();
+  return trainmc_.receivePosition(Game{board, to_play, pieces});
+}
+
+void DockerMC::discardRequests() noexcept {
+  trainmc_.discardRequests();
+}
@@ -0,0 +1,286 @@
+#include "engine.h"
+
+#include <cassert>
+#include <cstdint>
+
+#include <bitset>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "evaluator.h"
+#include "game.h"
+#include "move.h"
+#include "node.h"
+#include "trainmc.h"
+#include "util.h"
+
+Engine::Engine(Evaluator *evaluator, std::ostream &out,
+               int32_t searches_per_eval, int32_t seed)
+    : evaluator_{evaluator}, out_{out}, searches_per_eval_{searches_per_eval},
+      generator_(seed),
+      to_eval_{std::make_unique<float[]>(searches_per_eval * kGameStateSize)},
+      eval_{std::make_unique<float[]>(searches_per_eval)},
+      probs_{std::make_unique<float[]>(searches_per_eval * kNumMoves)},
+      legal_masks_{
+          std::make_unique<uint32_t[]>(searches_per_eval * kMoveMaskWords)},
+      trainmc_{&generator_, to_eval_.get(), kMaxSearches, searches_per_eval,
+               1.0,         0.25,           true} {
+  assert(evaluator_ != nullptr);
+  trainmc_.createRoot(Game{}, 0);
+  trainmc_.set_sparse_priors(true);
+}
+
+Engine::~Engine() {
+  stopSearch();
+}
+
+bool Engine::handleCommand(const std::string &line) {
+  std::istringstream args{line};
+  std::string command;
+  if (!(args >> command)) {
+    return true;
+  }
+  // These commands are answered while searching
+  if (command == "isready") {
+    send("readyok");
+  } else if (command == "stop") {
+    stopSearch();
+  } else if (command == "ponderhit") {
+    ponderhit();
+  } else if (command == "quit") {
+    stopSearch();
+    return false;
+  } else if (command == "position") {
+    stopSearch();
+    position(args);
+  } else if (command == "go") {
+    go(args);
+  } else if (command == "eval") {
+    stopSearch();
+    eval();
+  } else if (command == "legalmoves") {
+    stopSearch();
+    legalMoves();
+  } else {
+    send("info string unknown command " + command);
+  }
+  return true;
+}
+
+void Engine::wait() {
+  if (search_thread_.joinable()) {
+    search_thread_.join();
+  }
+}
+
+void Engine::position(std::istringstream &args) {
+  std::string token;
+  args >> token;
+  Game game;
+  if (token == "state") {
+    std::string board_string;
+    int32_t board[4 * kBoardSize];
+    int32_t to_play = 0;
+    int32_t pieces[6];
+    args >> board_string >> to_play;
+    for (int32_t i = 0; i < 6; ++i) {
+      args >> pieces[i];
+    }
+    bool valid_pieces = true;
+    for (int32_t i = 0; i < 6; ++i) {
+      valid_pieces = valid_pieces && pieces[i] >= 0 && pieces[i] <= 4;
+    }
+    if (!args || board_string.size() != 4 * kBoardSize ||
+        (to_play != 0 && to_play != 1) || !valid_pieces) {
+      send("info string invalid position");
+      return;
+    }
+    for (int32_t i = 0; i < 4 * kBoardSize; ++i) {
+      board[i] = board_string[i] == '1' ? 1 : 0;
+    }
+    game = Game{board, to_play, pieces};
+  } else if (token != "startpos") {
+    send("info string invalid position");
+    return;
+  }
+  if (args >> token && token == "moves") {
+    while (args >> token) {
+      int32_t move_id = parseMove(token);
+      std::bitset<kNumMoves> legal_moves;
+      game.getLegalMoves(legal_moves);
+      if (move_id == -1 || !legal_moves[move_id]) {
+        send("info string illegal move " + token);
+        return;
+      }
+      game.doMove(move_id);
+    }
+  }
+  trainmc_.receivePosition(game);
+}
+
+void Engine::go(std::istringstream &args) {
+  stopSearch();
+  Limits limits;
+  bool ponder = false;
+  std::string token;
+  while (args >> token) {
+    if (token == "movetime") {
+      args >> limits.movetime;
+    } else if (token == "nodes") {
+      args >> limits.nodes;
+    } else if (token == "infinite") {
+      limits.infinite = true;
+    } else if (token == "ponder") {
+      ponder = true;
+    }
+  }
+  if (limits.movetime < 0 && limits.nodes < 0 && !limits.infinite) {
+    limits.nodes = kDefaultNodes;
+  }
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    limits_ = limits;
+    deadline_ = std::chrono::steady_clock::now() +
+                std::chrono::milliseconds(limits.movetime);
+    pondering_ = ponder;
+  }
+  search_thread_ = std::thread{&Engine::search, this};
+}
+
+void Engine::ponderhit() {
+  std::lock_guard<std::mutex> lock{mutex_};
+  if (pondering_) {
+    pondering_ = false;
+    // The time limit starts when the move is played
+    deadline_ = std::chrono::steady_clock::now() +
+                std::chrono::milliseconds(limits_.movetime);
+    stop_condition_.notify_all();
+  }
+}
+
+void Engine::eval() {
+  std::ostringstream message;
+  trainmc_.root()->writeGameState(to_eval_.get());
+  evaluator_->evaluate(to_eval_.get(), 1, eval_.get(), probs_.get());
+  message << "eval network " << eval_[0];
+  if (trainmc_.root()->visits() > 1) {
+    message << " search " << trainmc_.value();
+  }
+  send(message.str());
+}
+
+void Engine::legalMoves() {
+  std::ostringstream message;
+  message << "legalmoves";
+  std::bitset<kNumMoves> legal_moves;
+  trainmc_.root()->getLegalMoves(legal_moves);
+  for (int32_t i = 0; i < kNumMoves; ++i) {
+    if (legal_moves[i]) {
+      message << ' ' << Move{i};
+    }
+  }
+  send(message.str());
+}
+
+void Engine::stopSearch() {
+  if (!search_thread_.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    stop_ = true;
+    stop_condition_.notify_all();
+  }
+  search_thread_.join();
+  stop_ = false;
+}
+
+void Engine::search() {
+  if (trainmc_.done()) {
+    send("bestmove none");
+    return;
+  }
+  const auto start = std::chrono::steady_clock::now();
+  const int32_t start_searches = trainmc_.searches_done();
+  int32_t iterations = 0;
+  while (true) {
+    bool wait = applyLimits(start_searches);
+    bool done = trainmc_.doIteration(eval_.get(), probs_.get());
+    ++iterations;
+    // Make sure the root has been evaluated before stopping
+    if (iterations > 2 && stop_) {
+      break;
+    }
+    // TrainMC stops at the limits
+    if (done || trainmc_.no_requests()) {
+      if (!wait) {
+        break;
+      }
+      // Infinite and ponder searches wait for stop or ponderhit
+      {
+        std::unique_lock<std::mutex> lock{mutex_};
+        stop_condition_.wait(lock, [this] {
+          return stop_ || (!pondering_ && !limits_.infinite);
+        });
+      }
+      // After ponderhit, search with the limits
+      if (stop_ || done) {
+        break;
+      }
+      continue;
+    }
+    trainmc_.writeLegalMasks(legal_masks_.get());
+    evaluator_->evaluateLegal(to_eval_.get(), legal_masks_.get(),
+                              trainmc_.num_requests(), eval_.get(),
+                              probs_.get());
+  }
+  trainmc_.discardRequests();
+
+  const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start);
+  std::ostringstream info;
+  info << "info visits " << trainmc_.root()->visits() << " nodes "
+       << trainmc_.num_nodes() << " value " << trainmc_.value() << " time "
+       << elapsed.count() << " pv";
+  for (int32_t move_id : trainmc_.principalVariation()) {
+    info << ' ' << Move{move_id};
+  }
+  send(info.str());
+  if (trainmc_.done()) {
+    send("bestmove none");
+    return;
+  }
+  std::ostringstream best_move;
+  best_move << "bestmove " << Move{trainmc_.bestMove()};
+  send(best_move.str());
+}
+
+bool Engine::applyLimits(int32_t start_searches) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  if (pondering_ || limits_.infinite) {
+    trainmc_.clear_deadline();
+    trainmc_.set_search_budget(-1);
+    return true;
+  }
+  if (limits_.movetime >= 0) {
+    trainmc_.set_deadline(deadline_);
+  } else {
+    trainmc_.clear_deadline();
+  }
+  if (limits_.nodes >= 0) {
+    trainmc_.set_search_budget(start_searches + limits_.nodes);
+  } else {
+    trainmc_.set_search_budget(-1);
+  }
+  return false;
+}
+
+void Engine::send(const std::string &line) {
+  std::lock_guard<std::mutex> lock{out_mutex_};
+  out_ << line << std::endl;
+}
@@ -0,0 +1,64 @@
+#include "evaltuner.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+
+#include <algorithm>
+
+EvalTuner::EvalTuner(int32_t min_searches, int32_t max_searches,
+                     float max_overhead)
+    : min_searches_{min_searches}, max_searches_{max_searches},
+      max_overhead_{max_overhead}, searches_per_eval_{max_searches} {
+  assert(min_searches > 0);
+  assert(min_searches <= max_searches);
+  assert(max_overhead > 0.0 && max_overhead < 1.0);
+}
+
+int32_t EvalTuner::searches_per_eval() const noexcept {
+  return searches_per_eval_;
+}
+
+void EvalTuner::record(int32_t num_rows, double search_time, double eval_time,
+                       int32_t num_games) noexcept {
+  assert(num_rows > 0);
+  weight_ = kDecay * weight_ + 1.0;
+  sum_rows_ = kDecay * sum_rows_ + num_rows;
+  sum_rows_sq_ =
+      kDecay * sum_rows_sq_ + static_cast<double>(num_rows) * num_rows;
+  sum_eval_ = kDecay * sum_eval_ + eval_time;
+  sum_rows_eval_ = kDecay * sum_rows_eval_ + num_rows * eval_time;
+  sum_search_ = kDecay * sum_search_ + search_time;
+  if (min_searches_ == max_searches_) {
+    return;
+  }
+  // The overhead cannot be told apart from the cost per row if the batches
+  // were all about the same size, so try another size
+  const double variance =
+      (weight_ * sum_rows_sq_ - sum_rows_ * sum_rows_) / (weight_ * weight_);
+  if (variance < 1.0) {
+    searches_per_eval_ = searches_per_eval_ == max_searches_
+                             ? std::max(min_searches_, max_searches_ / 2)
+                             : max_searches_;
+    return;
+  }
+  const double eval_cost =
+      std::max((weight_ * sum_rows_eval_ - sum_rows_ * sum_eval_) /
+                   (weight_ * weight_ * variance),
+               0.0);
+  const double overhead =
+      std::max((sum_eval_ - eval_cost * sum_rows_) / weight_, 0.0);
+  const double row_cost = eval_cost + sum_search_ / sum_rows_;
+  if (row_cost <= 0.0) {
+    searches_per_eval_ = max_searches_;
+    return;
+  }
+  // rows / (overhead + rows * row_cost) >= (1 - max_overhead) / row_cost
+  const double num_rows_needed =
+      (1.0 - max_overhead_) * overhead / (max_overhead_ * row_cost);
+  const double searches = std::ceil(
+      num_rows_needed / std::max(num_games, static_cast<int32_t>(1)));
+  searches_per_eval_ = static_cast<int32_t>(
+      std::clamp(searches, static_cast<double>(min_searches_),
+                 static_cast<double>(max_searches_)));
+}
@@ -0,0 +1,51 @@
+#include "evaluator.h"
+
+#include <cstdint>
+
+#include <random>
+#include <vector>
+
+#include "util.h"
+
+void Evaluator::evaluateLegal(const float game_states[],
+                              const uint32_t legal_masks[], int32_t num_states,
+                              float eval[], float priors[]) {
+  std::vector<float> probs(num_states * kNumMoves);
+  evaluate(game_states, num_states, eval, probs.data());
+  int32_t num_priors = 0;
+  for (int32_t i = 0; i < num_states; ++i) {
+    const uint32_t *mask = legal_masks + i * kMoveMaskWords;
+    for (int32_t j = 0; j < kNumMoves; ++j) {
+      if (mask[j / 32] >> (j % 32) & 1) {
+        priors[num_priors] = probs[i * kNumMoves + j];
+        ++num_priors;
+      }
+    }
+  }
+}
+
+MockEvaluator::MockEvaluator(uint32_t seed) noexcept : seed_{seed} {}
+
+void MockEvaluator::evaluate(const float game_states[], int32_t num_states,
+                             float eval[], float probs[]) {
+  std::uniform_real_distribution<float> dist(0.0, 1.0);
+  for (int32_t i = 0; i < num_states; ++i) {
+    // Hash the game state (FNV-1a) to seed the outputs
+    // Entries are multiples of 0.25, so scaling by 4 makes them integers
+    uint32_t hash = 2166136261u ^ seed_;
+    for (int32_t j = 0; j < kGameStateSize; ++j) {
+      hash ^= static_cast<uint32_t>(game_states[i * kGameStateSize + j] * 4.0);
+      hash *= 16777619u;
+    }
+    std::mt19937 generator(hash);
+    eval[i] = dist(generator) * 2.0 - 1.0;
+    float sum = 0.0;
+    for (int32_t j = 0; j < kNumMoves; ++j) {
+      probs[i * kNumMoves + j] = dist(generator);
+      sum += probs[i * kNumMoves + j];
+    }
+    for (int32_t j = 0; j < kNumMoves; ++j) {
+      probs[i * kNumMoves + j] /= sum;
+    }
+  }
+}
@@ -8,9 +8,60 @@
 
 #include <gsl/gsl>
 
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
 #include "move.h"
 #include "util.h"
 
+namespace {
+
+/// @brief Write the canonized pieces of a packed game state
+void expandPieces(const PackedGame &packed, float game_state[]) noexcept {
+  for (int32_t i = 0; i < 6; ++i) {
+    game_state[4 * kBoardSize + i] =
+        static_cast<float>(packed.pieces[(packed.to_play * 3 + i) % 6]) * 0.25;
+  }
+}
+
+void expandGameStatesScalar(const PackedGame packed[], int32_t num_states,
+                            float game_states[]) noexcept {
+  for (int32_t i = 0; i < num_states; ++i) {
+    float *game_state = game_states + i * kGameStateSize;
+    for (int32_t j = 0; j < 4 * kBoardSize; ++j) {
+      game_state[j] = static_cast<float>((packed[i].board >> j) & 1);
+    }
+    expandPieces(packed[i], game_state);
+  }
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+/// @brief Expand the board 8 bits at a time
+/// @details Each byte is broadcast to 8 lanes, and each lane tests its own
+/// bit. The lanes that are set become 1.0.
+__attribute__((target("avx2"))) void
+expandGameStatesAvx2(const PackedGame packed[], int32_t num_states,
+                     float game_states[]) noexcept {
+  const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+  const __m256 ones = _mm256_set1_ps(1.0);
+  for (int32_t i = 0; i < num_states; ++i) {
+    float *game_state = game_states + i * kGameStateSize;
+    for (int32_t j = 0; j < 8; ++j) {
+      const __m256i byte = _mm256_set1_epi32(
+          static_cast<int32_t>((packed[i].board >> (8 * j)) & 0xFF));
+      const __m256i set =
+          _mm256_cmpeq_epi32(_mm256_and_si256(byte, bits), bits);
+      _mm256_storeu_ps(game_state + 8 * j,
+                       _mm256_and_ps(_mm256_castsi256_ps(set), ones));
+    }
+    expandPieces(packed[i], game_state);
+  }
+}
+#endif
+
+}  // namespace
+
 Game::Game(int32_t board[4 * kBoardSize], int32_t to_play,
            int32_t pieces[6]) noexcept
     : to_play_{gsl::narrow_cast<int8_t>(to_play)} {
@@ -25,6 +76,36 @@ Game::Game(int32_t board[4 * kBoardSize], int32_t to_play,
   }
 }
 
+Game::Game(const PackedGame &packed) noexcept
+    : board_{packed.board}, to_play_{packed.to_play} {
+  assert(to_play_ == 0 || to_play_ == 1);
+  for (int32_t i = 0; i < 6; ++i) {
+    assert(packed.pieces[i] >= 0 && packed.pieces[i] <= 4);
+    pieces_[i] = packed.pieces[i];
+  }
+}
+
+PackedGame Game::pack() const noexcept {
+  PackedGame packed;
+  packed.board = board_.to_ullong();
+  for (int32_t i = 0; i < 6; ++i) {
+    packed.pieces[i] = pieces_[i];
+  }
+  packed.to_play = to_play_;
+  return packed;
+}
+
+void expandGameStates(const PackedGame packed[], int32_t num_states,
+                      float game_states[]) noexcept {
+#if defined(__GNUC__) && defined(__x86_64__)
+  if (__builtin_cpu_supports("avx2")) {
+    expandGameStatesAvx2(packed, num_states, game_states);
+    return;
+  }
+#endif
+  expandGameStatesScalar(packed, num_states, game_states);
+}
+
 bool Game::getLegalMoves(std::bitset<kNumMoves> &legal_moves) const noexcept {
   // First set all moves to legal
   legal_moves.set();
@@ -95,6 +176,22 @@ void Game::doMove(int32_t move_id) noexcept {
   to_play_ = 1 - to_play_;
 }
 
+bool Game::operator==(const Game &other) const noexcept {
+  if (board_ != other.board_ || to_play_ != other.to_play_) {
+    return false;
+  }
+  for (int32_t i = 0; i < 6; ++i) {
+    if (pieces_[i] != other.pieces_[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Game::operator!=(const Game &other) const noexcept {
+  return !(*this == other);
+}
+
 std::ostream &operator<<(std::ostream &os, const Game &game) {
   // Print board
   for (int32_t row = 0; row < 4; ++row) {
@@ -31,7 +31,15 @@ Match::Match(int32_t random_seed, Player player1, Player player2,
                                player2.c_puct, player2.epsilon, true)},
       ids_{player1.player_id, player2.player_id},
       model_ids_{player1.model_id, player2.model_id}, log_file_{std::move(
-                                                          log_file)} {}
+                                                          log_file)} {
+  const Player *players[2] = {&player1, &player2};
+  for (int32_t i = 0; i < 2; ++i) {
+    if (players_[i] != nullptr) {
+      players_[i]->set_rollout(players[i]->rollout);
+    }
+  }
+}
+
 int32_t Match::id(int32_t i) const noexcept {
   assert(i == 0 || i == 1);
   return ids_[i];
@@ -233,8 +241,9 @@ bool Match::chooseMoveAndContinue() {
     // First time iterating the second player
     if (players_[to_play_]->uninitialized()) {
       players_[to_play_]->createRoot(root_->game(), root_->depth());
-      // This is always false as the root requires an evaluation
-      return players_[to_play_]->doIteration();
+      // The root requires an evaluation, unless the player uses rollouts
+      need_eval = !players_[to_play_]->doIteration();
+      continue;
     }
     // It's possible that we need an evaluation for this
     // in the case that received move has not been searched
@@ -0,0 +1,251 @@
+#include "matchscheduler.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "bradleyterry.h"
+#include "tourney.h"
+
+MatchScheduler::MatchScheduler(int32_t num_players, float prior_sd)
+    : num_players_{num_players},
+      prior_precision_{1.0 / (prior_sd / kEloPerUnit * prior_sd /
+                              kEloPerUnit)},
+      num_games_(num_players * num_players, 0),
+      scores_(num_players * num_players, 0.0), params_(num_players, 0.0),
+      covariance_(num_players * num_players, 0.0) {
+  assert(num_players > 0);
+  assert(prior_sd > 0.0);
+  for (int32_t i = 0; i < num_players; ++i) {
+    covariance_[i * num_players + i] = 1.0 / prior_precision_;
+  }
+}
+
+int32_t MatchScheduler::num_players() const noexcept {
+  return num_players_;
+}
+
+int32_t MatchScheduler::num_games() const noexcept {
+  int32_t count = 0;
+  for (int32_t n : num_games_) {
+    count += n;
+  }
+  return count;
+}
+
+float MatchScheduler::rating(int32_t player) const noexcept {
+  assert(player >= 0 && player < num_players_);
+  const int32_t i = index(player);
+  return i < 0 ? 0.0 : params_[i] * kEloPerUnit;
+}
+
+float MatchScheduler::stddev(int32_t player) const noexcept {
+  assert(player >= 0 && player < num_players_);
+  const int32_t i = index(player);
+  if (i < 0) {
+    return 0.0;
+  }
+  return std::sqrt(covariance_[i * num_players_ + i]) * kEloPerUnit;
+}
+
+float MatchScheduler::first_player_advantage() const noexcept {
+  return params_[num_players_ - 1] * kEloPerUnit;
+}
+
+bool MatchScheduler::converged(float target_sd) const noexcept {
+  for (int32_t i = 0; i < num_players_; ++i) {
+    if (stddev(i) > target_sd) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void MatchScheduler::addResult(int32_t player1, int32_t player2,
+                               float score) noexcept {
+  assert(player1 >= 0 && player1 < num_players_);
+  assert(player2 >= 0 && player2 < num_players_);
+  assert(player1 != player2);
+  ++num_games_[player1 * num_players_ + player2];
+  scores_[player1 * num_players_ + player2] += score;
+}
+
+void MatchScheduler::addResults(const Tourney &tourney) {
+  const auto &results = tourney.results();
+  for (; num_results_read_ < results.size(); ++num_results_read_) {
+    const auto &result = results[num_results_read_];
+    addResult(result.player1, result.player2, result.score);
+  }
+}
+
+void MatchScheduler::fit() {
+  const int32_t m = num_players_;
+  std::vector<double> hessian;
+  std::vector<double> step;
+  for (int32_t iteration = 0; iteration < 100; ++iteration) {
+    buildSystem(hessian, step);
+    const double max_step = newtonStep(hessian, step, m);
+    for (int32_t i = 0; i < m; ++i) {
+      params_[i] += step[i];
+    }
+    if (max_step < 1e-9) {
+      break;
+    }
+  }
+  // The covariance is the inverse of the Hessian at the most likely ratings
+  buildSystem(hessian, step);
+  cholesky(hessian, m);
+  std::vector<double> column(m);
+  for (int32_t j = 0; j < m; ++j) {
+    std::fill(column.begin(), column.end(), 0.0);
+    column[j] = 1.0;
+    choleskySolve(hessian, m, column.data());
+    for (int32_t i = 0; i < m; ++i) {
+      covariance_[i * m + j] = column[i];
+    }
+  }
+}
+
+std::vector<std::pair<int32_t, int32_t>>
+MatchScheduler::nextPairings(int32_t num_pairings, float target_sd) {
+  const int32_t m = num_players_;
+  const int32_t b = m - 1;
+  const double target_variance =
+      target_sd / kEloPerUnit * target_sd / kEloPerUnit;
+  std::vector<double> covariance = covariance_;
+  // Sigma u for u = e_i - e_j + e_b, without the anchor
+  auto product = [&](int32_t player1, int32_t player2, double out[]) {
+    const int32_t i = index(player1);
+    const int32_t j = index(player2);
+    for (int32_t r = 0; r < m; ++r) {
+      out[r] = covariance[r * m + b];
+      if (i >= 0) {
+        out[r] += covariance[r * m + i];
+      }
+      if (j >= 0) {
+        out[r] -= covariance[r * m + j];
+      }
+    }
+  };
+  std::vector<std::pair<int32_t, int32_t>> pairings;
+  std::vector<double> sigma_u(m);
+  std::vector<double> best_sigma_u(m);
+  std::vector<uint8_t> counted(b);
+  for (int32_t k = 0; k < num_pairings && m > 1; ++k) {
+    // Only count the ratings that have not reached the target, unless all
+    // of them have
+    bool any_counted = false;
+    for (int32_t r = 0; r < b; ++r) {
+      counted[r] = covariance[r * m + r] > target_variance;
+      any_counted = any_counted || counted[r];
+    }
+    if (!any_counted) {
+      std::fill(counted.begin(), counted.end(), true);
+    }
+    double best_gain = -1.0;
+    double best_weight = 0.0;
+    double best_quad = 0.0;
+    std::pair<int32_t, int32_t> best{0, 1};
+    for (int32_t player1 = 0; player1 < m; ++player1) {
+      for (int32_t player2 = 0; player2 < m; ++player2) {
+        if (player1 == player2) {
+          continue;
+        }
+        product(player1, player2, sigma_u.data());
+        const int32_t i = index(player1);
+        const int32_t j = index(player2);
+        const double quad = sigma_u[b] + (i >= 0 ? sigma_u[i] : 0.0) -
+                            (j >= 0 ? sigma_u[j] : 0.0);
+        const double p = expectedScore(player1, player2);
+        const double weight = p * (1.0 - p);
+        // The reduction of the variances of the counted ratings
+        double norm = 0.0;
+        for (int32_t r = 0; r < b; ++r) {
+          if (counted[r]) {
+            norm += sigma_u[r] * sigma_u[r];
+          }
+        }
+        const double gain = weight * norm / (1.0 + weight * quad);
+        if (gain > best_gain) {
+          best_gain = gain;
+          best_weight = weight;
+          best_quad = quad;
+          best = {player1, player2};
+          best_sigma_u = sigma_u;
+        }
+      }
+    }
+    pairings.push_back(best);
+    // Update the covariance as if the game had been played
+    const double scale = best_weight / (1.0 + best_weight * best_quad);
+    for (int32_t r = 0; r < m; ++r) {
+      for (int32_t c = 0; c < m; ++c) {
+        covariance[r * m + c] -= scale * best_sigma_u[r] * best_sigma_u[c];
+      }
+    }
+  }
+  return pairings;
+}
+
+void MatchScheduler::schedule(Tourney &tourney, int32_t num_pairings,
+                              float target_sd) {
+  for (const auto &[player1, player2] :
+       nextPairings(num_pairings, target_sd)) {
+    tourney.addMatch(player1, player2);
+  }
+}
+
+int32_t MatchScheduler::index(int32_t player) const noexcept {
+  return player == num_players_ - 1 ? -1 : player;
+}
+
+double MatchScheduler::expectedScore(int32_t player1,
+                                     int32_t player2) const noexcept {
+  const int32_t i = index(player1);
+  const int32_t j = index(player2);
+  const double r1 = i < 0 ? 0.0 : params_[i];
+  const double r2 = j < 0 ? 0.0 : params_[j];
+  return 1.0 / (1.0 + std::exp(-(r1 - r2 + params_[num_players_ - 1])));
+}
+
+void MatchScheduler::buildSystem(std::vector<double> &hessian,
+                                 std::vector<double> &gradient) const {
+  const int32_t m = num_players_;
+  const int32_t b = m - 1;
+  hessian.assign(m * m, 0.0);
+  gradient.resize(m);
+  for (int32_t i = 0; i < m; ++i) {
+    hessian[i * m + i] = prior_precision_;
+    gradient[i] = -prior_precision_ * params_[i];
+  }
+  for (int32_t player1 = 0; player1 < m; ++player1) {
+    for (int32_t player2 = 0; player2 < m; ++player2) {
+      const int32_t n = num_games_[player1 * m + player2];
+      if (n == 0) {
+        continue;
+      }
+      const double p = expectedScore(player1, player2);
+      const double residual = scores_[player1 * m + player2] - n * p;
+      const double weight = n * p * (1.0 - p);
+      // u has +1 for player1, -1 for player2 and +1 for b
+      const int32_t indices[3] = {index(player1), index(player2), b};
+      const double signs[3] = {1.0, -1.0, 1.0};
+      for (int32_t x = 0; x < 3; ++x) {
+        if (indices[x] < 0) {
+          continue;
+        }
+        gradient[indices[x]] += signs[x] * residual;
+        for (int32_t y = 0; y < 3; ++y) {
+          if (indices[y] >= 0) {
+            hessian[indices[x] * m + indices[y]] +=
+                weight * signs[x] * signs[y];
+          }
+        }
+      }
+    }
+  }
+}
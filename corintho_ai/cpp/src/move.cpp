@@ -5,6 +5,7 @@
 
 #include <ostream>
 #include <stdlib.h>
+#include <string>
 
 #include "util.h"
 
@@ -121,4 +122,51 @@ char getColName(int32_t col) {
     assert(false);
     return ' ';
   }
-}
\ No newline at end of file
+}
+
+int32_t parseMove(const std::string &name) noexcept {
+  if (name.size() != 3) {
+    return -1;
+  }
+  // Place moves start with the piece type
+  PieceType piece_type = -1;
+  if (name[0] == 'B') {
+    piece_type = kBase;
+  } else if (name[0] == 'C') {
+    piece_type = kColumn;
+  } else if (name[0] == 'A') {
+    piece_type = kCapital;
+  }
+  // The space is given by the column name and the row number from the bottom
+  const int32_t offset = piece_type == -1 ? 0 : 1;
+  const int32_t col = name[offset] - 'a';
+  const int32_t row = 4 - (name[offset + 1] - '0');
+  if (col < 0 || col >= 4 || row < 0 || row >= 4) {
+    return -1;
+  }
+  if (piece_type != -1) {
+    return encodePlace(Space{row, col}, piece_type);
+  }
+  int32_t row_to = row;
+  int32_t col_to = col;
+  switch (name[2]) {
+  case 'L':
+    --col_to;
+    break;
+  case 'R':
+    ++col_to;
+    break;
+  case 'U':
+    --row_to;
+    break;
+  case 'D':
+    ++row_to;
+    break;
+  default:
+    return -1;
+  }
+  if (col_to < 0 || col_to >= 4 || row_to < 0 || row_to >= 4) {
+    return -1;
+  }
+  return encodeMove(Space{row, col}, Space{row_to, col_to});
+}
@@ -0,0 +1,289 @@
+#include "nativeevaluator.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "util.h"
+
+namespace {
+
+using PaddedLayer = NativeEvaluator::PaddedLayer;
+constexpr int32_t kColumnBlock = NativeEvaluator::kColumnBlock;
+constexpr int32_t kRowBlock = NativeEvaluator::kRowBlock;
+
+/// @brief Pad the outputs of a layer to a multiple of kColumnBlock
+/// @details The padded outputs have zero weights and bias, so they are 0.
+PaddedLayer padLayer(const DenseLayer &layer) {
+  PaddedLayer padded;
+  padded.num_inputs = layer.num_inputs;
+  padded.num_outputs = layer.num_outputs;
+  padded.stride =
+      (layer.num_outputs + kColumnBlock - 1) / kColumnBlock * kColumnBlock;
+  padded.weights.assign(padded.num_inputs * padded.stride, 0.0);
+  padded.bias.assign(padded.stride, 0.0);
+  for (int32_t i = 0; i < layer.num_inputs; ++i) {
+    std::copy_n(layer.weights.begin() + i * layer.num_outputs,
+                layer.num_outputs, padded.weights.begin() + i * padded.stride);
+  }
+  std::copy(layer.bias.begin(), layer.bias.end(), padded.bias.begin());
+  return padded;
+}
+
+/// @brief Compute a layer for a batch
+/// @param in num_rows rows of layer.num_inputs values, in_stride apart
+/// @param out Receives num_rows rows of layer.stride values
+void denseScalar(const float in[], int32_t in_stride, int32_t num_rows,
+                 const PaddedLayer &layer, bool relu, float out[]) noexcept {
+  for (int32_t col = 0; col < layer.stride; col += kColumnBlock) {
+    const float *weights = layer.weights.data() + col;
+    for (int32_t row = 0; row < num_rows; ++row) {
+      float sum[kColumnBlock];
+      std::copy_n(layer.bias.data() + col, kColumnBlock, sum);
+      const float *x = in + row * in_stride;
+      for (int32_t k = 0; k < layer.num_inputs; ++k) {
+        for (int32_t j = 0; j < kColumnBlock; ++j) {
+          sum[j] += x[k] * weights[k * layer.stride + j];
+        }
+      }
+      for (int32_t j = 0; j < kColumnBlock; ++j) {
+        out[row * layer.stride + col + j] =
+            relu ? std::max(sum[j], 0.0f) : sum[j];
+      }
+    }
+  }
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+/// @brief Compute kRows rows of one block of columns
+/// @details Each row keeps its two 8-lane sums in registers while the inputs
+/// are read, so the weights of each input are loaded once for all the rows.
+template <int32_t kRows>
+__attribute__((target("avx2,fma"))) void
+denseBlockAvx2(const float in[], int32_t in_stride, const PaddedLayer &layer,
+               int32_t col, bool relu, float out[]) noexcept {
+  const float *weights = layer.weights.data() + col;
+  __m256 sum[kRows][2];
+  for (int32_t r = 0; r < kRows; ++r) {
+    sum[r][0] = _mm256_loadu_ps(layer.bias.data() + col);
+    sum[r][1] = _mm256_loadu_ps(layer.bias.data() + col + 8);
+  }
+  for (int32_t k = 0; k < layer.num_inputs; ++k) {
+    const __m256 w0 = _mm256_loadu_ps(weights + k * layer.stride);
+    const __m256 w1 = _mm256_loadu_ps(weights + k * layer.stride + 8);
+    for (int32_t r = 0; r < kRows; ++r) {
+      const __m256 x = _mm256_broadcast_ss(in + r * in_stride + k);
+      sum[r][0] = _mm256_fmadd_ps(x, w0, sum[r][0]);
+      sum[r][1] = _mm256_fmadd_ps(x, w1, sum[r][1]);
+    }
+  }
+  const __m256 zero = _mm256_setzero_ps();
+  for (int32_t r = 0; r < kRows; ++r) {
+    if (relu) {
+      sum[r][0] = _mm256_max_ps(sum[r][0], zero);
+      sum[r][1] = _mm256_max_ps(sum[r][1], zero);
+    }
+    _mm256_storeu_ps(out + r * layer.stride + col, sum[r][0]);
+    _mm256_storeu_ps(out + r * layer.stride + col + 8, sum[r][1]);
+  }
+}
+
+__attribute__((target("avx2,fma"))) void
+denseAvx2(const float in[], int32_t in_stride, int32_t num_rows,
+          const PaddedLayer &layer, bool relu, float out[]) noexcept {
+  static_assert(kColumnBlock == 16, "the kernel computes 16 columns");
+  static_assert(kRowBlock == 4, "the kernel computes 4 rows");
+  for (int32_t col = 0; col < layer.stride; col += kColumnBlock) {
+    int32_t row = 0;
+    for (; row + kRowBlock <= num_rows; row += kRowBlock) {
+      denseBlockAvx2<kRowBlock>(in + row * in_stride, in_stride, layer, col,
+                                relu, out + row * layer.stride);
+    }
+    for (; row < num_rows; ++row) {
+      denseBlockAvx2<1>(in + row * in_stride, in_stride, layer, col, relu,
+                        out + row * layer.stride);
+    }
+  }
+}
+#endif
+
+void dense(const float in[], int32_t in_stride, int32_t num_rows,
+           const PaddedLayer &layer, bool relu, float out[]) noexcept {
+#if defined(__GNUC__) && defined(__x86_64__)
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    denseAvx2(in, in_stride, num_rows, layer, relu, out);
+    return;
+  }
+#endif
+  denseScalar(in, in_stride, num_rows, layer, relu, out);
+}
+
+template <typename T> bool read(std::ifstream &file, T *data, size_t count) {
+  file.read(reinterpret_cast<char *>(data), count * sizeof(T));
+  return file.good();
+}
+
+}  // namespace
+
+bool loadNetwork(const std::string &filename,
+                 std::vector<DenseLayer> &layers) {
+  layers.clear();
+  std::ifstream file{filename, std::ifstream::in | std::ifstream::binary};
+  NetworkHeader header;
+  if (!read(file, &header, 1) ||
+      std::memcmp(header.magic, kNetworkMagic, sizeof(kNetworkMagic)) != 0 ||
+      header.version != kNetworkVersion || header.num_layers < 2) {
+    return false;
+  }
+  for (uint32_t i = 0; i < header.num_layers; ++i) {
+    uint32_t shape[2];
+    if (!read(file, shape, 2) || shape[0] == 0 || shape[1] == 0 ||
+        shape[0] > 65536 || shape[1] > 65536) {
+      layers.clear();
+      return false;
+    }
+    DenseLayer layer;
+    layer.num_inputs = static_cast<int32_t>(shape[0]);
+    layer.num_outputs = static_cast<int32_t>(shape[1]);
+    layer.weights.resize(layer.num_inputs * layer.num_outputs);
+    layer.bias.resize(layer.num_outputs);
+    if (!read(file, layer.weights.data(), layer.weights.size()) ||
+        !read(file, layer.bias.data(), layer.bias.size())) {
+      layers.clear();
+      return false;
+    }
+    layers.push_back(std::move(layer));
+  }
+  // Check that the layers connect
+  const int32_t num_hidden = static_cast<int32_t>(layers.size()) - 2;
+  int32_t num_inputs = kGameStateSize;
+  for (int32_t i = 0; i < num_hidden; ++i) {
+    if (layers[i].num_inputs != num_inputs) {
+      layers.clear();
+      return false;
+    }
+    num_inputs = layers[i].num_outputs;
+  }
+  const DenseLayer &value = layers[num_hidden];
+  const DenseLayer &policy = layers[num_hidden + 1];
+  if (value.num_inputs != num_inputs || value.num_outputs != 1 ||
+      policy.num_inputs != num_inputs || policy.num_outputs != kNumMoves) {
+    layers.clear();
+    return false;
+  }
+  return true;
+}
+
+bool saveNetwork(const std::vector<DenseLayer> &layers,
+                 const std::string &filename) {
+  NetworkHeader header{};
+  std::memcpy(header.magic, kNetworkMagic, sizeof(kNetworkMagic));
+  header.version = kNetworkVersion;
+  header.num_layers = static_cast<uint32_t>(layers.size());
+  std::ofstream file{filename, std::ofstream::out | std::ofstream::binary};
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  for (const DenseLayer &layer : layers) {
+    assert(layer.weights.size() == static_cast<size_t>(layer.num_inputs) *
+                                       layer.num_outputs);
+    assert(layer.bias.size() == static_cast<size_t>(layer.num_outputs));
+    const uint32_t shape[2] = {static_cast<uint32_t>(layer.num_inputs),
+                               static_cast<uint32_t>(layer.num_outputs)};
+    file.write(reinterpret_cast<const char *>(shape), sizeof(shape));
+    file.write(reinterpret_cast<const char *>(layer.weights.data()),
+               layer.weights.size() * sizeof(float));
+    file.write(reinterpret_cast<const char *>(layer.bias.data()),
+               layer.bias.size() * sizeof(float));
+  }
+  return file.good();
+}
+
+DenseLayer mergeHeads(const DenseLayer &value, const DenseLayer &policy) {
+  assert(value.num_outputs == 1 && policy.num_outputs == kNumMoves);
+  assert(value.num_inputs == policy.num_inputs);
+  DenseLayer heads;
+  heads.num_inputs = value.num_inputs;
+  heads.num_outputs = 1 + kNumMoves;
+  heads.weights.resize(heads.num_inputs * heads.num_outputs);
+  for (int32_t i = 0; i < heads.num_inputs; ++i) {
+    heads.weights[i * heads.num_outputs] = value.weights[i];
+    std::copy_n(policy.weights.begin() + i * kNumMoves, kNumMoves,
+                heads.weights.begin() + i * heads.num_outputs + 1);
+  }
+  heads.bias.push_back(value.bias[0]);
+  heads.bias.insert(heads.bias.end(), policy.bias.begin(), policy.bias.end());
+  return heads;
+}
+
+void activateHeads(const float heads[], int32_t stride, int32_t num_states,
+                   float eval[], float probs[]) noexcept {
+  for (int32_t i = 0; i < num_states; ++i) {
+    const float *outputs = heads + i * stride;
+    eval[i] = std::tanh(outputs[0]);
+    float *state_probs = probs + i * kNumMoves;
+    const float max_logit =
+        *std::max_element(outputs + 1, outputs + 1 + kNumMoves);
+    float sum = 0.0;
+    for (int32_t j = 0; j < kNumMoves; ++j) {
+      state_probs[j] = std::exp(outputs[1 + j] - max_logit);
+      sum += state_probs[j];
+    }
+    for (int32_t j = 0; j < kNumMoves; ++j) {
+      state_probs[j] /= sum;
+    }
+  }
+}
+
+NativeEvaluator::NativeEvaluator(const std::string &filename) {
+  std::vector<DenseLayer> layers;
+  if (!loadNetwork(filename, layers)) {
+    return;
+  }
+  const size_t num_hidden = layers.size() - 2;
+  for (size_t i = 0; i < num_hidden; ++i) {
+    layers_.push_back(padLayer(layers[i]));
+  }
+  layers_.push_back(
+      padLayer(mergeHeads(layers[num_hidden], layers[num_hidden + 1])));
+  for (const PaddedLayer &layer : layers_) {
+    max_stride_ = std::max(max_stride_, layer.stride);
+  }
+}
+
+bool NativeEvaluator::is_open() const noexcept {
+  return !layers_.empty();
+}
+
+void NativeEvaluator::evaluate(const float game_states[], int32_t num_states,
+                               float eval[], float probs[]) {
+  assert(is_open());
+  assert(num_states >= 0);
+  if (num_states == 0) {
+    return;
+  }
+  const size_t buffer_size = static_cast<size_t>(num_states) * max_stride_;
+  for (std::vector<float> &buffer : buffers_) {
+    if (buffer.size() < buffer_size) {
+      buffer.resize(buffer_size);
+    }
+  }
+  const float *in = game_states;
+  int32_t in_stride = kGameStateSize;
+  for (size_t i = 0; i < layers_.size(); ++i) {
+    float *out = buffers_[i % 2].data();
+    dense(in, in_stride, num_states, layers_[i], i + 1 < layers_.size(), out);
+    in = out;
+    in_stride = layers_[i].stride;
+  }
+  activateHeads(in, in_stride, num_states, eval, probs);
+}
@@ -38,6 +38,22 @@ Node::Node(const Game &game, Node *parent, Node *next_sibling, int32_t move_id,
   initializeEdges();
 }
 
+Node::Node(const Game &game, Node *parent, int32_t child_id, int32_t depth,
+           const uint16_t *edges, int32_t num_legal_moves)
+    : game_{game}, parent_{parent},
+      child_id_{gsl::narrow_cast<int8_t>(child_id)},
+      num_legal_moves_{gsl::narrow_cast<int8_t>(num_legal_moves)},
+      depth_{gsl::narrow_cast<int8_t>(depth)} {
+  assert(num_legal_moves >= 0 && num_legal_moves <= kNumMoves);
+  if (num_legal_moves_ == 0) {
+    return;
+  }
+  edges_ = new Edge[num_legal_moves_];
+  for (int32_t i = 0; i < num_legal_moves_; ++i) {
+    edges_[i] = Edge(edges[i] & 0x7F, edges[i] >> 7);
+  }
+}
+
 Game Node::game() const noexcept {
   return game_;
 }
@@ -93,6 +109,12 @@ float Node::probability(int32_t i) const noexcept {
   return static_cast<float>(edges_[i].probability) * denominator_;
 }
 
+uint16_t Node::packed_edge(int32_t i) const noexcept {
+  assert(i < num_legal_moves_);
+  return gsl::narrow_cast<uint16_t>(edges_[i].move_id |
+                                    edges_[i].probability << 7);
+}
+
 bool Node::terminal() const noexcept {
   return result_ == kResultLoss || result_ == kResultDraw;
 }
@@ -0,0 +1,286 @@
+#include "quantizedevaluator.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "nativeevaluator.h"
+#include "util.h"
+
+namespace {
+
+using QuantizedLayer = QuantizedEvaluator::QuantizedLayer;
+constexpr int32_t kColumnBlock = QuantizedEvaluator::kColumnBlock;
+constexpr int32_t kRowBlock = QuantizedEvaluator::kRowBlock;
+constexpr int32_t kMaxActivation = QuantizedEvaluator::kMaxActivation;
+/// @brief The input scale, so that 0.25 is 31 units
+constexpr float kInputScale = 0.25 / 31.0;
+
+/// @brief Compute a hidden layer in float for calibration
+std::vector<float> reluLayer(const std::vector<float> &in, int32_t num_rows,
+                             const DenseLayer &layer) {
+  std::vector<float> out(num_rows * layer.num_outputs);
+  for (int32_t row = 0; row < num_rows; ++row) {
+    float *y = out.data() + row * layer.num_outputs;
+    std::copy(layer.bias.begin(), layer.bias.end(), y);
+    for (int32_t k = 0; k < layer.num_inputs; ++k) {
+      const float x = in[row * layer.num_inputs + k];
+      for (int32_t j = 0; j < layer.num_outputs; ++j) {
+        y[j] += x * layer.weights[k * layer.num_outputs + j];
+      }
+    }
+    for (int32_t j = 0; j < layer.num_outputs; ++j) {
+      y[j] = std::max(y[j], 0.0f);
+    }
+  }
+  return out;
+}
+
+/// @brief Quantize the weights of a layer with one scale per output
+QuantizedLayer quantizeLayer(const DenseLayer &layer, float input_scale) {
+  QuantizedLayer quantized;
+  quantized.num_inputs = (layer.num_inputs + 3) / 4 * 4;
+  quantized.num_outputs = layer.num_outputs;
+  quantized.stride =
+      (layer.num_outputs + kColumnBlock - 1) / kColumnBlock * kColumnBlock;
+  quantized.weights.assign(quantized.num_inputs * quantized.stride, 0);
+  quantized.scales.assign(quantized.stride, 0.0);
+  quantized.bias.assign(quantized.stride, 0.0);
+  quantized.input_scale = input_scale;
+  for (int32_t j = 0; j < layer.num_outputs; ++j) {
+    float max_weight = 0.0;
+    for (int32_t k = 0; k < layer.num_inputs; ++k) {
+      max_weight = std::max(
+          max_weight, std::abs(layer.weights[k * layer.num_outputs + j]));
+    }
+    const float weight_scale = max_weight > 0.0 ? max_weight / 127.0 : 1.0;
+    for (int32_t k = 0; k < layer.num_inputs; ++k) {
+      quantized.weights[((k / 4) * quantized.stride + j) * 4 + k % 4] =
+          static_cast<int8_t>(std::lrint(
+              layer.weights[k * layer.num_outputs + j] / weight_scale));
+    }
+    quantized.scales[j] = input_scale * weight_scale;
+    quantized.bias[j] = layer.bias[j];
+  }
+  return quantized;
+}
+
+/// @brief Compute the sums of a layer for a batch
+/// @param in num_rows rows of layer.num_inputs activations
+/// @param sums Receives num_rows rows of layer.stride sums
+void sumsScalar(const uint8_t in[], int32_t num_rows,
+                const QuantizedLayer &layer, int32_t sums[]) noexcept {
+  for (int32_t row = 0; row < num_rows; ++row) {
+    const uint8_t *x = in + row * layer.num_inputs;
+    for (int32_t j = 0; j < layer.stride; ++j) {
+      int32_t sum = 0;
+      for (int32_t k = 0; k < layer.num_inputs; ++k) {
+        sum += static_cast<int32_t>(x[k]) *
+               layer.weights[((k / 4) * layer.stride + j) * 4 + k % 4];
+      }
+      sums[row * layer.stride + j] = sum;
+    }
+  }
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+/// @brief Compute kRows rows of one block of columns
+/// @details The 4 activations of a group are broadcast to every lane, and
+/// each lane adds their products with its output's 4 weights.
+template <int32_t kRows>
+__attribute__((target("avx2"))) void
+sumBlockAvx2(const uint8_t in[], const QuantizedLayer &layer, int32_t col,
+             int32_t sums[]) noexcept {
+  const __m256i ones = _mm256_set1_epi16(1);
+  __m256i sum[kRows][2];
+  for (int32_t r = 0; r < kRows; ++r) {
+    sum[r][0] = _mm256_setzero_si256();
+    sum[r][1] = _mm256_setzero_si256();
+  }
+  for (int32_t k = 0; k < layer.num_inputs; k += 4) {
+    const int8_t *weights = layer.weights.data() + k * layer.stride + col * 4;
+    const __m256i w0 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(weights));
+    const __m256i w1 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(weights + 32));
+    for (int32_t r = 0; r < kRows; ++r) {
+      int32_t group;
+      std::memcpy(&group, in + r * layer.num_inputs + k, sizeof(group));
+      const __m256i x = _mm256_set1_epi32(group);
+      // Pairs of products are at most 2 * 127 * 127, so they fit in 16 bits
+      sum[r][0] = _mm256_add_epi32(
+          sum[r][0], _mm256_madd_epi16(_mm256_maddubs_epi16(x, w0), ones));
+      sum[r][1] = _mm256_add_epi32(
+          sum[r][1], _mm256_madd_epi16(_mm256_maddubs_epi16(x, w1), ones));
+    }
+  }
+  for (int32_t r = 0; r < kRows; ++r) {
+    int32_t *out = sums + r * layer.stride + col;
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), sum[r][0]);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 8), sum[r][1]);
+  }
+}
+
+/// @brief Compute kRows rows of one block of columns with AVX-VNNI
+/// @details The same as sumBlockAvx2, with one instruction per product
+/// of 4 activations and 4 weights.
+template <int32_t kRows>
+__attribute__((target("avx2,avxvnni"))) void
+sumBlockVnni(const uint8_t in[], const QuantizedLayer &layer, int32_t col,
+             int32_t sums[]) noexcept {
+  __m256i sum[kRows][2];
+  for (int32_t r = 0; r < kRows; ++r) {
+    sum[r][0] = _mm256_setzero_si256();
+    sum[r][1] = _mm256_setzero_si256();
+  }
+  for (int32_t k = 0; k < layer.num_inputs; k += 4) {
+    const int8_t *weights = layer.weights.data() + k * layer.stride + col * 4;
+    const __m256i w0 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(weights));
+    const __m256i w1 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(weights + 32));
+    for (int32_t r = 0; r < kRows; ++r) {
+      int32_t group;
+      std::memcpy(&group, in + r * layer.num_inputs + k, sizeof(group));
+      const __m256i x = _mm256_set1_epi32(group);
+      sum[r][0] = _mm256_dpbusd_avx_epi32(sum[r][0], x, w0);
+      sum[r][1] = _mm256_dpbusd_avx_epi32(sum[r][1], x, w1);
+    }
+  }
+  for (int32_t r = 0; r < kRows; ++r) {
+    int32_t *out = sums + r * layer.stride + col;
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), sum[r][0]);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 8), sum[r][1]);
+  }
+}
+
+template <void (*kBlock)(const uint8_t[], const QuantizedLayer &, int32_t,
+                         int32_t[]) noexcept,
+          void (*kRow)(const uint8_t[], const QuantizedLayer &, int32_t,
+                       int32_t[]) noexcept>
+void sumsBlocked(const uint8_t in[], int32_t num_rows,
+                 const QuantizedLayer &layer, int32_t sums[]) noexcept {
+  static_assert(kColumnBlock == 16, "the kernels compute 16 columns");
+  for (int32_t col = 0; col < layer.stride; col += kColumnBlock) {
+    int32_t row = 0;
+    for (; row + kRowBlock <= num_rows; row += kRowBlock) {
+      kBlock(in + row * layer.num_inputs, layer, col,
+             sums + row * layer.stride);
+    }
+    for (; row < num_rows; ++row) {
+      kRow(in + row * layer.num_inputs, layer, col, sums + row * layer.stride);
+    }
+  }
+}
+#endif
+
+void layerSums(const uint8_t in[], int32_t num_rows,
+               const QuantizedLayer &layer, int32_t sums[]) noexcept {
+#if defined(__GNUC__) && defined(__x86_64__)
+  if (__builtin_cpu_supports("avxvnni")) {
+    sumsBlocked<sumBlockVnni<kRowBlock>, sumBlockVnni<1>>(in, num_rows, layer,
+                                                          sums);
+    return;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    sumsBlocked<sumBlockAvx2<kRowBlock>, sumBlockAvx2<1>>(in, num_rows, layer,
+                                                          sums);
+    return;
+  }
+#endif
+  sumsScalar(in, num_rows, layer, sums);
+}
+
+/// @brief Quantize values with a scale, padding rows to num_padded
+void quantize(const float values[], int32_t value_stride, int32_t num_values,
+              int32_t num_rows, float scale, int32_t num_padded,
+              uint8_t out[]) noexcept {
+  const float inverse = 1.0 / scale;
+  for (int32_t row = 0; row < num_rows; ++row) {
+    uint8_t *x = out + row * num_padded;
+    for (int32_t j = 0; j < num_values; ++j) {
+      // Clamping first lets the rounding be a truncation. These conditionals
+      // vectorize, while std::clamp compiles to branches.
+      float value = values[row * value_stride + j] * inverse + 0.5f;
+      value = value < kMaxActivation ? value : kMaxActivation;
+      value = value > 0.0f ? value : 0.0f;
+      x[j] = static_cast<uint8_t>(static_cast<int32_t>(value));
+    }
+    std::fill(x + num_values, x + num_padded, 0);
+  }
+}
+
+}  // namespace
+
+QuantizedEvaluator::QuantizedEvaluator(const std::vector<DenseLayer> &layers,
+                                       const float game_states[],
+                                       int32_t num_states) {
+  assert(layers.size() >= 2);
+  assert(num_states > 0);
+  const size_t num_hidden = layers.size() - 2;
+  // Each hidden layer is calibrated by the largest output of the float
+  // network, which is the input of the next layer
+  float input_scale = kInputScale;
+  std::vector<float> values(game_states,
+                            game_states + num_states * kGameStateSize);
+  for (size_t i = 0; i < num_hidden; ++i) {
+    layers_.push_back(quantizeLayer(layers[i], input_scale));
+    values = reluLayer(values, num_states, layers[i]);
+    const float max_value = *std::max_element(values.begin(), values.end());
+    input_scale = max_value > 0.0 ? max_value / kMaxActivation : 1.0;
+  }
+  layers_.push_back(quantizeLayer(
+      mergeHeads(layers[num_hidden], layers[num_hidden + 1]), input_scale));
+  for (const QuantizedLayer &layer : layers_) {
+    max_stride_ = std::max({max_stride_, layer.stride, layer.num_inputs});
+  }
+}
+
+void QuantizedEvaluator::evaluate(const float game_states[],
+                                  int32_t num_states, float eval[],
+                                  float probs[]) {
+  assert(num_states >= 0);
+  if (num_states == 0) {
+    return;
+  }
+  const size_t buffer_size = static_cast<size_t>(num_states) * max_stride_;
+  for (std::vector<uint8_t> &buffer : activations_) {
+    if (buffer.size() < buffer_size) {
+      buffer.resize(buffer_size);
+    }
+  }
+  if (sums_.size() < buffer_size) {
+    sums_.resize(buffer_size);
+    outputs_.resize(buffer_size);
+  }
+  quantize(game_states, kGameStateSize, kGameStateSize, num_states,
+           layers_[0].input_scale, layers_[0].num_inputs,
+           activations_[0].data());
+  for (size_t i = 0; i < layers_.size(); ++i) {
+    const QuantizedLayer &layer = layers_[i];
+    layerSums(activations_[i % 2].data(), num_states, layer, sums_.data());
+    // Apply the scales and bias, then the ReLU of the hidden layers
+    for (int32_t row = 0; row < num_states; ++row) {
+      for (int32_t j = 0; j < layer.num_outputs; ++j) {
+        const int32_t index = row * layer.stride + j;
+        outputs_[index] = sums_[index] * layer.scales[j] + layer.bias[j];
+      }
+    }
+    if (i + 1 < layers_.size()) {
+      // Quantization clips negative values, which applies the ReLU
+      quantize(outputs_.data(), layer.stride, layer.num_outputs, num_states,
+               layers_[i + 1].input_scale, layers_[i + 1].num_inputs,
+               activations_[(i + 1) % 2].data());
+    }
+  }
+  activateHeads(outputs_.data(), layers_.back().stride, num_states, eval,
+                probs);
+}
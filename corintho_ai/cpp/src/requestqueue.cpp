@@ -0,0 +1,42 @@
+#include "requestqueue.h"
+
+#include <cassert>
+#include <cstdint>
+
+#include <deque>
+#include <mutex>
+#include <vector>
+
+int32_t RequestQueue::size() const {
+  std::lock_guard<std::mutex> lock{mutex_};
+  return requests_.size();
+}
+
+int32_t RequestQueue::num_rows() const {
+  std::lock_guard<std::mutex> lock{mutex_};
+  return num_rows_;
+}
+
+void RequestQueue::push(int32_t id, int32_t num_rows) {
+  assert(num_rows > 0);
+  std::lock_guard<std::mutex> lock{mutex_};
+  requests_.push_back(Request{id, num_rows});
+  num_rows_ += num_rows;
+}
+
+int32_t RequestQueue::popBatch(int32_t max_rows,
+                               std::vector<Request> &batch) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  batch.clear();
+  int32_t rows = 0;
+  // Keep the order, so no request waits for more than one batch longer than
+  // it has to
+  while (!requests_.empty() &&
+         rows + requests_.front().num_rows <= max_rows) {
+    rows += requests_.front().num_rows;
+    batch.push_back(requests_.front());
+    requests_.pop_front();
+  }
+  num_rows_ -= rows;
+  return rows;
+}
@@ -11,6 +11,7 @@
 #include <utility>
 #include <vector>
 
+#include "game.h"
 #include "move.h"
 #include "node.h"
 #include "trainer.h"
@@ -19,9 +20,9 @@
 SelfPlayer::SelfPlayer(int32_t random_seed, int32_t max_searches,
                        int32_t searches_per_eval, float c_puct, float epsilon,
                        std::unique_ptr<std::ofstream> log_file, bool testing,
-                       int32_t parity)
+                       int32_t parity, bool stop_futile)
     : generator_{std::mt19937(random_seed)},
-      to_eval_{std::make_unique<float[]>(kGameStateSize * max_searches)},
+      to_eval_{std::make_unique<float[]>(kGameStateSize * searches_per_eval)},
       players_{TrainMC{&generator_, to_eval_.get(), max_searches,
                        searches_per_eval, c_puct, epsilon, testing},
                TrainMC{&generator_, to_eval_.get(), max_searches,
@@ -36,6 +37,11 @@ SelfPlayer::SelfPlayer(int32_t random_seed, int32_t max_searches,
   if (!testing) {
     samples_.reserve(32);
   }
+  // Testing players stop futile searches regardless (see TrainMC)
+  if (stop_futile) {
+    players_[0].set_stop_futile(true);
+    players_[1].set_stop_futile(true);
+  }
 }
 
 int32_t SelfPlayer::to_play() const noexcept {
@@ -73,7 +79,37 @@ int32_t SelfPlayer::mate_length() const noexcept {
 void SelfPlayer::writeRequests(float *game_states) const noexcept {
   assert(game_states != nullptr);
   int32_t count = kGameStateSize * players_[to_play_].num_requests();
-  std::copy(to_eval_.get(), to_eval_.get() + count, game_states);
+  std::copy(players_[to_play_].to_eval(),
+            players_[to_play_].to_eval() + count, game_states);
+}
+
+void SelfPlayer::writePackedRequests(PackedGame packed[]) const noexcept {
+  players_[to_play_].writePackedRequests(packed);
+}
+
+void SelfPlayer::set_to_eval(float *to_eval) noexcept {
+  players_[0].set_to_eval(to_eval);
+  players_[1].set_to_eval(to_eval);
+}
+
+void SelfPlayer::set_searches_per_eval(int32_t searches_per_eval) noexcept {
+  players_[0].set_searches_per_eval(searches_per_eval);
+  players_[1].set_searches_per_eval(searches_per_eval);
+}
+
+void SelfPlayer::set_rollout(TrainMC::Rollout rollout,
+                             int32_t num_playouts) noexcept {
+  players_[0].set_rollout(rollout, num_playouts);
+  players_[1].set_rollout(rollout, num_playouts);
+}
+
+void SelfPlayer::set_virtual_loss(float virtual_loss) noexcept {
+  players_[0].set_virtual_loss(virtual_loss);
+  players_[1].set_virtual_loss(virtual_loss);
+}
+
+int32_t SelfPlayer::num_collisions() const noexcept {
+  return players_[0].num_collisions() + players_[1].num_collisions();
 }
 
 void SelfPlayer::writeSamples(float *game_states, float *eval_samples,
@@ -113,12 +149,29 @@ void SelfPlayer::writeSamples(float *game_states, float *eval_samples,
 }
 
 bool SelfPlayer::doIteration(float eval[], float probs[]) {
-  bool done = players_[to_play_].doIteration(eval, probs);
-  // If we have completed a turn, we can choose a move
-  if (done)
-    return chooseMoveAndContinue();
+  assert(state_ == State::kSearching);
   // Otherwise, the turn is not done so the game is not done
-  return false;
+  if (!players_[to_play_].doIteration(eval, probs)) {
+    return false;
+  }
+  // If we have completed a turn, we can choose a move
+  state_ = State::kChoosing;
+  return chooseMoveAndContinue();
+}
+
+void SelfPlayer::cancel() noexcept {
+  if (log_file_ != nullptr) {
+    *log_file_ << "GAME IS CANCELLED.\n";
+  }
+  // The second player has no tree before its first turn
+  for (TrainMC &player : players_) {
+    if (!player.uninitialized()) {
+      player.null_root();
+    }
+  }
+  to_eval_.reset();
+  log_file_.reset();
+  state_ = State::kDone;
 }
 
 void SelfPlayer::writeEval(Node *node) const noexcept {
@@ -229,6 +282,7 @@ void SelfPlayer::endGame() noexcept {
   players_[1].null_root();
   to_eval_.reset();
   log_file_.reset();
+  state_ = State::kDone;
 }
 
 int32_t SelfPlayer::chooseMove() {
@@ -244,48 +298,64 @@ int32_t SelfPlayer::chooseMove() {
 }
 
 bool SelfPlayer::chooseMoveAndContinue() {
-  bool need_eval = false;
+  int32_t choice = -1;
   // Loop until we need an evaluation.
   // We could play many turns, for example when mating sequences are found by
   // both players
-  while (!need_eval) {
-    if (log_file_ != nullptr) {
-      writePreMoveLogs();
-    }
-    // New mate found
-    if (players_[to_play_].root()->known() && mate_turn_ == 0) {
-      mate_turn_ = samples_.size() + 1;
-    }
-    int32_t choice = chooseMove();
-    if (log_file_ != nullptr) {
-      writeMoveChoice(choice);
-    }
-    // Check if the game is over
-    if (players_[to_play_].root()->terminal()) {
-      endGame();
-      return true;
-    }
-    // Go to next player
-    to_play_ = 1 - to_play_;
-    // First time iterating the second player
-    if (players_[to_play_].uninitialized()) {
-      players_[to_play_].createRoot(players_[1 - to_play_].root()->game(),
-                                    players_[1 - to_play_].root()->depth());
-      // This is always false as the root requires an evaluation
-      return players_[to_play_].doIteration();
-    }
-    // It's possible that we need an evaluation for this
-    // in the case that received move has not been searched
-    need_eval = players_[to_play_].receiveOpponentMove(
-        choice, players_[1 - to_play_].root()->get_game(),
-        players_[1 - to_play_].root()->depth());
-    if (!need_eval) {
-      // Otherwise, we search again.
-      // If no evaluation is needed, this player also did all its iterations
-      // without needing evaluations, so we loop again.
-      // This can happen if a mating sequence is found
-      need_eval = !players_[to_play_].doIteration();
+  while (true) {
+    switch (state_) {
+      case State::kChoosing:
+        if (log_file_ != nullptr) {
+          writePreMoveLogs();
+        }
+        // New mate found
+        if (players_[to_play_].root()->known() && mate_turn_ == 0) {
+          mate_turn_ = samples_.size() + 1;
+        }
+        choice = chooseMove();
+        if (log_file_ != nullptr) {
+          writeMoveChoice(choice);
+        }
+        // Check if the game is over
+        if (players_[to_play_].root()->terminal()) {
+          endGame();
+          return true;
+        }
+        // Go to next player
+        to_play_ = 1 - to_play_;
+        state_ = players_[to_play_].uninitialized() ? State::kFirstTurn
+                                                    : State::kReceiving;
+        break;
+      // First time iterating the second player
+      case State::kFirstTurn:
+        players_[to_play_].createRoot(players_[1 - to_play_].root()->game(),
+                                      players_[1 - to_play_].root()->depth());
+        // The root requires an evaluation, unless the players use rollouts
+        state_ = players_[to_play_].doIteration() ? State::kChoosing
+                                                  : State::kSearching;
+        break;
+      case State::kReceiving:
+        // It's possible that we need an evaluation for this
+        // in the case that received move has not been searched
+        if (players_[to_play_].receiveOpponentMove(
+                choice, players_[1 - to_play_].root()->get_game(),
+                players_[1 - to_play_].root()->depth())) {
+          state_ = State::kSearching;
+          break;
+        }
+        // Otherwise, we search again.
+        // If no evaluation is needed, this player also did all its
+        // iterations without needing evaluations, so we choose again.
+        // This can happen if a mating sequence is found
+        state_ = players_[to_play_].doIteration() ? State::kChoosing
+                                                  : State::kSearching;
+        break;
+      // The player to play needs evaluations
+      case State::kSearching:
+        return false;
+      case State::kDone:
+        assert(false);
+        return true;
     }
   }
-  return false;
-}
\ No newline at end of file
+}
@@ -0,0 +1,338 @@
+#include "shmtransport.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "evaluator.h"
+#include "game.h"
+#include "util.h"
+
+// The atomics are shared between processes, so they must not use locks
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+static_assert(sizeof(ShmSegment::Slot) == 16);
+static_assert(sizeof(ShmSegment::Channel) % 64 == 0);
+
+namespace {
+
+/// @brief Round a size up to a whole number of cache lines
+constexpr size_t roundUp(size_t size) noexcept {
+  return (size + 63) / 64 * 64;
+}
+
+constexpr size_t kHeaderSize = roundUp(sizeof(ShmSegment::Header));
+
+size_t requestSize(int32_t max_rows) noexcept {
+  return roundUp(sizeof(ShmSegment::Slot) + max_rows * sizeof(PackedGame));
+}
+
+size_t responseSize(int32_t max_rows) noexcept {
+  return roundUp(sizeof(ShmSegment::Slot) +
+                 max_rows * (1 + kNumMoves) * sizeof(float));
+}
+
+PackedGame *rows(ShmSegment::Slot *slot) noexcept {
+  return reinterpret_cast<PackedGame *>(slot + 1);
+}
+
+/// @brief Return the evaluations of a response, followed by the
+/// probabilities
+float *results(ShmSegment::Slot *slot) noexcept {
+  return reinterpret_cast<float *>(slot + 1);
+}
+
+}  // namespace
+
+ShmSegment::~ShmSegment() {
+  if (data_ != nullptr) {
+    munmap(data_, size_);
+  }
+}
+
+bool ShmSegment::is_open() const noexcept {
+  return data_ != nullptr;
+}
+
+int32_t ShmSegment::num_channels() const noexcept {
+  return is_open() ? header_->num_channels : 0;
+}
+
+int32_t ShmSegment::num_slots() const noexcept {
+  return is_open() ? header_->num_slots : 0;
+}
+
+int32_t ShmSegment::max_rows() const noexcept {
+  return is_open() ? header_->max_rows : 0;
+}
+
+size_t ShmSegment::segmentSize(int32_t num_channels, int32_t num_slots,
+                               int32_t max_rows) noexcept {
+  return kHeaderSize + num_channels * sizeof(Channel) +
+         static_cast<size_t>(num_channels) * num_slots *
+             (requestSize(max_rows) + responseSize(max_rows));
+}
+
+bool ShmSegment::map(int fd, size_t size) noexcept {
+  void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  // The mapping stays valid after the object is closed
+  close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+  data_ = static_cast<char *>(data);
+  size_ = size;
+  header_ = reinterpret_cast<Header *>(data_);
+  return true;
+}
+
+ShmSegment::Channel &ShmSegment::channel(int32_t i) const noexcept {
+  assert(i >= 0 && i < num_channels());
+  return reinterpret_cast<Channel *>(data_ + kHeaderSize)[i];
+}
+
+ShmSegment::Slot *ShmSegment::requestSlot(int32_t channel,
+                                          uint64_t i) const noexcept {
+  const size_t num_slots = header_->num_slots;
+  char *start = data_ + kHeaderSize + num_channels() * sizeof(Channel) +
+                channel * num_slots * (request_size_ + response_size_);
+  return reinterpret_cast<Slot *>(start + i % num_slots * request_size_);
+}
+
+ShmSegment::Slot *ShmSegment::responseSlot(int32_t channel,
+                                           uint64_t i) const noexcept {
+  const size_t num_slots = header_->num_slots;
+  char *start = data_ + kHeaderSize + num_channels() * sizeof(Channel) +
+                channel * num_slots * (request_size_ + response_size_) +
+                num_slots * request_size_;
+  return reinterpret_cast<Slot *>(start + i % num_slots * response_size_);
+}
+
+ShmServer::ShmServer(const std::string &name, int32_t num_channels,
+                     int32_t num_slots, int32_t max_rows)
+    : name_{name} {
+  assert(num_channels > 0 && num_slots > 0 && max_rows > 0);
+  // Workers attached to an old segment keep it until they detach
+  shm_unlink(name.c_str());
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd == -1) {
+    return;
+  }
+  const size_t size = segmentSize(num_channels, num_slots, max_rows);
+  if (ftruncate(fd, size) == -1) {
+    close(fd);
+    shm_unlink(name.c_str());
+    return;
+  }
+  if (!map(fd, size)) {
+    shm_unlink(name.c_str());
+    return;
+  }
+  // The new object is filled with zeros, so workers see that it is not
+  // ready until the end
+  header_ = new (data_) Header{};
+  std::memcpy(header_->magic, kMagic, sizeof(kMagic));
+  header_->version = kVersion;
+  header_->num_channels = num_channels;
+  header_->num_slots = num_slots;
+  header_->max_rows = max_rows;
+  request_size_ = requestSize(max_rows);
+  response_size_ = responseSize(max_rows);
+  for (int32_t i = 0; i < num_channels; ++i) {
+    new (&channel(i)) Channel{};
+  }
+  header_->ready.store(1, std::memory_order_release);
+}
+
+ShmServer::~ShmServer() {
+  if (is_open()) {
+    shm_unlink(name_.c_str());
+  }
+}
+
+int32_t ShmServer::serve(Evaluator &evaluator, int32_t max_batch) {
+  assert(is_open());
+  assert(max_batch >= max_rows());
+  if (static_cast<int32_t>(packed_.size()) < max_batch) {
+    packed_.resize(max_batch);
+    game_states_.resize(max_batch * kGameStateSize);
+    eval_.resize(max_batch);
+    probs_.resize(max_batch * kNumMoves);
+  }
+  taken_.clear();
+  int32_t num_rows = 0;
+  for (int32_t k = 0; k < num_channels(); ++k) {
+    const int32_t c = (first_channel_ + k) % num_channels();
+    Channel &ch = channel(c);
+    uint64_t head = ch.requests.head.load(std::memory_order_relaxed);
+    const uint64_t tail = ch.requests.tail.load(std::memory_order_acquire);
+    // Only take requests whose responses have room
+    const uint64_t num_pending =
+        ch.responses.tail.load(std::memory_order_relaxed) -
+        ch.responses.head.load(std::memory_order_acquire);
+    uint64_t num_free = num_slots() - num_pending;
+    const uint32_t epoch = ch.epoch.load(std::memory_order_acquire);
+    while (head < tail && num_free > 0) {
+      Slot *slot = requestSlot(c, head);
+      if (slot->epoch != epoch) {
+        // The worker that sent this has restarted
+        ++head;
+        continue;
+      }
+      if (num_rows + slot->num_rows > max_batch) {
+        break;
+      }
+      std::copy_n(rows(slot), slot->num_rows, packed_.data() + num_rows);
+      taken_.push_back(Taken{c, slot->epoch, slot->num_rows});
+      num_rows += slot->num_rows;
+      ++head;
+      --num_free;
+    }
+    // The rows have been copied, so the worker can reuse the slots
+    ch.requests.head.store(head, std::memory_order_release);
+  }
+  first_channel_ = (first_channel_ + 1) % num_channels();
+  if (num_rows == 0) {
+    return 0;
+  }
+
+  expandGameStates(packed_.data(), num_rows, game_states_.data());
+  evaluator.evaluate(game_states_.data(), num_rows, eval_.data(),
+                     probs_.data());
+
+  int32_t offset = 0;
+  for (const Taken &taken : taken_) {
+    Channel &ch = channel(taken.channel);
+    const uint64_t tail = ch.responses.tail.load(std::memory_order_relaxed);
+    Slot *slot = responseSlot(taken.channel, tail);
+    slot->epoch = taken.epoch;
+    slot->num_rows = taken.num_rows;
+    float *out = results(slot);
+    std::copy_n(eval_.data() + offset, taken.num_rows, out);
+    std::copy_n(probs_.data() + offset * kNumMoves, taken.num_rows * kNumMoves,
+                out + taken.num_rows);
+    ch.responses.tail.store(tail + 1, std::memory_order_release);
+    offset += taken.num_rows;
+  }
+  return num_rows;
+}
+
+bool ShmServer::all_done() const noexcept {
+  for (int32_t i = 0; i < num_channels(); ++i) {
+    if (channel(i).done.load(std::memory_order_acquire) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+ShmClient::ShmClient(const std::string &name, int32_t channel)
+    : channel_{channel} {
+  int fd = shm_open(name.c_str(), O_RDWR, 0600);
+  if (fd == -1) {
+    return;
+  }
+  struct stat shm_stat;
+  if (fstat(fd, &shm_stat) == -1 ||
+      static_cast<size_t>(shm_stat.st_size) < kHeaderSize) {
+    close(fd);
+    return;
+  }
+  if (!map(fd, shm_stat.st_size)) {
+    return;
+  }
+  // Check that the server has finished creating a segment of this version
+  // and that the channel exists
+  if (header_->ready.load(std::memory_order_acquire) == 0 ||
+      std::memcmp(header_->magic, kMagic, sizeof(kMagic)) != 0 ||
+      header_->version != kVersion || channel < 0 ||
+      channel >= static_cast<int32_t>(header_->num_channels) ||
+      size_ < segmentSize(header_->num_channels, header_->num_slots,
+                          header_->max_rows)) {
+    munmap(data_, size_);
+    data_ = nullptr;
+    header_ = nullptr;
+    size_ = 0;
+    return;
+  }
+  request_size_ = requestSize(header_->max_rows);
+  response_size_ = responseSize(header_->max_rows);
+  Channel &ch = ShmSegment::channel(channel_);
+  epoch_ = ch.epoch.fetch_add(1, std::memory_order_acq_rel) + 1;
+  ch.done.store(0, std::memory_order_release);
+}
+
+bool ShmClient::trySend(const PackedGame packed[],
+                        int32_t num_rows) noexcept {
+  assert(is_open());
+  assert(num_rows > 0 && num_rows <= max_rows());
+  Ring &ring = channel(channel_).requests;
+  const uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+  if (tail - ring.head.load(std::memory_order_acquire) >=
+      static_cast<uint64_t>(num_slots())) {
+    return false;
+  }
+  Slot *slot = requestSlot(channel_, tail);
+  slot->epoch = epoch_;
+  slot->num_rows = num_rows;
+  std::copy_n(packed, num_rows, rows(slot));
+  ring.tail.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+int32_t ShmClient::tryReceive(float eval[], float probs[]) noexcept {
+  assert(is_open());
+  Ring &ring = channel(channel_).responses;
+  while (true) {
+    const uint64_t head = ring.head.load(std::memory_order_relaxed);
+    if (head == ring.tail.load(std::memory_order_acquire)) {
+      return 0;
+    }
+    Slot *slot = responseSlot(channel_, head);
+    // Drop responses to a worker that attached to this channel before
+    const int32_t num_rows = slot->epoch == epoch_ ? slot->num_rows : 0;
+    const float *in = results(slot);
+    std::copy_n(in, num_rows, eval);
+    std::copy_n(in + num_rows, num_rows * kNumMoves, probs);
+    ring.head.store(head + 1, std::memory_order_release);
+    if (num_rows > 0) {
+      return num_rows;
+    }
+  }
+}
+
+void ShmClient::evaluate(const PackedGame packed[], int32_t num_rows,
+                         float eval[], float probs[]) noexcept {
+  int32_t num_sent = 0;
+  int32_t num_received = 0;
+  while (num_received < num_rows) {
+    if (num_sent < num_rows) {
+      const int32_t num_to_send = std::min(max_rows(), num_rows - num_sent);
+      if (trySend(packed + num_sent, num_to_send)) {
+        num_sent += num_to_send;
+        continue;
+      }
+    }
+    const int32_t num_new = tryReceive(eval + num_received,
+                                       probs + num_received * kNumMoves);
+    if (num_new == 0) {
+      std::this_thread::yield();
+    }
+    num_received += num_new;
+  }
+}
+
+void ShmClient::finish() noexcept {
+  channel(channel_).done.store(1, std::memory_order_release);
+}
@@ -0,0 +1,154 @@
+#include "threadpool.h"
+
+#include <cassert>
+#include <cstdint>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+ThreadPool::ThreadPool(int32_t num_threads) {
+  assert(num_threads >= 0);
+  if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (int32_t i = 0; i < num_threads; ++i) {
+    queues_.push_back(std::make_unique<Queue>());
+  }
+  // The calling thread is thread 0
+  for (int32_t i = 1; i < num_threads; ++i) {
+    workers_.emplace_back(&ThreadPool::workerLoop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    stop_ = true;
+  }
+  start_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+int32_t ThreadPool::num_threads() const noexcept {
+  return queues_.size();
+}
+
+void ThreadPool::parallelFor(int32_t num_tasks,
+                             const std::function<void(int32_t)> &task) {
+  if (num_tasks <= 0) {
+    return;
+  }
+  if (workers_.empty()) {
+    for (int32_t i = 0; i < num_tasks; ++i) {
+      task(i);
+    }
+    return;
+  }
+  distribute(num_tasks, &task, 0);
+  runTasks(0);
+  // Wait for tasks still running on other threads
+  wait();
+}
+
+void ThreadPool::start(int32_t num_tasks, std::function<void(int32_t)> task) {
+  assert(remaining_ == 0);
+  if (num_tasks <= 0) {
+    return;
+  }
+  async_task_ = std::move(task);
+  if (workers_.empty()) {
+    for (int32_t i = 0; i < num_tasks; ++i) {
+      async_task_(i);
+    }
+    return;
+  }
+  // The caller does not run tasks, so its queue is left empty
+  distribute(num_tasks, &async_task_, 1);
+}
+
+void ThreadPool::wait() {
+  std::unique_lock<std::mutex> lock{mutex_};
+  done_.wait(lock, [this] { return remaining_ == 0; });
+  task_ = nullptr;
+}
+
+void ThreadPool::distribute(int32_t num_tasks,
+                            const std::function<void(int32_t)> *task,
+                            int32_t first_queue) {
+  task_ = task;
+  remaining_ = num_tasks;
+  // Contiguous blocks, so neighbouring games stay on one thread unless stolen
+  const int32_t num_queues = queues_.size() - first_queue;
+  for (int32_t q = 0; q < num_queues; ++q) {
+    Queue &queue = *queues_[first_queue + q];
+    std::lock_guard<std::mutex> lock{queue.mutex};
+    for (int32_t i = num_tasks * q / num_queues;
+         i < num_tasks * (q + 1) / num_queues; ++i) {
+      queue.tasks.push_back(i);
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    ++batch_;
+  }
+  start_.notify_all();
+}
+
+void ThreadPool::workerLoop(int32_t id) {
+  int64_t batch = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock{mutex_};
+      start_.wait(lock, [this, batch] { return stop_ || batch_ != batch; });
+      if (stop_) {
+        return;
+      }
+      batch = batch_;
+    }
+    runTasks(id);
+  }
+}
+
+void ThreadPool::runTasks(int32_t id) {
+  int32_t i = takeTask(id);
+  while (i != -1) {
+    (*task_)(i);
+    if (--remaining_ == 0) {
+      // Lock so the notification cannot be missed by the waiting caller
+      std::lock_guard<std::mutex> lock{mutex_};
+      done_.notify_all();
+    }
+    i = takeTask(id);
+  }
+}
+
+int32_t ThreadPool::takeTask(int32_t id) {
+  {
+    std::lock_guard<std::mutex> lock{queues_[id]->mutex};
+    auto &tasks = queues_[id]->tasks;
+    if (!tasks.empty()) {
+      int32_t i = tasks.back();
+      tasks.pop_back();
+      return i;
+    }
+  }
+  // Steal from the other queues, starting with the next thread
+  const int32_t num_queues = queues_.size();
+  for (int32_t offset = 1; offset < num_queues; ++offset) {
+    Queue &queue = *queues_[(id + offset) % num_queues];
+    std::lock_guard<std::mutex> lock{queue.mutex};
+    if (!queue.tasks.empty()) {
+      int32_t i = queue.tasks.front();
+      queue.tasks.pop_front();
+      return i;
+    }
+  }
+  return -1;
+}
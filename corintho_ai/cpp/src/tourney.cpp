@@ -4,94 +4,198 @@
 #include <cstdint>
 
 #include <fstream>
+#include <map>
+#include <memory>
 #include <random>
 #include <string>
+#include <vector>
 
 #include <gsl/gsl>
-#include <omp.h>
 
+#include "threadpool.h"
 #include "util.h"
 
-bool Tourney::all_done() const noexcept {
-  for (const auto &done : is_done_) {
-    if (!done)
-      return false;
-  }
+Tourney::Tourney(int32_t num_threads, std::string log_folder,
+                 int32_t max_active)
+    : num_threads_{num_threads}, log_folder_{log_folder},
+      max_active_{max_active},
+      pool_{std::make_unique<ThreadPool>(num_threads)} {
+  assert(num_threads > 0);
+  assert(max_active >= 0);
+}
 
-  return true;
+bool Tourney::all_done() const noexcept {
+  return next_match_ == records_.size() && matches_.empty();
 }
 
 int32_t Tourney::num_requests(int32_t id) const noexcept {
   int32_t count = 0;
   for (size_t i = 0; i < matches_.size(); ++i) {
-    if (!is_done_[i] && matches_[i]->to_play() == id) {
+    if (id == -1 || matches_[i]->to_play() == id) {
       count += matches_[i]->num_requests();
     }
   }
   return count;
 }
 
+int32_t Tourney::offset(int32_t id) const noexcept {
+  int32_t offset = 0;
+  for (const auto &[model_id, count] : countRequests()) {
+    if (model_id >= id) {
+      break;
+    }
+    offset += count;
+  }
+  return offset;
+}
+
+int32_t Tourney::num_active() const noexcept {
+  return matches_.size();
+}
+
+std::vector<int32_t> Tourney::model_ids() const {
+  std::vector<int32_t> ids;
+  for (const auto &[model_id, count] : countRequests()) {
+    if (count > 0) {
+      ids.push_back(model_id);
+    }
+  }
+  return ids;
+}
+
+const std::vector<Tourney::MatchResult> &Tourney::results() const noexcept {
+  return results_;
+}
+
+float Tourney::score(int32_t player_id) const noexcept {
+  float score = 0.0;
+  int32_t num_matches = 0;
+  for (const MatchResult &result : results_) {
+    if (result.player1 == player_id) {
+      score += result.score;
+      ++num_matches;
+    } else if (result.player2 == player_id) {
+      score += 1.0 - result.score;
+      ++num_matches;
+    }
+  }
+  return num_matches > 0 ? score / num_matches : 0.5;
+}
+
 void Tourney::writeScores(const std::string &filename) const {
   std::ofstream file = std::ofstream{filename, std::ofstream::out};
-  for (size_t i = 0; i < matches_.size(); ++i) {
-    if (is_done_[i]) {
-      file << matches_[i]->id(0) << ' ' << matches_[i]->id(1) << ' '
-           << matches_[i]->score() << '\n';
-    }
+  for (const MatchResult &result : results_) {
+    file << result.player1 << ' ' << result.player2 << ' ' << result.score
+         << '\n';
   }
 }
 
 void Tourney::writeRequests(float *game_states, int32_t id) noexcept {
-  int32_t offset = 0;
+  groupRequests();
+  // The region of a model starts at its offset among all models
+  const int32_t start = id == -1 ? 0 : offset(id);
   for (size_t i = 0; i < matches_.size(); ++i) {
-    if (!is_done_[i] && matches_[i]->to_play() == id) {
-      matches_[i]->writeRequests(game_states + offset * kGameStateSize);
-      offset += matches_[i]->num_requests();
+    if (id == -1 || matches_[i]->to_play() == id) {
+      matches_[i]->writeRequests(game_states +
+                                 (offsets_[i] - start) * kGameStateSize);
     }
   }
 }
 
 void Tourney::doIteration(float eval[], float probs[], int32_t id) {
-  int32_t offset = 0;
-  int32_t offsets[matches_.size()] = {0};
-  for (size_t i = 1; i < matches_.size(); ++i) {
-    if (!is_done_[i] && matches_[i]->to_play() == id) {
-      offset += matches_[i - 1]->num_requests();
+  // Read the evaluations in the layout of Tourney::writeRequests
+  groupRequests();
+  const int32_t start = id == -1 ? 0 : offset(id);
+  std::vector<int32_t> active;
+  for (size_t i = 0; i < matches_.size(); ++i) {
+    if (id == -1 || matches_[i]->to_play() == id) {
+      active.push_back(i);
     }
-    offsets[i] = offset;
   }
-  omp_set_num_threads(num_threads_);
-#pragma omp parallel for
+  is_done_.assign(matches_.size(), false);
+  pool_->parallelFor(active.size(), [&](int32_t j) {
+    const int32_t i = active[j];
+    const int32_t row = offsets_[i] - start;
+    if (matches_[i]->doIteration(eval + row, probs + row * kNumMoves)) {
+      is_done_[i] = true;
+    }
+  });
+  // Record the scores of the finished matches and free them, keeping the
+  // other matches in order
+  size_t num_kept = 0;
   for (size_t i = 0; i < matches_.size(); ++i) {
-    if (!is_done_[i] && matches_[i]->to_play() == id) {
-      bool done = matches_[i]->doIteration(eval + offsets[i],
-                                           probs + offsets[i] * kNumMoves);
-      if (done)
-        is_done_[i] = true;
+    if (is_done_[i]) {
+      const MatchRecord &record = records_[record_ids_[i]];
+      results_.push_back(
+          MatchResult{record.player1, record.player2, matches_[i]->score()});
+      matches_[i].reset();
+      continue;
     }
+    matches_[num_kept] = std::move(matches_[i]);
+    record_ids_[num_kept] = record_ids_[i];
+    ++num_kept;
+  }
+  matches_.resize(num_kept);
+  record_ids_.resize(num_kept);
+  startMatches();
+}
+
+void Tourney::startMatches() {
+  while (next_match_ < records_.size() &&
+         (max_active_ == 0 ||
+          matches_.size() < static_cast<size_t>(max_active_))) {
+    const MatchRecord &record = records_[next_match_];
+    matches_.emplace_back(new Match{
+        record.seed, players_[record.player1], players_[record.player2],
+        record.logging
+            ? std::make_unique<std::ofstream>(
+                  log_folder_ + "/match_" + std::to_string(record.player1) +
+                  "_" + std::to_string(record.player2) + "_" +
+                  std::to_string(next_match_) + ".txt")
+            : nullptr});
+    record_ids_.push_back(next_match_);
+    ++next_match_;
+  }
+}
+
+std::map<int32_t, int32_t> Tourney::countRequests() const {
+  std::map<int32_t, int32_t> counts;
+  for (const auto &match : matches_) {
+    counts[match->to_play()] += match->num_requests();
+  }
+  return counts;
+}
+
+void Tourney::groupRequests() {
+  // Give each model a region, then place its matches in order within it
+  std::map<int32_t, int32_t> next_row;
+  int32_t offset = 0;
+  for (const auto &[model_id, count] : countRequests()) {
+    next_row[model_id] = offset;
+    offset += count;
+  }
+  offsets_.assign(matches_.size(), 0);
+  for (size_t i = 0; i < matches_.size(); ++i) {
+    int32_t &row = next_row[matches_[i]->to_play()];
+    offsets_[i] = row;
+    row += matches_[i]->num_requests();
   }
 }
 
 void Tourney::addPlayer(int32_t player_id, int32_t model_id,
                         int32_t max_searches, int32_t searches_per_eval,
-                        float c_puct, float epsilon, bool random) {
+                        float c_puct, float epsilon, bool random,
+                        int32_t rollout) {
   players_[player_id] =
       Player{player_id, model_id, max_searches, searches_per_eval,
-             c_puct,    epsilon,  random};
+             c_puct,    epsilon,  random,       TrainMC::Rollout(rollout)};
 }
 
 void Tourney::addMatch(int32_t player1, int32_t player2, bool logging) {
-  assert(matches_.size() == is_done_.size());
+  // make sure the player exists
   assert(players_.find(player1) != players_.end());
   assert(players_.find(player2) != players_.end());
-  // make sure the player exists
-  matches_.emplace_back(new Match{
-      gsl::narrow_cast<int32_t>(generator_()), players_[player1],
-      players_[player2],
-      logging ? std::make_unique<std::ofstream>(
-                    log_folder_ + "/match_" + std::to_string(player1) + "_" +
-                    std::to_string(player2) + "_" +
-                    std::to_string(matches_.size()) + ".txt")
-              : nullptr});
-  is_done_.push_back(false);
+  records_.push_back(MatchRecord{gsl::narrow_cast<int32_t>(generator_()),
+                                 player1, player2, logging});
+  startMatches();
 }
\ No newline at end of file
@@ -1,27 +1,41 @@
 #include "trainer.h"
 
+#include <cmath>
 #include <cstdint>
 
 #include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
 #include <queue>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <gsl/gsl>
-#include <omp.h>
 
+#include "evaltuner.h"
+#include "evaluator.h"
+#include "game.h"
 #include "node.h"
+#include "requestqueue.h"
 #include "selfplayer.h"
+#include "threadpool.h"
 #include "trainmc.h"
 #include "util.h"
 
 Trainer::Trainer(int32_t num_games, const std::string &log_folder,
                  int32_t seed, int32_t max_searches, int32_t searches_per_eval,
                  float c_puct, float epsilon, int32_t num_logged,
-                 int32_t num_threads, bool testing)
-    : is_done_{std::vector<bool>(num_games, false)},
+                 int32_t num_threads, bool testing, bool stop_futile,
+                 int32_t num_cohorts, int32_t num_slots)
+    : is_done_(num_games, false), offsets_(num_games, 0),
+      rows_per_game_{searches_per_eval}, num_games_{num_games},
+      log_folder_{log_folder}, num_logged_{num_logged}, c_puct_{c_puct},
+      epsilon_{epsilon}, testing_{testing}, stop_futile_{stop_futile},
       max_searches_{max_searches}, searches_per_eval_{searches_per_eval},
-      num_threads_{num_threads}, generator_{gsl::narrow_cast<uint32_t>(seed)} {
+      num_threads_{num_threads},
+      generator_{gsl::narrow_cast<uint32_t>(seed)} {
   assert(num_games > 0);
   assert(num_logged >= 0);
   assert(num_logged <= num_games);
@@ -32,22 +46,38 @@ Trainer::Trainer(int32_t num_games, const std::string &log_folder,
   assert(epsilon >= 0.0);
   assert(epsilon <= 1.0);
   assert(num_threads > 0);
-  initialize(num_games, log_folder, max_searches, searches_per_eval, c_puct,
-             epsilon, num_logged, testing);
+  assert(num_cohorts > 0);
+  assert(!testing || num_cohorts == 1);
+  assert(num_slots >= 0);
+  // 0 plays all games at once
+  if (num_slots == 0 || num_slots > num_games) {
+    num_slots = num_games;
+  }
+  initialize(num_slots, num_cohorts);
 }
 
 int32_t Trainer::num_requests(int32_t to_play) const noexcept {
+  // Training mode
+  if (to_play != 0 && to_play != 1) {
+    return cohorts_.empty() ? 0 : cohorts_[0].batch_size;
+  }
   int32_t num_requests = 0;
-  for (const auto &game : games_) {
-    if (!is_done_[&game - &games_[0]] &&
-        ((to_play != 0 && to_play != 1) ||
-         game.to_play() == (to_play + game.parity()) % 2)) {
-      num_requests += game.num_requests();
+  for (int32_t i : cohorts_[0].active) {
+    if (games_[i].to_play() == (to_play + games_[i].parity()) % 2) {
+      num_requests += games_[i].num_requests();
     }
   }
   return num_requests;
 }
 
+int32_t Trainer::batch_size(int32_t cohort) const noexcept {
+  return cohorts_[cohort].batch_size;
+}
+
+int32_t Trainer::num_games() const noexcept {
+  return games_.size();
+}
+
 int32_t Trainer::num_samples() const noexcept {
   int32_t num_samples = 0;
   for (const auto &game : games_) {
@@ -56,50 +86,87 @@ int32_t Trainer::num_samples() const noexcept {
   return num_samples;
 }
 
+int64_t Trainer::num_collisions() const noexcept {
+  int64_t num_collisions = 0;
+  for (const auto &game : games_) {
+    num_collisions += game.num_collisions();
+  }
+  return num_collisions;
+}
+
 float Trainer::score() const noexcept {
   float score = 0;
-  for (size_t i = 0; i < games_.size(); i += 2) {
-    score += games_[i].score();
-  }
-  for (size_t i = 1; i < games_.size(); i += 2) {
-    score += 1.0 - games_[i].score();
+  int32_t num_done = 0;
+  for (size_t i = 0; i < games_.size(); ++i) {
+    if (!is_done_[i]) {
+      continue;
+    }
+    score += i % 2 == 0 ? games_[i].score() : 1.0 - games_[i].score();
+    ++num_done;
   }
-  return score / games_.size();
+  return num_done == 0 ? 0.5 : score / num_done;
 }
 
 float Trainer::avg_mate_length() const noexcept {
   int32_t total_length = 0;
-  for (const auto &game : games_) {
-    assert(is_done_[&game - &games_[0]]);
-    total_length += game.mate_length();
+  int32_t num_done = 0;
+  for (size_t i = 0; i < games_.size(); ++i) {
+    if (is_done_[i]) {
+      total_length += games_[i].mate_length();
+      ++num_done;
+    }
   }
-  return static_cast<float>(total_length) / games_.size();
+  return num_done == 0 ? 0.0 : static_cast<float>(total_length) / num_done;
 }
 
 void Trainer::writeRequests(float *game_states,
                             int32_t to_play) const noexcept {
-  int32_t offset = 0;
+  // Training mode
+  const Cohort &cohort = cohorts_[0];
+  if (to_play != 0 && to_play != 1) {
+    std::copy(cohort.to_eval.get(),
+              cohort.to_eval.get() + cohort.batch_size * kGameStateSize,
+              game_states);
+    return;
+  }
   // Testing mode
   // Only count requests from one player
-  if (to_play == 0 || to_play == 1) {
-    for (size_t i = 0; i < games_.size(); ++i) {
-      if (games_[i].to_play() == (to_play + games_[i].parity()) % 2 &&
-          !is_done_[i]) {
-        games_[i].writeRequests(game_states + offset * kGameStateSize);
-        offset += games_[i].num_requests();
+  int32_t offset = 0;
+  for (int32_t i : cohort.active) {
+    if (games_[i].to_play() == (to_play + games_[i].parity()) % 2) {
+      games_[i].writeRequests(game_states + offset * kGameStateSize);
+      offset += games_[i].num_requests();
+    }
+  }
+}
+
+void Trainer::writePackedRequests(PackedGame packed[],
+                                  int32_t to_play) const noexcept {
+  // Training mode
+  // Match the rows of Trainer::requests
+  const Cohort &cohort = cohorts_[0];
+  if (to_play != 0 && to_play != 1) {
+    for (int32_t i : cohort.active) {
+      if (games_[i].num_requests() > 0) {
+        games_[i].writePackedRequests(packed + offsets_[i]);
       }
     }
     return;
   }
-  // Training mode
-  for (size_t i = 0; i < games_.size(); ++i) {
-    if (!is_done_[i]) {
-      games_[i].writeRequests(game_states + offset * kGameStateSize);
+  // Testing mode
+  int32_t offset = 0;
+  for (int32_t i : cohort.active) {
+    if (games_[i].to_play() == (to_play + games_[i].parity()) % 2) {
+      games_[i].writePackedRequests(packed + offset);
       offset += games_[i].num_requests();
     }
   }
 }
 
+float *Trainer::requests(int32_t cohort) noexcept {
+  return cohorts_[cohort].to_eval.get();
+}
+
 void Trainer::writeSamples(float *game_states, float *eval_samples,
                            float *prob_samples) const noexcept {
   int32_t offset = 0;
@@ -113,144 +180,453 @@ void Trainer::writeSamples(float *game_states, float *eval_samples,
 }
 
 void Trainer::writeScores(const std::string &filename) const {
-  float scores[games_.size()];
-  for (size_t i = 0; i < games_.size(); i += 2) {
-    scores[i] = games_[i].score();
-  }
-  for (size_t i = 1; i < games_.size(); i += 2) {
-    scores[i] = 1.0 - games_[i].score();
-  }
-  // First player score
-  int32_t wins = 0;
-  int32_t draws = 0;
-  for (size_t i = 0; i < games_.size(); i += 2) {
-    if (scores[i] == 1.0) {
-      ++wins;
-    } else if (scores[i] == 0.5) {
-      ++draws;
-    }
-  }
+  // Cancelled games and games the test did not count are left out. See
+  // Trainer::set_sprt
   std::ofstream file = std::ofstream{filename, std::ofstream::out};
-  file << "First player wins: " << wins << " / " << games_.size() / 2 << " = "
-       << static_cast<float>(wins) / (games_.size() / 2)
-       << "\nFirst player draws: " << draws << " / " << games_.size() / 2
-       << " = " << static_cast<float>(draws) / (games_.size() / 2)
-       << "\nFirst player losses: " << games_.size() / 2 - wins - draws
-       << " / " << games_.size() / 2 << " = "
-       << static_cast<float>(games_.size() / 2 - wins - draws) /
-              (games_.size() / 2)
-       << '\n';
-  // Second player score
-  wins = 0;
-  draws = 0;
-  for (size_t i = 1; i < games_.size(); i += 2) {
-    if (scores[i] == 1.0) {
-      ++wins;
-    } else if (scores[i] == 0.5) {
-      ++draws;
+  const char *names[2] = {"First", "Second"};
+  for (size_t parity = 0; parity < 2; ++parity) {
+    int32_t num_done = 0;
+    int32_t wins = 0;
+    int32_t draws = 0;
+    for (size_t i = parity; i < games_.size(); i += 2) {
+      if (!is_done_[i]) {
+        continue;
+      }
+      ++num_done;
+      const float score =
+          parity == 0 ? games_[i].score() : 1.0 - games_[i].score();
+      if (score == 1.0) {
+        ++wins;
+      } else if (score == 0.5) {
+        ++draws;
+      }
     }
+    const int32_t losses = num_done - wins - draws;
+    file << names[parity] << " player wins: " << wins << " / " << num_done
+         << " = " << static_cast<float>(wins) / num_done << '\n'
+         << names[parity] << " player draws: " << draws << " / " << num_done
+         << " = " << static_cast<float>(draws) / num_done << '\n'
+         << names[parity] << " player losses: " << losses << " / "
+         << num_done << " = " << static_cast<float>(losses) / num_done
+         << '\n';
   }
-  file << "Second player wins: " << wins << " / " << games_.size() / 2 << " = "
-       << static_cast<float>(wins) / (games_.size() / 2)
-       << "\nSecond player draws: " << draws << " / " << games_.size() / 2
-       << " = " << static_cast<float>(draws) / (games_.size() / 2)
-       << "\nSecond player losses: " << games_.size() / 2 - wins - draws
-       << " / " << games_.size() / 2 << " = "
-       << static_cast<float>(games_.size() / 2 - wins - draws) /
-              (games_.size() / 2)
-       << '\n';
 }
 
 bool Trainer::doIteration(float eval[], float probs[], int32_t to_play) {
   // Training
   if (to_play != 0 && to_play != 1) {
-    // Compute offsets for evaluations and probabilities since we use
-    // multiprocessing.
-    int32_t offset = 0;
-    int32_t offsets[games_.size()] = {0};
-    for (size_t i = 1; i < games_.size(); ++i) {
-      offset += games_[i - 1].num_requests();
-      offsets[i] = offset;
+    assert(cohorts_.size() == 1);
+    if (eval_batch_size_ > 0) {
+      return doQueuedIteration(eval, probs);
     }
-    omp_set_num_threads(num_threads_);
-#pragma omp parallel for
-    for (size_t i = 0; i < games_.size(); ++i) {
-      if (!is_done_[i]) {
-        // We offset the start of the games to try to get an even distribution
-        // of the games across the number of searches in a move. This way, the
-        // total number of nodes will be more even. This reduces peak memory
-        // usage. Avoid division by 0 in the rare case that games_.size() <
-        // max_searches_
-        if (i / std::max(games_.size() / max_searches_,
-                         static_cast<size_t>(1)) <=
-            static_cast<size_t>(searches_done_)) {
-          // First search does not depend on pointers being null
-          bool done = games_[i].doIteration(eval + offsets[i],
-                                            probs + kNumMoves * offsets[i]);
-          // Game is done
-          if (done) {
-            is_done_[i] = true;
-          }
-        }
-      }
+    Cohort &cohort = cohorts_[0];
+    const auto start = std::chrono::steady_clock::now();
+    // The last batch has been evaluated since the last iteration
+    if (autotune_ && cohort.batch_size > 0) {
+      tuner_.record(
+          cohort.batch_size, search_time_,
+          std::chrono::duration<double>(start - search_end_).count(),
+          cohort.active.size());
+      rows_per_game_ = tuner_.searches_per_eval();
     }
-    ++searches_done_;
-    for (size_t i = 0; i < games_.size(); ++i) {
-      if (!is_done_[i]) {
-        return false;
-      }
-    }
-    return true;
+    searchCohort(cohort, eval, probs, true);
+    const bool done = finishCohort(cohort);
+    search_end_ = std::chrono::steady_clock::now();
+    search_time_ = std::chrono::duration<double>(search_end_ - start).count();
+    return done;
   }
   // Testing
+  // No offset in game start (there are not enough games for memory usage to
+  // matter).
+  // Only count games from one player. The offsets follow the order of
+  // writeRequests.
+  Cohort &cohort = cohorts_[0];
+  std::vector<int32_t> ready;
   int32_t offset = 0;
-  int32_t offsets[games_.size()] = {0};
-  for (size_t i = 1; i < games_.size(); ++i) {
-    // Only count games from one player
-    if (games_[i - 1].to_play() == (to_play + games_[i - 1].parity()) % 2 &&
-        !is_done_[i - 1]) {
-      offset += games_[i - 1].num_requests();
+  for (int32_t i : cohort.active) {
+    if (games_[i].to_play() == (to_play + games_[i].parity()) % 2) {
+      ready.push_back(i);
+      offsets_[i] = offset;
+      offset += games_[i].num_requests();
     }
-    offsets[i] = offset;
   }
-  omp_set_num_threads(num_threads_);
-#pragma omp parallel for
-  for (size_t i = 0; i < games_.size(); ++i) {
-    // No offset in game start (there are not enough games for memory usage to
-    // matter).
-    if (games_[i].to_play() == (to_play + games_[i].parity()) % 2 &&
-        !is_done_[i]) {
-      bool done = games_[i].doIteration(eval + offsets[i],
-                                        probs + kNumMoves * offsets[i]);
-      if (done) {
-        is_done_[i] = true;
-      }
+  cohort.pool->parallelFor(ready.size(), [&](int32_t j) {
+    int32_t i = ready[j];
+    if (games_[i].doIteration(eval + offsets_[i],
+                              probs + kNumMoves * offsets_[i])) {
+      is_done_[i] = true;
     }
+  });
+  if (sprt_) {
+    updateSprt(cohort);
   }
-  for (size_t i = 0; i < games_.size(); ++i) {
+  removeDoneGames(cohort);
+  startGames(cohort);
+  return cohort.active.empty();
+}
+
+void Trainer::set_batch_size(int32_t batch_size) noexcept {
+  assert(cohorts_.size() == 1);
+  assert(cohorts_[0].searches_done == 0);
+  assert(batch_size == 0 || batch_size >= searches_per_eval_);
+  // The batch buffer holds requests from every slot
+  eval_batch_size_ =
+      std::min(batch_size, cohorts_[0].num_slots * searches_per_eval_);
+}
+
+void Trainer::set_target_samples(int32_t num_samples) noexcept {
+  target_samples_ = num_samples;
+}
+
+void Trainer::set_sprt(float elo0, float elo1, float alpha,
+                       float beta) noexcept {
+  assert(testing_);
+  assert(cohorts_[0].searches_done == 0);
+  assert(elo0 < elo1);
+  assert(alpha > 0.0 && alpha < 1.0);
+  assert(beta > 0.0 && beta < 1.0);
+  sprt_ = true;
+  sprt_score0_ = 1.0 / (1.0 + std::pow(10.0, -elo0 / 400.0));
+  sprt_score1_ = 1.0 / (1.0 + std::pow(10.0, -elo1 / 400.0));
+  sprt_lower_ = std::log(beta / (1.0 - alpha));
+  sprt_upper_ = std::log((1.0 - beta) / alpha);
+}
+
+int32_t Trainer::sprt_result() const noexcept {
+  return sprt_result_;
+}
+
+int32_t Trainer::sprt_num_games() const noexcept {
+  return sprt_next_;
+}
+
+float Trainer::llr() const noexcept {
+  const int32_t n = sprt_counts_[0] + sprt_counts_[1] + sprt_counts_[2];
+  if (n == 0) {
+    return 0.0;
+  }
+  const double mean = (sprt_counts_[0] + 0.5 * sprt_counts_[1]) / n;
+  const double variance =
+      (sprt_counts_[0] * (1.0 - mean) * (1.0 - mean) +
+       sprt_counts_[1] * (0.5 - mean) * (0.5 - mean) +
+       sprt_counts_[2] * mean * mean) /
+      n;
+  // The ratio is undefined until the games have different results
+  if (variance == 0.0) {
+    return 0.0;
+  }
+  return n * (sprt_score1_ - sprt_score0_) *
+         (2.0 * mean - sprt_score0_ - sprt_score1_) / (2.0 * variance);
+}
+
+void Trainer::set_rollout(TrainMC::Rollout rollout,
+                          int32_t num_playouts) noexcept {
+  rollout_ = rollout;
+  num_playouts_ = num_playouts;
+  for (auto &game : games_) {
+    game.set_rollout(rollout, num_playouts);
+  }
+}
+
+void Trainer::set_virtual_loss(float virtual_loss) noexcept {
+  virtual_loss_ = virtual_loss;
+  for (auto &game : games_) {
+    game.set_virtual_loss(virtual_loss);
+  }
+}
+
+void Trainer::set_autotune(bool autotune) noexcept {
+  assert(!autotune || (cohorts_.size() == 1 && eval_batch_size_ == 0));
+  autotune_ = autotune;
+  if (autotune) {
+    tuner_ = EvalTuner{1, searches_per_eval_};
+  }
+}
+
+bool Trainer::doQueuedIteration(float eval[], float probs[]) {
+  Cohort &cohort = cohorts_[0];
+  // The games started so far have not searched yet
+  if (cohort.searches_done == 0) {
+    for (int32_t i : cohort.active) {
+      batch_requests_.push_back(RequestQueue::Request{i, 0});
+    }
+  }
+  // The games queue their new requests as they finish searching
+  cohort.pool->parallelFor(batch_requests_.size(), [&](int32_t j) {
+    int32_t i = batch_requests_[j].id;
+    if (games_[i].doIteration(eval + offsets_[i],
+                              probs + kNumMoves * offsets_[i])) {
+      is_done_[i] = true;
+    } else {
+      queue_.push(i, games_[i].num_requests());
+    }
+  });
+  ++cohort.searches_done;
+  removeDoneGames(cohort);
+  const int32_t num_started = startGames(cohort);
+  // Assemble the next batch
+  cohort.batch_size = queue_.popBatch(eval_batch_size_, batch_requests_);
+  int32_t offset = 0;
+  for (const auto &request : batch_requests_) {
+    offsets_[request.id] = offset;
+    offset += request.num_rows;
+  }
+  cohort.pool->parallelFor(batch_requests_.size(), [&](int32_t j) {
+    int32_t i = batch_requests_[j].id;
+    games_[i].writeRequests(cohort.to_eval.get() +
+                            offsets_[i] * kGameStateSize);
+  });
+  // New games search without evaluations
+  for (auto it = cohort.active.end() - num_started; it != cohort.active.end();
+       ++it) {
+    batch_requests_.push_back(RequestQueue::Request{*it, 0});
+  }
+  return cohort.active.empty();
+}
+
+void Trainer::run(Evaluator &evaluator) {
+  if (testing_) {
+    run(evaluator, evaluator);
+    return;
+  }
+  // Each cohort's batch has at most searches_per_eval rows per slot
+  const int32_t num_cohorts = cohorts_.size();
+  std::vector<std::vector<float>> eval(num_cohorts);
+  std::vector<std::vector<float>> probs(num_cohorts);
+  for (int32_t c = 0; c < num_cohorts; ++c) {
+    eval[c].resize(cohorts_[c].num_slots * searches_per_eval_);
+    probs[c].resize(cohorts_[c].num_slots * searches_per_eval_ * kNumMoves);
+  }
+  if (num_cohorts == 1) {
+    while (!doIteration(eval[0].data(), probs[0].data())) {
+      evaluator.evaluate(requests(0), batch_size(0), eval[0].data(),
+                         probs[0].data());
+    }
+    return;
+  }
+  // Evaluate each cohort's batch while the next cohort searches
+  for (int32_t c = 0; c < num_cohorts; ++c) {
+    submit(c, eval[c].data(), probs[c].data());
+  }
+  std::vector<bool> done(num_cohorts, false);
+  int32_t num_done = 0;
+  for (int32_t c = 0; num_done < num_cohorts; c = (c + 1) % num_cohorts) {
+    if (done[c]) {
+      continue;
+    }
+    if (complete(c)) {
+      done[c] = true;
+      ++num_done;
+      continue;
+    }
+    evaluator.evaluate(requests(c), batch_size(c), eval[c].data(),
+                       probs[c].data());
+    submit(c, eval[c].data(), probs[c].data());
+  }
+}
+
+void Trainer::run(Evaluator &first, Evaluator &second) {
+  assert(testing_);
+  Evaluator *evaluators[2] = {&first, &second};
+  const int32_t num_rows = cohorts_[0].num_slots * searches_per_eval_;
+  std::vector<float> game_states(num_rows * kGameStateSize);
+  std::vector<float> eval(num_rows);
+  std::vector<float> probs(num_rows * kNumMoves);
+  // A player searches until it has no requests, then the other player does.
+  // The requests of the player are evaluated right before its iteration, so
+  // every iteration receives the evaluations of its own requests.
+  int32_t to_play = 0;
+  while (true) {
+    const int32_t num_requests = this->num_requests(to_play);
+    if (num_requests > 0) {
+      writeRequests(game_states.data(), to_play);
+      evaluators[to_play]->evaluate(game_states.data(), num_requests,
+                                    eval.data(), probs.data());
+    }
+    if (doIteration(eval.data(), probs.data(), to_play)) {
+      return;
+    }
+    if (this->num_requests(to_play) == 0) {
+      to_play = 1 - to_play;
+    }
+  }
+}
+
+void Trainer::submit(int32_t cohort, float eval[], float probs[]) {
+  searchCohort(cohorts_[cohort], eval, probs, false);
+}
+
+bool Trainer::complete(int32_t cohort) {
+  cohorts_[cohort].pool->wait();
+  return finishCohort(cohorts_[cohort]);
+}
+
+void Trainer::searchCohort(Cohort &cohort, float eval[], float probs[],
+                           bool wait) {
+  // Every active game searches. Trainer::finishCohort starts new games
+  // after packing the requests of these.
+  cohort.num_ready = cohort.active.size();
+  auto task = [this, &cohort, eval, probs](int32_t j) {
+    int32_t i = cohort.active[j];
+    // The evaluations are at the rows of the last batch. The new requests
+    // are written straight into this game's rows of the next batch, and
+    // Trainer::finishCohort packs them.
+    games_[i].set_to_eval(cohort.to_eval.get() +
+                          j * rows_per_game_ * kGameStateSize);
+    games_[i].set_searches_per_eval(rows_per_game_);
+    // First search does not depend on pointers being null
+    if (games_[i].doIteration(eval + offsets_[i],
+                              probs + kNumMoves * offsets_[i])) {
+      is_done_[i] = true;
+    }
+    offsets_[i] = j * rows_per_game_;
+  };
+  if (wait) {
+    cohort.pool->parallelFor(cohort.num_ready, task);
+  } else {
+    cohort.pool->start(cohort.num_ready, task);
+  }
+}
+
+bool Trainer::finishCohort(Cohort &cohort) {
+  // Pack the requests so the batch has no unused rows. Each game's requests
+  // move down to the end of the previous game's, which never overwrites rows
+  // that have not moved yet. Most games fill their rows, so little is copied.
+  float *to_eval = cohort.to_eval.get();
+  int32_t offset = 0;
+  for (int32_t j = 0; j < cohort.num_ready; ++j) {
+    const int32_t i = cohort.active[j];
+    const int32_t num_requests = is_done_[i] ? 0 : games_[i].num_requests();
+    if (offset != offsets_[i] && num_requests > 0) {
+      std::copy(to_eval + offsets_[i] * kGameStateSize,
+                to_eval + (offsets_[i] + num_requests) * kGameStateSize,
+                to_eval + offset * kGameStateSize);
+    }
+    offsets_[i] = offset;
+    offset += num_requests;
+  }
+  cohort.batch_size = offset;
+  ++cohort.searches_done;
+  removeDoneGames(cohort);
+  startGames(cohort);
+  return cohort.active.empty();
+}
+
+int32_t Trainer::startGames(Cohort &cohort) {
+  // We offset the start of the games to try to get an even distribution
+  // of the games across the number of searches in a move. This way, the
+  // total number of nodes will be more even. This reduces peak memory
+  // usage. Avoid division by 0 in the rare case that there are fewer
+  // slots than max_searches_
+  // Testing has no offset (there are not enough games for memory usage to
+  // matter).
+  int64_t max_playing = cohort.num_slots;
+  if (!testing_) {
+    const int64_t games_per_search = std::max(
+        static_cast<int64_t>(cohort.num_slots / max_searches_),
+        static_cast<int64_t>(1));
+    max_playing = std::min(max_playing,
+                           games_per_search * (cohort.searches_done + 1));
+  }
+  int32_t num_started = 0;
+  while (static_cast<int64_t>(cohort.active.size()) < max_playing &&
+         static_cast<int32_t>(games_.size()) < num_games_ &&
+         (target_samples_ < 0 || finished_samples_ < target_samples_)) {
+    const int32_t i = games_.size();
+    // Logged games write to their own file
+    std::unique_ptr<std::ofstream> log_file{nullptr};
+    if (i < num_logged_) {
+      log_file = std::make_unique<std::ofstream>(
+          log_folder_ + "/game_" + std::to_string(i) + ".txt",
+          std::ofstream::out);
+    }
+    // Generate parity for test games (changes who plays first). Does not
+    // affect training games
+    games_.emplace_back(generator_(), max_searches_, searches_per_eval_,
+                        c_puct_, epsilon_, std::move(log_file), testing_,
+                        i % 2, stop_futile_);
+    games_.back().set_virtual_loss(virtual_loss_);
+    games_.back().set_rollout(rollout_, num_playouts_);
+    cohort.active.push_back(i);
+    ++num_started;
+  }
+  return num_started;
+}
+
+void Trainer::removeDoneGames(Cohort &cohort) noexcept {
+  auto &active = cohort.active;
+  for (int32_t i : active) {
+    if (is_done_[i]) {
+      finished_samples_ += games_[i].num_samples();
+    }
+  }
+  active.erase(std::remove_if(active.begin(), active.end(),
+                              [this](int32_t i) { return is_done_[i]; }),
+               active.end());
+}
+
+void Trainer::updateSprt(Cohort &cohort) {
+  if (sprt_result_ != 0) {
+    return;
+  }
+  // Count colour pairs in order of game index. Counting games as they
+  // finish would favour short games, which are more often decisive.
+  const int32_t num_started = games_.size();
+  while (sprt_next_ + 1 < num_started && is_done_[sprt_next_] &&
+         is_done_[sprt_next_ + 1]) {
+    for (int32_t i = sprt_next_; i < sprt_next_ + 2; ++i) {
+      // The score of the new model, as in Trainer::score
+      const float score =
+          i % 2 == 0 ? games_[i].score() : 1.0 - games_[i].score();
+      ++sprt_counts_[score == 1.0 ? 0 : score == 0.5 ? 1 : 2];
+    }
+    sprt_next_ += 2;
+  }
+  const double llr = this->llr();
+  if (llr >= sprt_upper_) {
+    sprt_result_ = 1;
+  } else if (llr <= sprt_lower_) {
+    sprt_result_ = -1;
+  } else {
+    return;
+  }
+  // Cancel the games that are still playing and start no more
+  auto &active = cohort.active;
+  for (int32_t i : active) {
     if (!is_done_[i]) {
-      return false;
+      games_[i].cancel();
+    }
+  }
+  // Games after the counted pairs that already finished are left out too,
+  // so the scores are of the games the test counted
+  for (int32_t i = sprt_next_; i < num_started; ++i) {
+    is_done_[i] = false;
+  }
+  active.erase(std::remove_if(active.begin(), active.end(),
+                              [this](int32_t i) { return !is_done_[i]; }),
+               active.end());
+  num_games_ = num_started;
+}
+
+void Trainer::initialize(int32_t num_slots, int32_t num_cohorts) {
+  games_.reserve(num_games_);
+  cohorts_.resize(num_cohorts);
+  for (int32_t c = 0; c < num_cohorts; ++c) {
+    Cohort &cohort = cohorts_[c];
+    cohort.num_slots = (num_slots - c + num_cohorts - 1) / num_cohorts;
+    cohort.active.reserve(cohort.num_slots);
+    // Testing games copy their requests, since only one player's requests
+    // are evaluated at a time
+    if (!testing_) {
+      cohort.to_eval = std::make_unique<float[]>(
+          cohort.num_slots * searches_per_eval_ * kGameStateSize);
     }
+    // With one cohort, the caller runs games too. Otherwise, the caller
+    // evaluates other cohorts while this one searches on its own threads.
+    cohort.pool = std::make_unique<ThreadPool>(
+        num_cohorts == 1 ? num_threads_ : num_threads_ + 1);
   }
-  return true;
-}
-
-void Trainer::initialize(int32_t num_games, const std::string &log_folder,
-                         int32_t max_searches, int32_t searches_per_eval,
-                         float c_puct, float epsilon, int32_t num_logged,
-                         bool testing) {
-  games_.reserve(num_games);
-  for (int32_t i = 0; i < num_logged; ++i) {
-    games_.emplace_back(
-        generator_(), max_searches, searches_per_eval, c_puct, epsilon,
-        std::make_unique<std::ofstream>(log_folder + "/game_" +
-                                            std::to_string(i) + ".txt",
-                                        std::ofstream::out),
-        testing, i % 2);  // Generate parity for test games (changes who plays
-                          // first). Does not affect training games
-  }
-  for (int32_t i = num_logged; i < num_games; ++i) {
-    games_.emplace_back(generator_(), max_searches, searches_per_eval, c_puct,
-                        epsilon, nullptr, testing, i % 2);
+  for (auto &cohort : cohorts_) {
+    startGames(cohort);
   }
 }
\ No newline at end of file
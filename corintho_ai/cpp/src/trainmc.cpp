@@ -5,21 +5,28 @@
 #include <cstdint>
 #include <cstring>
 
+#include <algorithm>
+#include <bitset>
+#include <chrono>
 #include <fstream>
 #include <random>
+#include <string>
 #include <vector>
 
 #include <gsl/gsl>
 
+#include "game.h"
 #include "move.h"
 #include "node.h"
+#include "treefile.h"
 
 TrainMC::TrainMC(std::mt19937 *generator, float *to_eval, int32_t max_searches,
                  int32_t searches_per_eval, float c_puct, float epsilon,
                  bool testing)
     : max_searches_{max_searches}, searches_per_eval_{searches_per_eval},
-      c_puct_{c_puct}, epsilon_{epsilon}, to_eval_{to_eval}, testing_{testing},
-      generator_{generator} {
+      c_puct_{c_puct}, epsilon_{epsilon}, eval_limit_{searches_per_eval},
+      stop_futile_{testing},
+      to_eval_{to_eval}, testing_{testing}, generator_{generator} {
   // We cannot have only 1 search as
   // choosing a move requires having visited at least one child
   assert(max_searches_ > 0);
@@ -84,6 +91,7 @@ void TrainMC::null_root() noexcept {
   delete root_;
   root_ = nullptr;
   cur_ = nullptr;
+  state_ = State::kNoTree;
 }
 
 void TrainMC::writeRequests(float *game_states) const noexcept {
@@ -93,6 +101,26 @@ void TrainMC::writeRequests(float *game_states) const noexcept {
   }
 }
 
+int32_t TrainMC::writeLegalMasks(uint32_t masks[]) const noexcept {
+  int32_t num_priors = 0;
+  for (size_t i = 0; i < searched_.size(); ++i) {
+    uint32_t *mask = masks + i * kMoveMaskWords;
+    std::fill(mask, mask + kMoveMaskWords, 0);
+    for (int32_t j = 0; j < searched_[i]->num_legal_moves(); ++j) {
+      int32_t move_id = searched_[i]->move_id(j);
+      mask[move_id / 32] |= 1u << (move_id % 32);
+    }
+    num_priors += searched_[i]->num_legal_moves();
+  }
+  return num_priors;
+}
+
+void TrainMC::writePackedRequests(PackedGame packed[]) const noexcept {
+  for (size_t i = 0; i < searched_.size(); ++i) {
+    packed[i] = searched_[i]->get_game().pack();
+  }
+}
+
 void TrainMC::getLegalMoves(int32_t legal_moves[kNumMoves]) const noexcept {
   assert(!uninitialized());
   assert(searched_.size() <= searches_per_eval_);
@@ -136,44 +164,183 @@ int32_t TrainMC::chooseMove(float game_state[kGameStateSize],
   return chooseMoveNormal(prob_sample);
 }
 
+int32_t TrainMC::bestMove() const noexcept {
+  assert(!uninitialized());
+  // If there are no children, choose based on probabilities
+  int32_t choice = chooseHighProbMove();
+  int32_t max_visits = 0;
+  float max_eval = 0.0;
+  Node *cur = root_->first_child();
+  while (cur != nullptr) {
+    // Winning moves lead to lost positions
+    if (root_->won()) {
+      if (cur->lost()) {
+        return cur->child_id();
+      }
+    } else if (root_->lost() || !cur->won()) {
+      // Same as chooseMoveNormal and chooseMoveLostDrawn
+      float eval = cur->evaluation();
+      if (cur->result() == kResultDraw || cur->result() == kDeducedDraw) {
+        eval = 0.0;
+      }
+      if (cur->visits() > max_visits ||
+          (cur->visits() == max_visits && eval > max_eval)) {
+        choice = cur->child_id();
+        max_visits = cur->visits();
+        max_eval = eval;
+      }
+    }
+    cur = cur->next_sibling();
+  }
+  return choice;
+}
+
+float TrainMC::value() const noexcept {
+  assert(!uninitialized());
+  // Remove the virtual losses of the pending searches
+  int32_t pending = num_requests();
+  if (pending > 0 && searched_[0] == root_) {
+    return 0.0;
+  }
+  int32_t visits = root_->visits() - pending;
+  if (visits <= 0) {
+    return 0.0;
+  }
+  return (root_->evaluation() - pending * virtual_loss_) /
+         static_cast<float>(visits);
+}
+
+std::vector<int32_t> TrainMC::principalVariation(int32_t max_length) const {
+  assert(!uninitialized());
+  std::vector<int32_t> line;
+  if (max_length <= 0 || root_->terminal()) {
+    return line;
+  }
+  int32_t choice = bestMove();
+  line.push_back(choice);
+  const Node *cur = root_->first_child();
+  while (cur != nullptr && cur->child_id() != choice) {
+    cur = cur->next_sibling();
+  }
+  // Follow the most visited child
+  while (cur != nullptr && static_cast<int32_t>(line.size()) < max_length) {
+    const Node *best = nullptr;
+    for (const Node *child = cur->first_child(); child != nullptr;
+         child = child->next_sibling()) {
+      if (best == nullptr || child->visits() > best->visits()) {
+        best = child;
+      }
+    }
+    if (best == nullptr) {
+      break;
+    }
+    line.push_back(best->child_id());
+    cur = best;
+  }
+  return line;
+}
+
+void TrainMC::set_deadline(
+    std::chrono::steady_clock::time_point deadline) noexcept {
+  has_deadline_ = true;
+  deadline_ = deadline;
+}
+
+void TrainMC::clear_deadline() noexcept {
+  has_deadline_ = false;
+}
+
+void TrainMC::set_stop_futile(bool stop_futile) noexcept {
+  stop_futile_ = stop_futile;
+}
+
+void TrainMC::set_search_budget(int32_t search_budget) noexcept {
+  search_budget_ = search_budget;
+}
+
+void TrainMC::set_to_eval(float *to_eval) noexcept {
+  assert(to_eval != nullptr);
+  to_eval_ = to_eval;
+}
+
+void TrainMC::set_virtual_loss(float virtual_loss) noexcept {
+  assert(virtual_loss >= 0.0);
+  // Pending searches revert the loss they added
+  assert(searched_.size() == 0);
+  virtual_loss_ = virtual_loss;
+}
+
+void TrainMC::set_searches_per_eval(int32_t searches_per_eval) noexcept {
+  assert(searches_per_eval > 0);
+  eval_limit_ = std::min(searches_per_eval, searches_per_eval_);
+}
+
+void TrainMC::set_sparse_priors(bool sparse_priors) noexcept {
+  sparse_priors_ = sparse_priors;
+}
+
+void TrainMC::set_rollout(Rollout rollout, int32_t num_playouts) noexcept {
+  assert(num_playouts > 0);
+  assert(searched_.size() == 0);
+  rollout_ = rollout;
+  num_playouts_ = num_playouts;
+}
+
 bool TrainMC::doIteration(float eval[], float probs[]) {
-  assert(to_eval_ != nullptr);
+  assert(to_eval_ != nullptr || rollout_ != Rollout::kNone);
   assert(searches_done_ <= max_searches_);
-  // This is the first iteration of a game
-  if (uninitialized()) {
-    // Initialize the Monte Carlo search tree
-    root_ = new Node();
-    cur_ = root_;
-    // "Search" the root node
-    searches_done_ = 1;
-    // Request an evaluation
-    // The result is not deduced at this point
-    cur_->writeGameState(to_eval_);
-    searched_.push_back(cur_);
-    assert(searched_.size() <= searches_per_eval_);
-    return false;
+  switch (state_) {
+    // This is the first iteration of a game
+    case State::kNoTree:
+      // Initialize the Monte Carlo search tree
+      createRoot(Game{}, 0);
+      [[fallthrough]];
+    // The root is new, for example when we receive a new root from the
+    // opponent. The result is not deduced at this point.
+    case State::kNewRoot:
+      requestRoot();
+      if (rollout_ == Rollout::kNone) {
+        return false;
+      }
+      receiveRollouts();
+      break;
+    case State::kWaiting:
+      receiveEval(eval, probs);
+      break;
+    // At the start of a turn, there are no evaluations
+    case State::kSearching:
+      break;
   }
-  // This occurs when we receive a new root from the opponent
-  // We should ignore the all_visited and not increment visit count
-  if (searches_done_ == 0 && root_->visits() == 1 && root_->all_visited()) {
-    searches_done_ = 1;
-    // We need an evaluation
-    cur_->writeGameState(to_eval_);
-    searched_.push_back(cur_);
-    assert(searched_.size() <= searches_per_eval_);
-    return false;
+  state_ = State::kSearching;
+  const int32_t search_limit = searchLimit();
+  while (true) {
+    // All evaluations have been received, so the turn can end here
+    if (searchFutile()) {
+      return true;
+    }
+    while (static_cast<int32_t>(searched_.size()) < eval_limit_ &&
+           searches_done_ < search_limit && root_->visits() < kMaxVisits &&
+           !root_->known() && !root_->all_visited()) {
+      // The root has been evaluated at this point, so we can stop
+      if (pastDeadline()) {
+        discardRequests();
+        return true;
+      }
+      search();
+    }
+    // Playouts evaluate the requests here, and the search goes on
+    if (rollout_ == Rollout::kNone || searched_.size() == 0) {
+      break;
+    }
+    receiveRollouts();
   }
-  // At the start of a turn, there are no evaluations
-  if (searched_.size() > 0)
-    receiveEval(eval, probs);
-  while (static_cast<int32_t>(searched_.size()) < searches_per_eval_ &&
-         searches_done_ < max_searches_ && !root_->known() &&
-         !root_->all_visited()) {
-    search();
+  if (searched_.size() > 0) {
+    state_ = State::kWaiting;
   }
   // Add a check for the number of requests
   // We should only choose a move if we have received all evaluations
-  return (searches_done_ == max_searches_ || root_->known()) &&
+  return (searches_done_ >= search_limit || root_->visits() >= kMaxVisits ||
+          root_->known()) &&
          searched_.size() == 0;
 }
 
@@ -195,11 +362,12 @@ bool TrainMC::receiveOpponentMove(int32_t move_choice, const Game &game,
   // Copy opponent game state into our root
   root_ = nullptr;
   createRoot(game, depth);
+  // Playouts evaluate the root in the next iteration
+  if (rollout_ != Rollout::kNone) {
+    return false;
+  }
   // We need an evaluation
-  cur_->writeGameState(to_eval_);
-  searched_.push_back(cur_);
-  assert(searched_.size() <= searches_per_eval_);
-  searches_done_ = 1;
+  requestRoot();
   return true;
 }
 
@@ -207,6 +375,103 @@ void TrainMC::createRoot(const Game &game, int32_t depth) {
   assert(root_ == nullptr);
   root_ = new Node(game, depth);
   cur_ = root_;
+  state_ = State::kNewRoot;
+}
+
+bool TrainMC::receivePosition(const Game &game) {
+  assert(!uninitialized());
+  assert(searched_.size() == 0);
+  if (root_->get_game() == game) {
+    return true;
+  }
+  Node *cur = root_->first_child();
+  while (cur != nullptr) {
+    if (cur->get_game() == game) {
+      receiveOpponentMove(cur->child_id(), game, root_->depth() + 1);
+      return true;
+    }
+    cur = cur->next_sibling();
+  }
+  // After our move and the opponent's reply, the position is a grandchild
+  for (cur = root_->first_child(); cur != nullptr; cur = cur->next_sibling()) {
+    for (Node *reply = cur->first_child(); reply != nullptr;
+         reply = reply->next_sibling()) {
+      if (reply->get_game() == game) {
+        const int32_t reply_id = reply->child_id();
+        const int32_t depth = root_->depth() + 2;
+        receiveOpponentMove(cur->child_id(), cur->get_game(), depth - 1);
+        receiveOpponentMove(reply_id, game, depth);
+        return true;
+      }
+    }
+  }
+  // Unsearched or unrelated position. The root will be evaluated on the next
+  // iteration.
+  delete root_;
+  root_ = nullptr;
+  createRoot(game, 0);
+  searches_done_ = 0;
+  return false;
+}
+
+void TrainMC::discardRequests() noexcept {
+  for (Node *leaf : searched_) {
+    // The root is only ever requested on its own.
+    // The next iteration requests it again.
+    if (leaf == root_) {
+      searches_done_ = 0;
+      state_ = State::kNewRoot;
+      continue;
+    }
+    --searches_done_;
+    Node *parent = leaf->parent();
+    // Undo the visit and virtual loss along the path
+    for (Node *cur = parent; cur != nullptr; cur = cur->parent()) {
+      cur->decrement_visits();
+      cur->decrease_evaluation(virtual_loss_);
+      cur->set_all_visited(false);
+    }
+    // Remove the leaf from its parent's children
+    if (parent->first_child() == leaf) {
+      parent->set_first_child(leaf->next_sibling());
+    } else {
+      Node *prev = parent->first_child();
+      while (prev->next_sibling() != leaf) {
+        prev = prev->next_sibling();
+      }
+      prev->set_next_sibling(leaf->next_sibling());
+    }
+    // So that the siblings are not deleted with the leaf
+    leaf->null_next_sibling();
+    delete leaf;
+  }
+  searched_.clear();
+  cur_ = root_;
+  if (state_ == State::kWaiting) {
+    state_ = State::kSearching;
+  }
+}
+
+bool TrainMC::saveTree(const std::string &filename) const {
+  assert(!uninitialized());
+  // Pending requests have default evaluations which are not meaningful
+  assert(searched_.size() == 0);
+  return ::saveTree(root_, filename);
+}
+
+bool TrainMC::loadTree(const std::string &filename) {
+  assert(searched_.size() == 0);
+  TreeFile tree_file{filename};
+  if (!tree_file.is_open()) {
+    return false;
+  }
+  delete root_;
+  root_ = tree_file.restore();
+  cur_ = root_;
+  searches_done_ = 0;
+  // Saved trees are evaluated
+  state_ = State::kSearching;
+  return true;
 }
 
 void TrainMC::getFilteredProbs(float probs[kNumMoves],
@@ -233,6 +498,18 @@ void TrainMC::getFilteredProbs(float probs[kNumMoves],
   }
 }
 
+void TrainMC::getSparseProbs(const float priors[],
+                             float filtered_probs[]) const noexcept {
+  float sum = 0.0;
+  for (int32_t j = 0; j < cur_->num_legal_moves(); ++j) {
+    sum += priors[j];
+  }
+  float scalar = 1.0 / sum * (1 - epsilon_);
+  for (int32_t j = 0; j < cur_->num_legal_moves(); ++j) {
+    filtered_probs[j] = priors[j] * scalar;
+  }
+}
+
 void TrainMC::generateDirichlet(float dirichlet[]) const noexcept {
   float sum = 0.0;
   for (int32_t i = 0; i < cur_->num_legal_moves(); ++i) {
@@ -266,13 +543,34 @@ void TrainMC::setProbs(float filtered_probs[], float dirichlet[]) noexcept {
   cur_->set_denominator(1.0 / static_cast<float>(final_sum));
 }
 
+void TrainMC::requestRoot() noexcept {
+  assert(searched_.size() == 0);
+  // "Search" the root node
+  searches_done_ = 1;
+  cur_ = root_;
+  // receiveEval reverts this like for any other leaf
+  cur_->set_evaluation(virtual_loss_);
+  if (rollout_ == Rollout::kNone) {
+    cur_->writeGameState(to_eval_);
+  }
+  searched_.push_back(cur_);
+  state_ = State::kWaiting;
+}
+
 void TrainMC::receiveEval(float eval[], float probs[]) noexcept {
   assert(eval != nullptr);
   assert(probs != nullptr);
+  // Start of the priors of the current position when they are sparse
+  int32_t prior_offset = 0;
   for (size_t i = 0; i < searched_.size(); ++i) {
     cur_ = searched_[i];
     float filtered_probs[cur_->num_legal_moves()];
-    getFilteredProbs(probs + kNumMoves * i, filtered_probs);
+    if (sparse_priors_) {
+      getSparseProbs(probs + prior_offset, filtered_probs);
+      prior_offset += cur_->num_legal_moves();
+    } else {
+      getFilteredProbs(probs + kNumMoves * i, filtered_probs);
+    }
     // Generate Dirichlet noise
     float dirichlet[cur_->num_legal_moves()];
     generateDirichlet(dirichlet);
@@ -281,20 +579,74 @@ void TrainMC::receiveEval(float eval[], float probs[]) noexcept {
     // Propagate the evaluation up the tree
     float cur_eval = eval[i];
     while (cur_->parent() != nullptr) {
-      // Correct default +1 evaluation
-      cur_->increase_evaluation(cur_eval - 1.0);
+      // Revert the virtual loss
+      cur_->increase_evaluation(cur_eval - virtual_loss_);
       // Reset this marker
       cur_->set_all_visited(false);
       cur_eval *= -1.0;
       cur_ = cur_->parent();
     }
     // Propagate to the root
-    cur_->increase_evaluation(cur_eval - 1.0);
+    cur_->increase_evaluation(cur_eval - virtual_loss_);
   }
   root_->set_all_visited(false);
   searched_.clear();
 }
 
+void TrainMC::receiveRollouts() noexcept {
+  float eval[searched_.size()];
+  for (size_t i = 0; i < searched_.size(); ++i) {
+    float total = 0.0;
+    for (int32_t j = 0; j < num_playouts_; ++j) {
+      total += playout(searched_[i]->get_game());
+    }
+    eval[i] = total / num_playouts_;
+  }
+  // Uniform priors, in either layout. The sparse layout needs fewer.
+  std::vector<float> probs(searched_.size() * kNumMoves, 1.0);
+  receiveEval(eval, probs.data());
+}
+
+float TrainMC::playout(const Game &game) const noexcept {
+  Game cur = game;
+  std::bitset<kNumMoves> legal_moves;
+  // The result for the player to move in the starting position
+  float sign = 1.0;
+  for (int32_t i = 0; i < kMaxPlayoutMoves; ++i) {
+    bool is_lines = cur.getLegalMoves(legal_moves);
+    // The player to move has lost if there are lines, as in Node
+    if (legal_moves.none()) {
+      return is_lines ? -sign : 0.0;
+    }
+    int32_t choice = -1;
+    if (rollout_ == Rollout::kHeuristic) {
+      std::bitset<kNumMoves> next_moves;
+      for (int32_t j = 0; j < kNumMoves && choice == -1; ++j) {
+        if (!legal_moves[j]) {
+          continue;
+        }
+        Game next = cur;
+        next.doMove(j);
+        if (next.getLegalMoves(next_moves) && next_moves.none()) {
+          choice = j;
+        }
+      }
+    }
+    if (choice == -1) {
+      std::uniform_int_distribution<int32_t> dist(0, legal_moves.count() - 1);
+      int32_t k = dist(*generator_);
+      for (choice = 0; !legal_moves[choice] || k > 0; ++choice) {
+        if (legal_moves[choice]) {
+          --k;
+        }
+      }
+    }
+    cur.doMove(choice);
+    sign = -sign;
+  }
+  return 0.0;
+}
+
 int32_t TrainMC::chooseHighProbMove() const noexcept {
   int32_t max_prob = 0;
   int32_t choice = 0;
@@ -401,6 +753,7 @@ int32_t TrainMC::chooseMoveOpening(float prob_sample[kNumMoves]) noexcept {
     root_ = new_root;
     cur_ = root_;
     searches_done_ = 0;
+    state_ = State::kNewRoot;
     return choice;
   }
   // Choose a random move weighted by the number of visits
@@ -465,6 +818,7 @@ int32_t TrainMC::chooseMoveNormal(float prob_sample[kNumMoves]) noexcept {
     root_ = new_root;
     cur_ = root_;
     searches_done_ = 0;
+    state_ = State::kNewRoot;
     return choice;
   }
 
@@ -491,6 +845,7 @@ void TrainMC::moveDown(Node *prev) noexcept {
   root_ = new_root;
   cur_ = root_;
   searches_done_ = 0;
+  state_ = State::kSearching;
   assert(searched_.size() == 0);
 }
 
@@ -599,6 +954,47 @@ TrainMC::ChooseNextOutput TrainMC::chooseNext() noexcept {
   return ChooseNextOutput{ChooseNextOutput::Type::kVisited, choice, best_prev};
 }
 
+int32_t TrainMC::searchLimit() const noexcept {
+  if (search_budget_ >= 0 && search_budget_ < max_searches_) {
+    return search_budget_;
+  }
+  return max_searches_;
+}
+
+bool TrainMC::pastDeadline() const noexcept {
+  return has_deadline_ && std::chrono::steady_clock::now() >= deadline_;
+}
+
+bool TrainMC::searchFutile() const noexcept {
+  // In the training opening, the move is sampled from all the visit counts
+  if (!stop_futile_ || root_->known() ||
+      (!testing_ && root_->depth() < kNumOpeningMoves)) {
+    return false;
+  }
+  int32_t remaining = std::min(searchLimit() - searches_done_,
+                               kMaxVisits - root_->visits());
+  // Visit counts of the two most visited moves that chooseMoveNormal and
+  // chooseMoveLostDrawn could choose
+  int32_t first = 0;
+  int32_t second = 0;
+  for (Node *cur = root_->first_child(); cur != nullptr;
+       cur = cur->next_sibling()) {
+    if (cur->won()) {
+      continue;
+    }
+    if (cur->visits() > first) {
+      second = first;
+      first = cur->visits();
+    } else if (cur->visits() > second) {
+      second = cur->visits();
+    }
+  }
+  // Ties are broken by evaluation, so the lead must be strict.
+  // Deducing that the most visited move loses could still change the choice,
+  // which we accept.
+  return first > second + remaining;
+}
+
 void TrainMC::search() {
   // I feel that this should be the case anyways
   // but it is sometimes not, so we set it here.
@@ -609,35 +1005,46 @@ void TrainMC::search() {
     // Choose the next node to move down to
     ChooseNextOutput res = chooseNext();
     cur_->increment_visits();
-    // We use a default evaluation of 1.0 before we have a neural net
-    // evaluation This helps diversify the searches. In particular, the second
-    // player has a large advantage in Corintho, so most positions the first
-    // player plays has only losing moves. In such a position, a move getting
-    // a 0.0 evaluation search will improve its evaluation and will very
-    // likely be searched again before neural net evaluations are received.
-    // This drastically decreases the effective number of searches. Most
-    // pessimistically, with 1600 searches and 16 searches per evaluation, we
-    // effectively get 100 searches. Change the default value from 0.0 to 1.0
-    // empirically drastically improved improvement rate. Note that every node
-    // visited gets this default, as opposed to a leaf node getting it and
-    // having it propagate the normal way. This ensures that visited nodes are
-    // maximally unlikely to get visited again.
-    cur_->increase_evaluation(1.0);
+    // We add a virtual loss before we have a neural net evaluation. This
+    // helps diversify the searches. In particular, the second player has a
+    // large advantage in Corintho, so most positions the first player plays
+    // has only losing moves. In such a position, a move getting a 0.0
+    // evaluation search will improve its evaluation and will very likely be
+    // searched again before neural net evaluations are received. This
+    // drastically decreases the effective number of searches. Changing the
+    // default value from 0.0 to 1.0 empirically drastically improved
+    // improvement rate. Note that every node visited gets the virtual loss,
+    // as opposed to a leaf node getting it and having it propagate the normal
+    // way. A loss of 1.0 makes visited nodes maximally unlikely to get
+    // visited again, which most pessimistically, with 1600 searches and 16
+    // searches per evaluation, leaves about 100 effective searches. A smaller
+    // loss suits larger batches (see TrainMC::set_virtual_loss).
+    cur_->increase_evaluation(virtual_loss_);
     // If no nodes were searched, this means all nodes are all_visited
     // or won or lost positions
     // This node is then all_visited
     if (res.type == ChooseNextOutput::Type::kNone) {
+      // The search collided with leaves waiting for an evaluation if a child
+      // is all_visited without a known result. Otherwise every move is
+      // decided, which is not a collision.
+      for (Node *child = cur_->first_child(); child != nullptr;
+           child = child->next_sibling()) {
+        if (!child->known()) {
+          ++num_collisions_;
+          break;
+        }
+      }
       cur_->set_all_visited();
       // Since no search was done
-      // We need to undo the visit count and default 1.0 evaluation
+      // We need to undo the visit count and virtual loss
       while (cur_->parent() != nullptr) {
         cur_->decrement_visits();
-        cur_->decrease_evaluation(1.0);
+        cur_->decrease_evaluation(virtual_loss_);
         cur_ = cur_->parent();
       }
       // Remove search from root
       cur_->decrement_visits();
-      cur_->decrease_evaluation(1.0);
+      cur_->decrease_evaluation(virtual_loss_);
       --searches_done_;
       return;
     }
@@ -675,17 +1082,19 @@ void TrainMC::search() {
     cur_->set_evaluation(cur_eval);
     while (cur_->parent() != nullptr) {
       cur_ = cur_->parent();
-      // Correct default +1.0 evaluation
-      cur_->increase_evaluation(cur_eval - 1.0);
+      // Revert the virtual loss
+      cur_->increase_evaluation(cur_eval - virtual_loss_);
       cur_eval *= -1.0;
     }
   }
   // Otherwise, request an evaluation for the new node
   else {
-    // Default +1 evaluation for new node
-    cur_->set_evaluation(1.0);
+    // Virtual loss for the new node
+    cur_->set_evaluation(virtual_loss_);
     // Write game in correct position
-    cur_->writeGameState(to_eval_ + searched_.size() * kGameStateSize);
+    if (rollout_ == Rollout::kNone) {
+      cur_->writeGameState(to_eval_ + searched_.size() * kGameStateSize);
+    }
     // Record the node in searched_
     searched_.push_back(cur_);
     assert(searched_.size() <= searches_per_eval_);
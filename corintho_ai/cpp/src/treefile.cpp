@@ -0,0 +1,269 @@
+#include "treefile.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <gsl/gsl>
+
+#include "game.h"
+#include "node.h"
+#include "util.h"
+
+// The records are read in place, so their layout must not change silently
+static_assert(sizeof(TreeFile::Header) == 32);
+static_assert(sizeof(TreeFile::Record) == 40);
+
+TreeFile::TreeFile(const std::string &filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) {
+    return;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) == -1 ||
+      static_cast<size_t>(file_stat.st_size) < sizeof(Header)) {
+    ::close(fd);
+    return;
+  }
+  size_ = file_stat.st_size;
+  void *data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping stays valid after the file is closed
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    size_ = 0;
+    return;
+  }
+  data_ = static_cast<const char *>(data);
+  header_ = reinterpret_cast<const Header *>(data_);
+  records_ = reinterpret_cast<const Record *>(data_ + sizeof(Header));
+  // Check that the file is a tree written by this version and is complete
+  if (std::memcmp(header_->magic, kMagic, sizeof(kMagic)) != 0 ||
+      header_->version != kVersion || header_->num_nodes == 0 ||
+      size_ < sizeof(Header) + header_->num_nodes * sizeof(Record) +
+                  header_->num_edges * sizeof(uint16_t) ||
+      !valid()) {
+    close();
+  }
+}
+
+TreeFile::TreeFile(TreeFile &&other) noexcept
+    : data_{other.data_}, size_{other.size_}, header_{other.header_},
+      records_{other.records_} {
+  other.data_ = nullptr;
+  other.size_ = 0;
+  other.header_ = nullptr;
+  other.records_ = nullptr;
+}
+
+TreeFile &TreeFile::operator=(TreeFile &&other) noexcept {
+  if (this != &other) {
+    close();
+    data_ = other.data_;
+    size_ = other.size_;
+    header_ = other.header_;
+    records_ = other.records_;
+    other.data_ = nullptr;
+    other.size_ = 0;
+    other.header_ = nullptr;
+    other.records_ = nullptr;
+  }
+  return *this;
+}
+
+TreeFile::~TreeFile() {
+  close();
+}
+
+bool TreeFile::is_open() const noexcept {
+  return data_ != nullptr;
+}
+
+int32_t TreeFile::num_nodes() const noexcept {
+  if (!is_open()) {
+    return 0;
+  }
+  return header_->num_nodes;
+}
+
+const TreeFile::Record &TreeFile::record(int32_t i) const noexcept {
+  assert(is_open());
+  assert(i >= 0 && i < num_nodes());
+  return records_[i];
+}
+
+int32_t TreeFile::move_id(int32_t i, int32_t j) const noexcept {
+  assert(j >= 0 && j < record(i).num_legal_moves);
+  return edges()[record(i).first_edge + j] & 0x7F;
+}
+
+float TreeFile::probability(int32_t i, int32_t j) const noexcept {
+  assert(j >= 0 && j < record(i).num_legal_moves);
+  // The denominator is not stored since it is the inverse of the sum of the
+  // weights (see TrainMC::setProbs)
+  const uint16_t *edges = this->edges() + record(i).first_edge;
+  int32_t sum = 0;
+  for (int32_t k = 0; k < record(i).num_legal_moves; ++k) {
+    sum += edges[k] >> 7;
+  }
+  if (sum == 0) {
+    return 0.0;
+  }
+  return static_cast<float>(edges[j] >> 7) / static_cast<float>(sum);
+}
+
+Node *TreeFile::restore() const {
+  assert(is_open());
+  std::vector<Node *> nodes(num_nodes(), nullptr);
+  const Record &root = record(0);
+  nodes[0] = new Node(Game{root.game}, nullptr, root.child_id, root.depth,
+                      edges() + root.first_edge, root.num_legal_moves);
+  // Records are in breadth-first order, so parents are always restored before
+  // their children
+  for (int32_t i = 0; i < num_nodes(); ++i) {
+    const Record &cur = record(i);
+    Node *node = nodes[i];
+    assert(node != nullptr);
+    node->set_evaluation(cur.evaluation);
+    node->set_visits(cur.visits);
+    node->set_result(cur.result);
+    node->set_all_visited((cur.flags & 1) != 0);
+    int32_t sum = 0;
+    for (int32_t j = 0; j < cur.num_legal_moves; ++j) {
+      sum += edges()[cur.first_edge + j] >> 7;
+    }
+    // Unevaluated nodes have no probabilities
+    if (sum > 0) {
+      node->set_denominator(1.0 / static_cast<float>(sum));
+    }
+    // Build the children back to front so each knows its next sibling
+    Node *next_sibling = nullptr;
+    for (int32_t j = cur.num_children - 1; j >= 0; --j) {
+      int32_t child_index = cur.first_child + j;
+      const Record &child = record(child_index);
+      nodes[child_index] =
+          new Node(Game{child.game}, node, child.child_id, child.depth,
+                   edges() + child.first_edge, child.num_legal_moves);
+      nodes[child_index]->set_next_sibling(next_sibling);
+      next_sibling = nodes[child_index];
+    }
+    node->set_first_child(next_sibling);
+  }
+  return nodes[0];
+}
+
+void TreeFile::close() noexcept {
+  if (data_ != nullptr) {
+    munmap(const_cast<char *>(data_), size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+  header_ = nullptr;
+  records_ = nullptr;
+}
+
+bool TreeFile::valid() const noexcept {
+  const int64_t num_nodes = header_->num_nodes;
+  const int64_t num_edges = header_->num_edges;
+  // The first record that is not yet the child of an earlier record
+  int64_t next_child = 1;
+  for (int64_t i = 0; i < num_nodes; ++i) {
+    const Record &cur = records_[i];
+    // Every record but the root is a child of an earlier record
+    if (i > 0 && i >= next_child) {
+      return false;
+    }
+    if (cur.game.to_play != 0 && cur.game.to_play != 1) {
+      return false;
+    }
+    for (int8_t pieces : cur.game.pieces) {
+      if (pieces < 0 || pieces > 4) {
+        return false;
+      }
+    }
+    if (cur.result < kResultNone || cur.result > kDeducedWin ||
+        cur.child_id < 0 || cur.child_id >= kNumMoves) {
+      return false;
+    }
+    if (cur.num_legal_moves < 0 || cur.num_legal_moves > kNumMoves ||
+        cur.first_edge + static_cast<int64_t>(cur.num_legal_moves) >
+            num_edges) {
+      return false;
+    }
+    for (int32_t j = 0; j < cur.num_legal_moves; ++j) {
+      if ((edges()[cur.first_edge + j] & 0x7F) >= kNumMoves) {
+        return false;
+      }
+    }
+    if (cur.num_children < 0 || cur.num_children > cur.num_legal_moves) {
+      return false;
+    }
+    if (cur.num_children > 0) {
+      if (cur.first_child != next_child ||
+          next_child + cur.num_children > num_nodes) {
+        return false;
+      }
+      next_child += cur.num_children;
+    }
+  }
+  return next_child == num_nodes;
+}
+
+const uint16_t *TreeFile::edges() const noexcept {
+  return reinterpret_cast<const uint16_t *>(
+      data_ + sizeof(Header) + header_->num_nodes * sizeof(Record));
+}
+
+bool saveTree(const Node *root, const std::string &filename) {
+  assert(root != nullptr);
+  // Breadth-first order. Children are pushed together, so they are
+  // contiguous.
+  std::vector<const Node *> order{root};
+  std::vector<TreeFile::Record> records;
+  std::vector<uint16_t> edges;
+  for (size_t i = 0; i < order.size(); ++i) {
+    const Node *node = order[i];
+    TreeFile::Record record{};
+    record.game = node->get_game().pack();
+    record.evaluation = node->evaluation();
+    record.first_edge = gsl::narrow_cast<uint32_t>(edges.size());
+    record.visits = gsl::narrow_cast<int16_t>(node->visits());
+    record.child_id = gsl::narrow_cast<int8_t>(node->child_id());
+    record.depth = gsl::narrow_cast<int8_t>(node->depth());
+    record.result = node->result();
+    record.num_legal_moves = gsl::narrow_cast<int8_t>(node->num_legal_moves());
+    record.flags = node->all_visited() ? 1 : 0;
+    for (int32_t j = 0; j < node->num_legal_moves(); ++j) {
+      edges.push_back(node->packed_edge(j));
+    }
+    if (node->first_child() != nullptr) {
+      record.first_child = gsl::narrow_cast<uint32_t>(order.size());
+    }
+    for (Node *child = node->first_child(); child != nullptr;
+         child = child->next_sibling()) {
+      order.push_back(child);
+      ++record.num_children;
+    }
+    records.push_back(record);
+  }
+  TreeFile::Header header{};
+  std::memcpy(header.magic, TreeFile::kMagic, sizeof(TreeFile::kMagic));
+  header.version = TreeFile::kVersion;
+  header.num_nodes = gsl::narrow_cast<uint32_t>(records.size());
+  header.num_edges = gsl::narrow_cast<uint32_t>(edges.size());
+  std::ofstream file{filename, std::ofstream::out | std::ofstream::binary};
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char *>(records.data()),
+             records.size() * sizeof(TreeFile::Record));
+  file.write(reinterpret_cast<const char *>(edges.data()),
+             edges.size() * sizeof(uint16_t));
+  return file.good();
+}
@@ -0,0 +1,62 @@
+// Command line engine for Corintho analysis
+// Reads commands from standard input and writes replies to standard output.
+// See Engine for the protocol.
+//
+// Usage: corintho_engine [--searches-per-eval N] [--seed N] [--weights FILE]
+//
+// FILE is a network exported by python/export_weights.py. Without it, the
+// engine searches with MockEvaluator.
+
+#include <cstdint>
+#include <cstdlib>
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "engine.h"
+#include "evaluator.h"
+#include "nativeevaluator.h"
+
+int main(int argc, char *argv[]) {
+  int32_t searches_per_eval = 16;
+  int32_t seed = 0;
+  std::string weights;
+  for (int32_t i = 1; i + 1 < argc; i += 2) {
+    std::string flag{argv[i]};
+    if (flag == "--searches-per-eval") {
+      searches_per_eval = std::atoi(argv[i + 1]);
+    } else if (flag == "--seed") {
+      seed = std::atoi(argv[i + 1]);
+    } else if (flag == "--weights") {
+      weights = argv[i + 1];
+    } else {
+      std::cerr << "Unknown flag " << flag << std::endl;
+      return 1;
+    }
+  }
+  if (searches_per_eval <= 0) {
+    std::cerr << "searches per eval must be positive" << std::endl;
+    return 1;
+  }
+  std::unique_ptr<Evaluator> evaluator;
+  if (weights.empty()) {
+    evaluator = std::make_unique<MockEvaluator>(static_cast<uint32_t>(seed));
+  } else {
+    auto native = std::make_unique<NativeEvaluator>(weights);
+    if (!native->is_open()) {
+      std::cerr << "Could not load " << weights << std::endl;
+      return 1;
+    }
+    evaluator = std::move(native);
+  }
+  Engine engine{evaluator.get(), std::cout, searches_per_eval, seed};
+  std::string line;
+  while (std::getline(std::cin, line)) {
+    if (!engine.handleCommand(line)) {
+      break;
+    }
+  }
+  return 0;
+}
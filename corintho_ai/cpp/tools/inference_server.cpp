@@ -0,0 +1,96 @@
+// Inference server for self-play workers in other processes
+// Creates a shared memory segment with one channel per worker and evaluates
+// the requests of all workers in shared batches, with an exported network or
+// with MockEvaluator if none is given. Start the workers with
+// selfplay --connect NAME --worker I. A worker that dies can be started again
+// with the same index. The server exits once every worker has finished.
+//
+// Usage: inference_server [--name NAME] [--workers N] [--weights FILE]
+//                         [--slots N] [--max-rows N] [--batch-size N]
+
+#include <cstdint>
+#include <cstdlib>
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "evaluator.h"
+#include "nativeevaluator.h"
+#include "shmtransport.h"
+
+int main(int argc, char *argv[]) {
+  std::string name = "/corintho";
+  std::string weights;
+  int32_t num_workers = 1;
+  int32_t num_slots = 4;
+  int32_t max_rows = 256;
+  int32_t batch_size = 1024;
+  for (int32_t i = 1; i + 1 < argc; i += 2) {
+    std::string flag{argv[i]};
+    if (flag == "--name") {
+      name = argv[i + 1];
+    } else if (flag == "--workers") {
+      num_workers = std::atoi(argv[i + 1]);
+    } else if (flag == "--weights") {
+      weights = argv[i + 1];
+    } else if (flag == "--slots") {
+      num_slots = std::atoi(argv[i + 1]);
+    } else if (flag == "--max-rows") {
+      max_rows = std::atoi(argv[i + 1]);
+    } else if (flag == "--batch-size") {
+      batch_size = std::atoi(argv[i + 1]);
+    } else {
+      std::cerr << "Unknown flag " << flag << std::endl;
+      return 1;
+    }
+  }
+  if (num_workers <= 0 || num_slots <= 0 || max_rows <= 0 ||
+      batch_size < max_rows) {
+    std::cerr << "workers, slots and rows must be positive, with the batch "
+                 "size at least the rows of a request"
+              << std::endl;
+    return 1;
+  }
+
+  std::unique_ptr<Evaluator> evaluator;
+  if (weights.empty()) {
+    evaluator = std::make_unique<MockEvaluator>();
+  } else {
+    auto native = std::make_unique<NativeEvaluator>(weights);
+    if (!native->is_open()) {
+      std::cerr << "Could not load " << weights << std::endl;
+      return 1;
+    }
+    evaluator = std::move(native);
+  }
+  ShmServer server{name, num_workers, num_slots, max_rows};
+  if (!server.is_open()) {
+    std::cerr << "Could not create " << name << std::endl;
+    return 1;
+  }
+
+  int64_t num_rows = 0;
+  int64_t num_batches = 0;
+  const auto start = std::chrono::steady_clock::now();
+  while (!server.all_done()) {
+    const int32_t num_served = server.serve(*evaluator, batch_size);
+    if (num_served == 0) {
+      std::this_thread::yield();
+      continue;
+    }
+    num_rows += num_served;
+    ++num_batches;
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cout << "Positions: " << num_rows << "\nBatches: " << num_batches
+            << "\nAverage batch: "
+            << (num_batches > 0 ? static_cast<double>(num_rows) / num_batches
+                                : 0.0)
+            << "\nPositions per second: " << num_rows / elapsed.count()
+            << std::endl;
+  return 0;
+}
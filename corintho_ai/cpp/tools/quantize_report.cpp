@@ -0,0 +1,208 @@
+// Accuracy report for the quantized network
+// Plays self-play games with the float network to get sample positions, and
+// calibrates a QuantizedEvaluator with half of them. On the other half, it
+// reports the mean squared error of the value and the KL divergence of the
+// policy from the float network, and the evaluation speed of both. Finally it
+// plays a tourney between the two networks and reports the rating difference.
+//
+// Usage: quantize_report --weights FILE [--games N] [--matches N]
+//                        [--searches N] [--searches-per-eval N] [--seed N]
+//                        [--threads N]
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "evaluator.h"
+#include "nativeevaluator.h"
+#include "quantizedevaluator.h"
+#include "tourney.h"
+#include "trainer.h"
+#include "util.h"
+
+namespace {
+
+/// @brief Play self-play games and return one position per training sample
+std::vector<float> samplePositions(Evaluator &evaluator, int32_t num_games,
+                                   int32_t max_searches,
+                                   int32_t searches_per_eval, int32_t seed,
+                                   int32_t num_threads) {
+  Trainer trainer{num_games, "",   seed, max_searches, searches_per_eval,
+                  1.0,       0.25, 0,    num_threads};
+  std::vector<float> eval(num_games * searches_per_eval);
+  std::vector<float> probs(num_games * searches_per_eval * kNumMoves);
+  while (!trainer.doIteration(eval.data(), probs.data())) {
+    evaluator.evaluate(trainer.requests(), trainer.num_requests(),
+                       eval.data(), probs.data());
+  }
+  const int32_t num_samples = trainer.num_samples();
+  std::vector<float> game_states(num_samples * kNumSymmetries *
+                                 kGameStateSize);
+  std::vector<float> eval_samples(num_samples * kNumSymmetries);
+  std::vector<float> prob_samples(num_samples * kNumSymmetries * kNumMoves);
+  trainer.writeSamples(game_states.data(), eval_samples.data(),
+                       prob_samples.data());
+  // Keep the first symmetry of each sample
+  std::vector<float> positions(num_samples * kGameStateSize);
+  for (int32_t i = 0; i < num_samples; ++i) {
+    std::copy_n(game_states.begin() + i * kNumSymmetries * kGameStateSize,
+                kGameStateSize, positions.begin() + i * kGameStateSize);
+  }
+  return positions;
+}
+
+/// @brief Return the positions evaluated per second
+double evalRate(Evaluator &evaluator, const std::vector<float> &positions) {
+  const int32_t num_positions = positions.size() / kGameStateSize;
+  const int32_t batch_size = std::min(num_positions, 256);
+  std::vector<float> eval(batch_size);
+  std::vector<float> probs(batch_size * kNumMoves);
+  int64_t num_evaluated = 0;
+  const auto start = std::chrono::steady_clock::now();
+  std::chrono::duration<double> elapsed{0.0};
+  while (elapsed.count() < 1.0) {
+    for (int32_t i = 0; i + batch_size <= num_positions; i += batch_size) {
+      evaluator.evaluate(positions.data() + i * kGameStateSize, batch_size,
+                         eval.data(), probs.data());
+      num_evaluated += batch_size;
+    }
+    elapsed = std::chrono::steady_clock::now() - start;
+  }
+  return num_evaluated / elapsed.count();
+}
+
+/// @brief Play matches between two evaluators, alternating the first player
+/// @return The average score of the second evaluator
+float playMatches(Evaluator &first, Evaluator &second, int32_t num_matches,
+                  int32_t max_searches, int32_t searches_per_eval,
+                  int32_t num_threads) {
+  Tourney tourney{num_threads, ""};
+  tourney.addPlayer(0, 0, max_searches, searches_per_eval);
+  tourney.addPlayer(1, 1, max_searches, searches_per_eval);
+  for (int32_t i = 0; i < num_matches; ++i) {
+    tourney.addMatch(i % 2, 1 - i % 2);
+  }
+  Evaluator *evaluators[2] = {&first, &second};
+  std::vector<float> game_states(num_matches * searches_per_eval *
+                                 kGameStateSize);
+  std::vector<float> eval(num_matches * searches_per_eval);
+  std::vector<float> probs(num_matches * searches_per_eval * kNumMoves);
+  while (!tourney.all_done()) {
+    // Evaluate the region of each model, then advance every match
+    tourney.writeRequests(game_states.data());
+    for (int32_t id : tourney.model_ids()) {
+      const int32_t offset = tourney.offset(id);
+      evaluators[id]->evaluate(game_states.data() + offset * kGameStateSize,
+                               tourney.num_requests(id), eval.data() + offset,
+                               probs.data() + offset * kNumMoves);
+    }
+    tourney.doIteration(eval.data(), probs.data());
+  }
+  return tourney.score(1);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  std::string weights;
+  int32_t num_games = 64;
+  int32_t num_matches = 100;
+  int32_t max_searches = 200;
+  int32_t searches_per_eval = 16;
+  int32_t seed = 0;
+  int32_t num_threads = 1;
+  for (int32_t i = 1; i + 1 < argc; i += 2) {
+    std::string flag{argv[i]};
+    if (flag == "--weights") {
+      weights = argv[i + 1];
+    } else if (flag == "--games") {
+      num_games = std::atoi(argv[i + 1]);
+    } else if (flag == "--matches") {
+      num_matches = std::atoi(argv[i + 1]);
+    } else if (flag == "--searches") {
+      max_searches = std::atoi(argv[i + 1]);
+    } else if (flag == "--searches-per-eval") {
+      searches_per_eval = std::atoi(argv[i + 1]);
+    } else if (flag == "--seed") {
+      seed = std::atoi(argv[i + 1]);
+    } else if (flag == "--threads") {
+      num_threads = std::atoi(argv[i + 1]);
+    } else {
+      std::cerr << "Unknown flag " << flag << std::endl;
+      return 1;
+    }
+  }
+  if (num_games <= 0 || num_matches <= 0 || max_searches <= 0 ||
+      searches_per_eval <= 0 || searches_per_eval > max_searches ||
+      num_threads <= 0) {
+    std::cerr << "games, matches, searches and threads must be positive, "
+                 "with searches per eval at most searches"
+              << std::endl;
+    return 1;
+  }
+  std::vector<DenseLayer> layers;
+  if (!loadNetwork(weights, layers)) {
+    std::cerr << "Could not load " << weights << std::endl;
+    return 1;
+  }
+  NativeEvaluator native{weights};
+
+  std::vector<float> positions = samplePositions(
+      native, num_games, max_searches, searches_per_eval, seed, num_threads);
+  const int32_t num_positions = positions.size() / kGameStateSize;
+  const int32_t num_calibration = num_positions / 2;
+  const int32_t num_test = num_positions - num_calibration;
+  if (num_calibration == 0) {
+    std::cerr << "Not enough positions to calibrate" << std::endl;
+    return 1;
+  }
+  QuantizedEvaluator quantized{layers, positions.data(), num_calibration};
+  const std::vector<float> test_positions(
+      positions.begin() + num_calibration * kGameStateSize, positions.end());
+
+  std::vector<float> eval(num_test);
+  std::vector<float> probs(num_test * kNumMoves);
+  std::vector<float> float_eval(num_test);
+  std::vector<float> float_probs(num_test * kNumMoves);
+  quantized.evaluate(test_positions.data(), num_test, eval.data(),
+                     probs.data());
+  native.evaluate(test_positions.data(), num_test, float_eval.data(),
+                  float_probs.data());
+  double value_error = 0.0;
+  double divergence = 0.0;
+  for (int32_t i = 0; i < num_test; ++i) {
+    value_error += (eval[i] - float_eval[i]) * (eval[i] - float_eval[i]);
+    for (int32_t j = 0; j < kNumMoves; ++j) {
+      const double p = float_probs[i * kNumMoves + j];
+      const double q = probs[i * kNumMoves + j];
+      if (p > 0.0) {
+        divergence += p * std::log(p / std::max(q, 1e-30));
+      }
+    }
+  }
+  std::cout << "Calibration positions: " << num_calibration
+            << "\nTest positions: " << num_test
+            << "\nValue MSE: " << value_error / num_test
+            << "\nPolicy KL divergence: " << divergence / num_test
+            << "\nFloat positions per second: "
+            << evalRate(native, test_positions)
+            << "\nQuantized positions per second: "
+            << evalRate(quantized, test_positions) << std::endl;
+
+  const float score = playMatches(native, quantized, num_matches,
+                                  max_searches, searches_per_eval,
+                                  num_threads);
+  // Keep the rating finite if one side won every match
+  const float clamped = std::clamp(score, 0.5f / num_matches,
+                                   1.0f - 0.5f / num_matches);
+  std::cout << "Quantized score: " << score << " in " << num_matches
+            << " matches\nRating change: "
+            << 400.0 * std::log10(clamped / (1.0 - clamped)) << std::endl;
+  return 0;
+}
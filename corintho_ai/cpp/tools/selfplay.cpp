@@ -0,0 +1,217 @@
+// Self-play driver
+// Plays training games to the end in C++ with Trainer::run, evaluating with
+// an exported network, or with MockEvaluator if none is given. Writes the
+// training samples as game_states.npy, evaluation_labels.npy and
+// probability_labels.npy in the output folder, which np.load reads, and
+// reports the throughput.
+//
+// With --connect NAME --worker I, the games are evaluated by an
+// inference_server process through channel I of its shared memory segment
+// instead, so that several workers share one network.
+//
+// With --rollout 1 (random) or 2 (heuristic), leaves are evaluated with
+// playouts and no network is used. See TrainMC::set_rollout.
+//
+// Usage: selfplay [--weights FILE] [--output DIR] [--games N] [--searches N]
+//                 [--searches-per-eval N] [--seed N] [--threads N]
+//                 [--cohorts N] [--slots N] [--batch-size N] [--autotune 0|1]
+//                 [--connect NAME --worker I] [--rollout 0|1|2]
+
+#include <cstdint>
+#include <cstdlib>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "evaluator.h"
+#include "game.h"
+#include "nativeevaluator.h"
+#include "shmtransport.h"
+#include "trainer.h"
+#include "trainmc.h"
+#include "util.h"
+
+namespace {
+
+/// @brief Write a float32 array in the NumPy .npy format
+/// @return Whether the file was written successfully
+bool writeNpy(const std::string &filename, const std::vector<float> &data,
+              const std::vector<int32_t> &shape) {
+  std::string header = "{'descr': '<f4', 'fortran_order': False, 'shape': (";
+  for (int32_t dim : shape) {
+    header += std::to_string(dim) + ", ";
+  }
+  header += "), }";
+  // The magic string, version and header length take 10 bytes, and the
+  // header ends with a newline so that the data is aligned to 64 bytes
+  while ((10 + header.size() + 1) % 64 != 0) {
+    header += ' ';
+  }
+  header += '\n';
+  std::ofstream file{filename, std::ios::binary};
+  const char prefix[8] = {'\x93', 'N', 'U', 'M', 'P', 'Y', 1, 0};
+  const uint16_t header_size = header.size();
+  const char size_bytes[2] = {static_cast<char>(header_size & 0xFF),
+                              static_cast<char>(header_size >> 8)};
+  file.write(prefix, sizeof(prefix));
+  file.write(size_bytes, sizeof(size_bytes));
+  file.write(header.data(), header.size());
+  file.write(reinterpret_cast<const char *>(data.data()),
+             data.size() * sizeof(float));
+  return file.good();
+}
+
+/// @brief Play the games with evaluations from an inference server
+void runWorker(Trainer &trainer, ShmClient &client, int32_t max_requests) {
+  std::vector<PackedGame> packed(max_requests);
+  std::vector<float> eval(max_requests);
+  std::vector<float> probs(max_requests * kNumMoves);
+  while (!trainer.doIteration(eval.data(), probs.data())) {
+    trainer.writePackedRequests(packed.data());
+    client.evaluate(packed.data(), trainer.num_requests(), eval.data(),
+                    probs.data());
+  }
+  client.finish();
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  std::string weights;
+  std::string output;
+  std::string connect;
+  int32_t worker = 0;
+  int32_t num_games = 64;
+  int32_t max_searches = 200;
+  int32_t searches_per_eval = 16;
+  int32_t seed = 0;
+  int32_t num_threads = 1;
+  int32_t num_cohorts = 1;
+  int32_t num_slots = 0;
+  int32_t batch_size = 0;
+  bool autotune = false;
+  int32_t rollout = 0;
+  for (int32_t i = 1; i + 1 < argc; i += 2) {
+    std::string flag{argv[i]};
+    if (flag == "--weights") {
+      weights = argv[i + 1];
+    } else if (flag == "--connect") {
+      connect = argv[i + 1];
+    } else if (flag == "--worker") {
+      worker = std::atoi(argv[i + 1]);
+    } else if (flag == "--output") {
+      output = argv[i + 1];
+    } else if (flag == "--games") {
+      num_games = std::atoi(argv[i + 1]);
+    } else if (flag == "--searches") {
+      max_searches = std::atoi(argv[i + 1]);
+    } else if (flag == "--searches-per-eval") {
+      searches_per_eval = std::atoi(argv[i + 1]);
+    } else if (flag == "--seed") {
+      seed = std::atoi(argv[i + 1]);
+    } else if (flag == "--threads") {
+      num_threads = std::atoi(argv[i + 1]);
+    } else if (flag == "--cohorts") {
+      num_cohorts = std::atoi(argv[i + 1]);
+    } else if (flag == "--slots") {
+      num_slots = std::atoi(argv[i + 1]);
+    } else if (flag == "--batch-size") {
+      batch_size = std::atoi(argv[i + 1]);
+    } else if (flag == "--autotune") {
+      autotune = std::atoi(argv[i + 1]) != 0;
+    } else if (flag == "--rollout") {
+      rollout = std::atoi(argv[i + 1]);
+    } else {
+      std::cerr << "Unknown flag " << flag << std::endl;
+      return 1;
+    }
+  }
+  if (num_games <= 0 || max_searches <= 0 || searches_per_eval <= 0 ||
+      searches_per_eval > max_searches || num_threads <= 0 ||
+      num_cohorts <= 0 || num_slots < 0 || batch_size < 0) {
+    std::cerr << "games, searches, threads and cohorts must be positive, "
+                 "with searches per eval at most searches"
+              << std::endl;
+    return 1;
+  }
+  if (rollout < 0 || rollout > 2) {
+    std::cerr << "rollout must be 0, 1 or 2" << std::endl;
+    return 1;
+  }
+  if (!connect.empty() && (num_cohorts != 1 || batch_size != 0)) {
+    std::cerr << "Workers play one cohort without a batch size" << std::endl;
+    return 1;
+  }
+
+  std::unique_ptr<Evaluator> evaluator;
+  std::unique_ptr<ShmClient> client;
+  if (!connect.empty()) {
+    client = std::make_unique<ShmClient>(connect, worker);
+    if (!client->is_open()) {
+      std::cerr << "Could not attach to channel " << worker << " of "
+                << connect << std::endl;
+      return 1;
+    }
+  } else if (weights.empty()) {
+    evaluator = std::make_unique<MockEvaluator>();
+  } else {
+    auto native = std::make_unique<NativeEvaluator>(weights);
+    if (!native->is_open()) {
+      std::cerr << "Could not load " << weights << std::endl;
+      return 1;
+    }
+    evaluator = std::move(native);
+  }
+
+  Trainer trainer{num_games, "",    seed,        max_searches,
+                  searches_per_eval, 1.0, 0.25, 0,
+                  num_threads,       false, false, num_cohorts,
+                  num_slots};
+  if (batch_size > 0) {
+    trainer.set_batch_size(batch_size);
+  }
+  trainer.set_autotune(autotune);
+  trainer.set_rollout(TrainMC::Rollout(rollout));
+  const auto start = std::chrono::steady_clock::now();
+  if (client) {
+    const int32_t num_playing =
+        num_slots > 0 ? std::min(num_slots, num_games) : num_games;
+    runWorker(trainer, *client, num_playing * searches_per_eval);
+  } else {
+    trainer.run(*evaluator);
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  const int32_t num_samples = trainer.num_samples();
+  const int32_t num_rows = num_samples * kNumSymmetries;
+  std::cout << "Games: " << trainer.num_games()
+            << "\nSamples: " << num_samples
+            << "\nSeconds: " << elapsed.count()
+            << "\nGames per second: " << trainer.num_games() / elapsed.count()
+            << "\nSamples per second: " << num_samples / elapsed.count()
+            << "\nCollisions: " << trainer.num_collisions() << std::endl;
+
+  if (!output.empty()) {
+    std::vector<float> game_states(num_rows * kGameStateSize);
+    std::vector<float> eval_samples(num_rows);
+    std::vector<float> prob_samples(num_rows * kNumMoves);
+    trainer.writeSamples(game_states.data(), eval_samples.data(),
+                         prob_samples.data());
+    if (!writeNpy(output + "/game_states.npy", game_states,
+                  {num_rows, kGameStateSize}) ||
+        !writeNpy(output + "/evaluation_labels.npy", eval_samples,
+                  {num_rows}) ||
+        !writeNpy(output + "/probability_labels.npy", prob_samples,
+                  {num_rows, kNumMoves})) {
+      std::cerr << "Could not write samples to " << output << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -17,6 +17,9 @@ def choose_move_route():
             data["timeLimit"],
             data["searchesPerEval"],
             data["maxNodes"],
+            data.get("gameId"),
+            data.get("ponder", False),
+            data.get("autotune", False),
         )
     )
 
@@ -3,10 +3,15 @@ Module for choosing moves using MCST and a neural network
 for the Corintho web app.
 
 choose_move: Main Cython function called by the Flask API.
+
+Search trees are kept between requests in sessions keyed by game ID,
+so the search done for previous moves is reused. While waiting for the human's
+move, a session can keep searching (pondering).
 """
 
 # distutils: language = c++
 
+import threading
 import time
 
 import numpy as np
@@ -18,6 +23,8 @@ from libcpp cimport bool
 # Load the TFLite model
 model = tflite.Interpreter(model_path="corintho_ai/docker/tflite_model.tflite")
 model.allocate_tensors()
+# The interpreter is shared by requests and pondering threads
+_model_lock = threading.Lock()
 
 cdef extern from "../cpp/src/dockermc.cpp":
     cdef cppclass DockerMC:
@@ -40,11 +47,25 @@ cdef extern from "../cpp/src/dockermc.cpp":
         void getLegalMoves(int *legal_moves) except +
         int chooseMove() except +
         bool doIteration(float *eval, float *probs) except +
+        bool receivePosition(int *board, int to_play, int *pieces) except +
+        void discardRequests() except +
+        int bestMove() except +
+        float value() except +
+        int principalVariation(int *moves, int max_length) except +
+        void setTimeLimit(float seconds) except +
+        void setSearchBudget(int search_budget) except +
+        void setAutotune(bool autotune) except +
 
 # Constants
 cdef int _NUM_MOVES = 96
 cdef int _GAME_STATE_SIZE = 70
 _PIECE_TYPES = ["base", "column", "capital"]
+# Sessions unused for this many seconds are deleted
+_SESSION_TIMEOUT = 600
+_MAX_SESSIONS = 64
+_MAX_PV_LENGTH = 16
+# Maximum time to ponder in seconds
+_PONDER_LIMIT = 60
 
 cdef int extract_game_state(game_state, int[:] board, int[:] pieces):
     """
@@ -88,13 +109,17 @@ cdef dict get_pre_result(DockerMC* mc):
         return {"pre-result": "win"}
     return None
 
-cdef void search(DockerMC* mc, searches_per_eval, time_limit, start_time):
+cdef void search(DockerMC* mc, searches_per_eval, time_limit, stop_event=None):
     """
     Do a search with the MCST.
 
     Continues searching until the time limit is reached or the maximum number of searches is reached.
+    The time limit is enforced by the MCST, so it is overshot by at most one neural network evaluation.
+    Requests that were not evaluated are discarded at the end.
 
     mc: pointer to DockerMC object
+    time_limit: the time limit from now in seconds
+    stop_event: threading.Event that stops the search when set (used for pondering)
     """
     # Get neural network input and output shapes
     input_details = model.get_input_details()
@@ -106,13 +131,11 @@ cdef void search(DockerMC* mc, searches_per_eval, time_limit, start_time):
     cdef np.ndarray[np.float32_t, ndim=1] eval = np.zeros(searches_per_eval, dtype=np.float32)
     cdef np.ndarray[np.float32_t, ndim=2] probs = np.zeros((searches_per_eval, _NUM_MOVES), dtype=np.float32)
 
-    evals_done = 0
-    # We continue searching until the time limit is reached or the maximum number of searches is reached.
-    # We do at least 2 searches
-    while evals_done < 3 or time.time() - start_time < time_limit:
-        evals_done += 1
+    mc.setTimeLimit(time_limit)
+    while stop_event is None or not stop_event.is_set():
         done = mc.doIteration(&eval[0], &probs[0,0])
-        # The MCST has deduced the game outcome or a maximum number of searches is reached
+        # The MCST has deduced the game outcome, the time limit has passed,
+        # or a maximum number of searches is reached
         if done:
             break
         # Get requests for evaluation
@@ -125,12 +148,15 @@ cdef void search(DockerMC* mc, searches_per_eval, time_limit, start_time):
         # This is needed in TFLite models
         input_shape = list(input_details[0]['shape'])
         input_shape[0] = num_requests
-        model.resize_tensor_input(input_details[0]['index'], input_shape)
-        model.allocate_tensors()
-        model.set_tensor(input_details[0]['index'], input_data)
-        model.invoke()
-        eval = model.get_tensor(output_details[1]['index']).flatten()
-        probs = model.get_tensor(output_details[0]['index'])
+        with _model_lock:
+            model.resize_tensor_input(input_details[0]['index'], input_shape)
+            model.allocate_tensors()
+            model.set_tensor(input_details[0]['index'], input_data)
+            model.invoke()
+            eval = model.get_tensor(output_details[1]['index']).flatten()
+            probs = model.get_tensor(output_details[0]['index'])
+    # The tree must not have pending requests when choosing a move
+    mc.discardRequests()
 
 cdef list get_legal_moves(DockerMC* mc):
     """
@@ -150,13 +176,123 @@ cdef list get_legal_moves(DockerMC* mc):
         if legal_moves[i] == 1:
             legal_move_lst.append(i)
     return legal_move_lst
-   
+
+
+cdef list get_principal_variation(DockerMC* mc):
+    """
+    Get the most visited line of play from MCST.
+
+    mc: pointer to DockerMC object
+
+    Returns: list of IDs of moves, starting with the best move
+    """
+    cdef int[:] moves = np.zeros(_MAX_PV_LENGTH, dtype=np.int32)
+    cdef int length = mc.principalVariation(&moves[0], _MAX_PV_LENGTH)
+    return [moves[i] for i in range(length)]
+
+
+cdef class Session:
+    """
+    A search tree kept between requests for one game.
+
+    The tree is rooted at the position after the AI's last move.
+    """
+    cdef DockerMC *mc
+    cdef public int searches_per_eval
+    cdef public int max_searches
+    cdef public double last_used
+    cdef object stop_event
+    cdef object thread
+
+    def __cinit__(self, seed, int max_searches, int searches_per_eval, int[:] board, int to_play, int[:] pieces):
+        self.mc = new DockerMC(
+            seed,
+            max_searches,
+            searches_per_eval,
+            1.0,
+            0.25,
+            &board[0],
+            to_play,
+            &pieces[0],
+        )
+        self.searches_per_eval = searches_per_eval
+        self.max_searches = max_searches
+        self.last_used = time.time()
+        self.stop_event = None
+        self.thread = None
+
+    def __dealloc__(self):
+        if self.mc != NULL:
+            del self.mc
+
+    def receive_position(self, int[:] board, int to_play, int[:] pieces):
+        """
+        Move the tree to the position after the human's move.
+
+        Returns: whether the tree was reused
+        """
+        self.stop_pondering()
+        return self.mc.receivePosition(&board[0], to_play, &pieces[0])
+
+    def _ponder(self):
+        search(self.mc, self.searches_per_eval, _PONDER_LIMIT, self.stop_event)
+
+    def start_pondering(self):
+        """Search the human's replies in a background thread."""
+        self.stop_event = threading.Event()
+        self.thread = threading.Thread(target=self._ponder, daemon=True)
+        self.thread.start()
+
+    def stop_pondering(self):
+        """Stop pondering and wait for the search to finish."""
+        if self.thread is not None:
+            self.stop_event.set()
+            self.thread.join()
+            self.thread = None
+            self.stop_event = None
+
+
+# Sessions by game ID
+_sessions = {}
+_sessions_lock = threading.Lock()
+
+
+def _take_session(game_id):
+    """
+    Remove and return the session for a game, deleting expired sessions.
+
+    Returns: the session or None
+    """
+    now = time.time()
+    with _sessions_lock:
+        session = _sessions.pop(game_id, None)
+        expired = [
+            key for key, value in _sessions.items()
+            if now - value.last_used > _SESSION_TIMEOUT
+        ]
+        for key in expired:
+            _sessions.pop(key).stop_pondering()
+    return session
+
+
+def _store_session(game_id, session):
+    """Store a session, deleting the least recently used if there are too many."""
+    session.last_used = time.time()
+    with _sessions_lock:
+        _sessions[game_id] = session
+        while len(_sessions) > _MAX_SESSIONS:
+            oldest = min(_sessions, key=lambda key: _sessions[key].last_used)
+            _sessions.pop(oldest).stop_pondering()
+
 
 def choose_move(
         game_state,
         time_limit,
         searches_per_eval=1,
         max_searches=0,
+        game_id=None,
+        ponder=False,
+        autotune=False,
     ):
     """
     Use the MCST and neural network algorithm to choose a move.
@@ -165,7 +301,12 @@ def choose_move(
     time_limit: the time limit for the search in seconds
     searches_per_eval: number of searches per neural network evaluation
     max_searches: the maximum number of searches to do (0 for no limit)
-    model: TFLite model
+    game_id: ID of the game, used to reuse the search tree between moves.
+        If None, a new tree is used.
+    ponder: whether to keep searching while the human is thinking.
+        Only used if game_id is given.
+    autotune: whether to adjust the searches per evaluation between 1 and
+        searches_per_eval from the measured search and evaluation times.
     """
     
     start_time = time.time()
@@ -176,29 +317,43 @@ def choose_move(
     cdef int[:] pieces = np.zeros(6, dtype=np.int32)
     to_play = extract_game_state(game_state, board, pieces)
 
-    # Construct a MCST object
     if max_searches == 0:
         max_searches = 32760  # So that visit count fits in a 16-bit signed integer
-    cdef DockerMC *mc = new DockerMC(
-        rng.integers(65536),
-        max_searches,
-        searches_per_eval,
-        1.0,
-        0.25,
-        &board[0],
-        to_play,
-        &pieces[0],
-    )
+
+    # Get the session for this game or construct a new MCST
+    session = None
+    tree_reused = False
+    if game_id is not None:
+        session = _take_session(game_id)
+    if (
+        session is not None
+        and session.searches_per_eval == searches_per_eval
+        and session.max_searches == max_searches
+    ):
+        tree_reused = session.receive_position(board, to_play, pieces)
+    else:
+        if session is not None:
+            session.stop_pondering()
+        session = Session(
+            rng.integers(65536),
+            max_searches,
+            searches_per_eval,
+            board,
+            to_play,
+            pieces,
+        )
+    cdef DockerMC *mc = (<Session>session).mc
+    mc.setAutotune(autotune)
 
     pre_result = get_pre_result(mc)
     if pre_result:
-        del mc
         return pre_result
 
     # Search with the MCST
-    search(mc, searches_per_eval, time_limit, start_time);
-    
+    search(mc, searches_per_eval, time_limit - (time.time() - start_time))
+
     # Choose the best move and get other information
+    principal_variation = get_principal_variation(mc)
     move = mc.chooseMove()
     is_done = mc.done()
     has_won = False
@@ -208,8 +363,13 @@ def choose_move(
     else:
         legal_moves = get_legal_moves(mc)
     nodes_searched = mc.num_nodes()
-    evaluation = mc.eval()
-    del mc
+    evaluation = mc.value()
+
+    # Keep the tree for the human's next move
+    if game_id is not None and not is_done:
+        if ponder:
+            session.start_pondering()
+        _store_session(game_id, session)
 
     return {
         "move": move,
@@ -217,5 +377,7 @@ def choose_move(
         "has_won": has_won,
         "legal_moves": legal_moves,
         "nodes_searched": nodes_searched,
-        "evaluation": evaluation / nodes_searched,
+        "evaluation": evaluation,
+        "principal_variation": principal_variation,
+        "tree_reused": tree_reused,
     }
@@ -16,7 +16,9 @@ setup(
                 "play_corintho",
                 [
                     os.path.join(current_dir, "choose_move.pyx"),
+                    os.path.join(current_dir, "../cpp/src/evaltuner.cpp"),
                     os.path.join(current_dir, "../cpp/src/trainmc.cpp"),
+                    os.path.join(current_dir, "../cpp/src/treefile.cpp"),
                     os.path.join(current_dir, "../cpp/src/node.cpp"),
                     os.path.join(current_dir, "../cpp/src/game.cpp"),
                     os.path.join(current_dir, "../cpp/src/move.cpp"),
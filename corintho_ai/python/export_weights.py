@@ -0,0 +1,87 @@
+import argparse
+import struct
+
+import keras.api._v2.keras as keras
+import numpy as np
+
+_GAME_STATE_SIZE = 70
+_NUM_MOVES = 96
+# Must match kNetworkMagic and kNetworkVersion in nativeevaluator.h
+_MAGIC = b"CNET"
+_VERSION = 1
+
+
+def get_args():
+    """Parse command line arguments"""
+    parser = argparse.ArgumentParser(
+        description="Export a Keras model to the network file read by "
+        "NativeEvaluator."
+    )
+    parser.add_argument(
+        "model",
+        type=str,
+        help="Path to the saved Keras model.",
+    )
+    parser.add_argument(
+        "output",
+        type=str,
+        help="Path of the network file to write.",
+    )
+    return parser.parse_args()
+
+
+def get_layers(model):
+    """Return the dense layers of the model as (kernel, bias) pairs
+
+    Batch normalization is folded into the dense layers that read it. As in
+    the models made by wrapper.py, each dense layer is assumed to read the
+    latest batch normalization, and both heads read the last one.
+    The hidden layers come first, then the value head and the policy head.
+    """
+    layers = []
+    # The latest batch normalization, as a scale and a shift
+    scale = None
+    shift = None
+    for layer in model.layers:
+        if isinstance(layer, keras.layers.BatchNormalization):
+            gamma, beta, mean, variance = layer.get_weights()
+            scale = gamma / np.sqrt(variance + layer.epsilon)
+            shift = beta - scale * mean
+        elif isinstance(layer, keras.layers.Dense):
+            kernel, bias = layer.get_weights()
+            if scale is not None:
+                # (x * scale + shift) @ kernel + bias
+                bias = bias + shift @ kernel
+                kernel = kernel * scale[:, np.newaxis]
+            layers.append((kernel, bias))
+        elif not isinstance(
+            layer, (keras.layers.InputLayer, keras.layers.Activation)
+        ):
+            raise ValueError(f"Unsupported layer {layer.name}")
+    if len(layers) < 2:
+        raise ValueError("The model must have a value and a policy head")
+    # The heads can be in either order
+    heads = sorted(layers[-2:], key=lambda layer: layer[0].shape[1])
+    if heads[0][0].shape[1] != 1 or heads[1][0].shape[1] != _NUM_MOVES:
+        raise ValueError("The model must have a value and a policy head")
+    return layers[:-2] + heads
+
+
+def export(model, output):
+    """Write the layers of the model to a network file"""
+    layers = get_layers(model)
+    if layers[0][0].shape[0] != _GAME_STATE_SIZE:
+        raise ValueError("The model must read the game state")
+    with open(output, "wb") as file:
+        file.write(
+            struct.pack("<4sII5I", _MAGIC, _VERSION, len(layers), *([0] * 5))
+        )
+        for kernel, bias in layers:
+            file.write(struct.pack("<II", *kernel.shape))
+            file.write(np.ascontiguousarray(kernel, dtype="<f4").tobytes())
+            file.write(np.ascontiguousarray(bias, dtype="<f4").tobytes())
+
+
+if __name__ == "__main__":
+    args = get_args()
+    export(keras.models.load_model(args.model), args.output)
@@ -27,15 +27,31 @@ cdef extern from "../cpp/src/trainer.cpp":
             int num_logged,
             int num_threads,
             bool testing,
+            bool stop_futile,
+            int num_cohorts,
+            int num_slots,
         ) except +
         int num_requests(int to_play) except +
+        int batch_size(int cohort) except +
+        int num_games() except +
         int num_samples() except +
+        long long num_collisions() except +
         float score() except +
         float avg_mate_length() except +
         void writeRequests(float *game_states, int to_play) except +
+        float *requests(int cohort) except +
         void writeSamples(float *game_states, float *eval_samples, float *prob_samples) except +
         void writeScores(string file) except +
         bool doIteration(float *evaluations, float *probabilities, int to_play) except +
+        void submit(int cohort, float *evaluations, float *probabilities) except +
+        bool complete(int cohort) except +
+        void set_batch_size(int batch_size) except +
+        void set_target_samples(int num_samples) except +
+        void set_autotune(bool autotune) except +
+        void set_virtual_loss(float virtual_loss) except +
+        void set_sprt(float elo0, float elo1, float alpha, float beta) except +
+        int sprt_result() except +
+        int sprt_num_games() except +
 
 cdef int _NUM_MOVES = 96
 cdef int _GAME_STATE_SIZE = 70
@@ -86,7 +102,7 @@ cdef void log_stats(Trainer *trainer, time_taken, predict_time, play_time, evals
     """
     Log some stats
     """
-    num_games = params["num_games"]
+    num_games = trainer.num_games()
     max_searches = params["max_searches"]
 
     with open(f"{log_folder}/progress.txt", 'a+', encoding='utf-8') as f:
@@ -107,6 +123,7 @@ cdef void log_stats(Trainer *trainer, time_taken, predict_time, play_time, evals
             f"{evals_done} evaluations\n"
             f"{format_time(time_taken / evals_done)} per evaluation\n"
             f"{format_time(play_time)} for self play\n"   
+            f"{trainer.num_collisions()} search collisions\n"
         )
         if not testing:
             num_samples = trainer.num_samples()
@@ -125,14 +142,22 @@ cdef void play_games(Trainer *trainer, log_folder, params, best_model, new_model
     Main playing loop
     This is used in both training and testing
     """
-    num_games = params["num_games"]
+    # The most games that request evaluations at a time. Training staggers the
+    # starts of the games, but test games fill every slot in the constructor.
+    if new_model is None:
+        num_games = params.get("game_slots", 0) or params["num_games"]
+    else:
+        num_games = trainer.num_games()
     searches_per_eval = params["searches_per_eval"]
     max_searches = params["max_searches"]
 
     cdef np.ndarray[np.float32_t, ndim=1] evals = np.zeros(num_games * searches_per_eval, dtype=np.float32)
     cdef np.ndarray[np.float32_t, ndim=2] probs = np.zeros((num_games * searches_per_eval, _NUM_MOVES), dtype=np.float32)
-    cdef np.ndarray[np.float32_t, ndim=2] game_states = np.zeros((num_games * searches_per_eval, _GAME_STATE_SIZE), dtype=np.float32)
+    cdef np.ndarray[np.float32_t, ndim=2] game_states
     to_play = -1 if new_model is None else 0
+    # In training, the games write their requests straight into the Trainer's batch
+    if to_play != -1:
+        game_states = np.zeros((num_games * searches_per_eval, _GAME_STATE_SIZE), dtype=np.float32)
     predict_time = 0.0
     play_time = 0.0
     evals_done = 0
@@ -162,7 +187,10 @@ cdef void play_games(Trainer *trainer, log_folder, params, best_model, new_model
                 print(f"evals done: {evals_done}")
                 raise Exception("No requests during training")
         
-        trainer.writeRequests(&game_states[0,0], to_play)
+        if to_play == -1:
+            game_states = np.asarray(<np.float32_t[:num_requests, :_GAME_STATE_SIZE]> trainer.requests(0))
+        else:
+            trainer.writeRequests(&game_states[0,0], to_play)
         pred_start = time.perf_counter()
         get_predictions(best_model, new_model, game_states, evals, probs, num_requests, to_play)
         predict_time += time.perf_counter() - pred_start
@@ -186,6 +214,60 @@ cdef void play_games(Trainer *trainer, log_folder, params, best_model, new_model
     time_taken = time.perf_counter() - start_time
     log_stats(trainer, time_taken, predict_time, play_time, evals_done, log_folder, params, new_model is not None)
 
+cdef void play_games_pipelined(Trainer *trainer, log_folder, params, best_model):
+    """
+    Training playing loop with 2 cohorts of games
+    One cohort searches while the batch of the other is evaluated
+    """
+    num_slots = params.get("game_slots", 0) or params["num_games"]
+    searches_per_eval = params["searches_per_eval"]
+    max_searches = params["max_searches"]
+    cohort_rows = (num_slots + 1) // 2 * searches_per_eval
+
+    cdef np.ndarray[np.float32_t, ndim=2] evals = np.zeros((2, cohort_rows), dtype=np.float32)
+    cdef np.ndarray[np.float32_t, ndim=3] probs = np.zeros((2, cohort_rows, _NUM_MOVES), dtype=np.float32)
+    predict_time = 0.0
+    play_time = 0.0
+    evals_done = 0
+    start_time = time.perf_counter()
+    last_time = start_time
+
+    for cohort in range(2):
+        trainer.submit(cohort, &evals[cohort, 0], &probs[cohort, 0, 0])
+    done = [False, False]
+    cohort = 0
+    while not (done[0] and done[1]):
+        if not done[cohort]:
+            # Only the time spent waiting for the search is play time
+            play_start = time.perf_counter()
+            done[cohort] = trainer.complete(cohort)
+            play_time += time.perf_counter() - play_start
+            if not done[cohort]:
+                num_requests = trainer.batch_size(cohort)
+                if num_requests == 0:
+                    print(f"evals done: {evals_done}")
+                    raise Exception("No requests during training")
+                game_states = np.asarray(<np.float32_t[:num_requests, :_GAME_STATE_SIZE]> trainer.requests(cohort))
+                pred_start = time.perf_counter()
+                get_predictions(best_model, None, game_states, evals[cohort], probs[cohort], num_requests, -1)
+                predict_time += time.perf_counter() - pred_start
+                evals_done += 1
+                trainer.submit(cohort, &evals[cohort, 0], &probs[cohort, 0, 0])
+        cohort = 1 - cohort
+
+        if time.perf_counter() - last_time > 60:
+            time_taken = time.perf_counter() - start_time
+            with open(f"{log_folder}/progress.txt", 'a+', encoding='utf-8') as f:
+                f.write(
+                    f"{evals_done} evaluations completed in {format_time(time_taken)}\n"
+                    f"Neural network prediction time so far: {format_time(predict_time)}\n"
+                    f"Time waiting for self play so far: {format_time(play_time)}\n\n"
+                )
+            last_time = time.perf_counter()
+
+    time_taken = time.perf_counter() - start_time
+    log_stats(trainer, time_taken, predict_time, play_time, evals_done, log_folder, params)
+
 cdef get_samples(Trainer *trainer, params):
     """
     Get training samples
@@ -307,14 +389,32 @@ def train_generation(params):
         params["num_logged"],
         params["num_threads"],
         False,  # Training
+        params.get("stop_futile", 0) == 1,
+        2 if params.get("pipeline", 0) == 1 else 1,  # Cohorts
+        params.get("game_slots", 0),  # Games playing at a time
     )
+    if params.get("target_samples", 0) > 0:
+        trainer.set_target_samples(params["target_samples"])
+    if params.get("autotune", 0) == 1:
+        trainer.set_autotune(True)
+    trainer.set_virtual_loss(params.get("virtual_loss", 1.0))
+    if params.get("eval_batch_size", 0) > 0:
+        trainer.set_batch_size(params["eval_batch_size"])
     # Self play
-    play_games(
-        trainer,
-        params["train_log_folder"],
-        params,
-        best_model,
-    )
+    if params.get("pipeline", 0) == 1:
+        play_games_pipelined(
+            trainer,
+            params["train_log_folder"],
+            params,
+            best_model,
+        )
+    else:
+        play_games(
+            trainer,
+            params["train_log_folder"],
+            params,
+            best_model,
+        )
     # Get training samples
     game_states, evaluation_labels, probability_labels = get_samples(trainer, params)
 
@@ -337,7 +437,14 @@ def train_generation(params):
         params["num_logged"],
         params["num_threads"],
         True,  # Testing
+        True,  # Stop futile searches
+        1,  # Cohorts
+        params.get("test_slots", 0),  # Games playing at a time
     )
+    tester.set_virtual_loss(params.get("virtual_loss", 1.0))
+    use_sprt = params.get("sprt_elo1", 0.0) > params.get("sprt_elo0", 0.0)
+    if use_sprt:
+        tester.set_sprt(params["sprt_elo0"], params["sprt_elo1"], 0.05, 0.05)
 
     test_log_folder = params["test_log_folder"]
     play_games(
@@ -348,7 +455,14 @@ def train_generation(params):
         new_model,
     )
     score = tester.score()
-    open(f"{test_log_folder}/score.txt", 'w', encoding='utf-8').write(f"New agent score {score:1f}!\n")
+    sprt_result = tester.sprt_result() if use_sprt else 0
+    with open(f"{test_log_folder}/score.txt", 'w', encoding='utf-8') as f:
+        f.write(f"New agent score {score:1f}!\n")
+        if sprt_result != 0:
+            f.write(
+                f"SPRT {'accepted' if sprt_result == 1 else 'rejected'} "
+                f"after {tester.sprt_num_games()} games\n"
+            )
     update_rating(
         params["new_rating_file"],
         params["best_gen_rating"],
@@ -360,6 +474,9 @@ def train_generation(params):
     keras.backend.clear_session()
 
     # Return whether new model improved
+    # A decided test replaces the threshold
+    if sprt_result != 0:
+        return sprt_result == 1
     if score > params["test_threshold"]:
         return True
     return False
@@ -16,8 +16,12 @@ setup(
                 "corintho",
                 [
                     os.path.join(current_dir, "main.pyx"),
+                    os.path.join(current_dir, "../cpp/src/evaltuner.cpp"),
+                    os.path.join(current_dir, "../cpp/src/requestqueue.cpp"),
                     os.path.join(current_dir, "../cpp/src/selfplayer.cpp"),
+                    os.path.join(current_dir, "../cpp/src/threadpool.cpp"),
                     os.path.join(current_dir, "../cpp/src/trainmc.cpp"),
+                    os.path.join(current_dir, "../cpp/src/treefile.cpp"),
                     os.path.join(current_dir, "../cpp/src/node.cpp"),
                     os.path.join(current_dir, "../cpp/src/game.cpp"),
                     os.path.join(current_dir, "../cpp/src/move.cpp"),
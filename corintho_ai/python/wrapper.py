@@ -27,6 +27,14 @@ def get_args():
         default=0.5,
         help="Factor to reduce learning rate upon plateau. Default 0.5.",
     )
+    parser.add_argument(
+        "--autotune",
+        type=int,
+        default=0,
+        help="1 to adjust the self play searches per evaluation between 1 and "
+        "--searches_per_eval from the measured search and evaluation times. "
+        "Cannot be used with --pipeline or --eval_batch_size. Default is 0.",
+    )
     parser.add_argument(
         "--batch_size",
         type=int,
@@ -57,6 +65,22 @@ def get_args():
         default=0.25,
         help="Epsilon for Monte Carlo Search Tree. Default is 0.25",
     )
+    parser.add_argument(
+        "--eval_batch_size",
+        type=int,
+        default=0,
+        help="Number of positions per self play evaluation batch. Games "
+        "queue their requests and each batch takes them in order. Cannot "
+        "be used with --pipeline. Default 0 uses one batch for all games.",
+    )
+    parser.add_argument(
+        "--game_slots",
+        type=int,
+        default=0,
+        help="Number of self play games playing at a time. A new game starts "
+        "when one finishes, until --num_games games are played. "
+        "Default 0 plays all games at once.",
+    )
     parser.add_argument(
         "--learning_rate",
         type=float,
@@ -115,6 +139,13 @@ def get_args():
         default=3,
         help="Number of epochs before annealling learning rate. Default 3.",
     )
+    parser.add_argument(
+        "--pipeline",
+        type=int,
+        default=0,
+        help="1 to split self play games into 2 cohorts, so that one "
+        "cohort searches while the other is evaluated. Default is 0.",
+    )
     parser.add_argument(
         "--searches_per_eval",
         type=int,
@@ -123,6 +154,46 @@ def get_args():
         "before running a neural network evaluation. "
         "Default is 1, which is the standard MCST algorithm.",
     )
+    parser.add_argument(
+        "--sprt_elo0",
+        type=float,
+        default=0.0,
+        help="Elo gain of the new agent that a sequential probability "
+        "ratio test should reject. Default is 0.0",
+    )
+    parser.add_argument(
+        "--sprt_elo1",
+        type=float,
+        default=0.0,
+        help="Elo gain of the new agent that a sequential probability "
+        "ratio test should accept. If it is larger than --sprt_elo0, testing "
+        "stops once the test decides, and the decision replaces "
+        "--test_threshold. Default is 0.0, which turns the test off.",
+    )
+    parser.add_argument(
+        "--stop_futile",
+        type=int,
+        default=0,
+        help="1 to end a self play turn early once the chosen move "
+        "cannot change. Test games always do this. Default is 0.",
+    )
+    parser.add_argument(
+        "--target_samples",
+        type=int,
+        default=0,
+        help="Stop starting self play games once the finished games have this "
+        "many training samples. Default 0 plays all --num_games games.",
+    )
+    parser.add_argument(
+        "--test_slots",
+        type=int,
+        default=0,
+        help="Number of test games playing at a time, rounded down to a "
+        "whole colour pair. Fewer slots waste fewer searches on games that "
+        "are cancelled once a sequential probability ratio test decides. "
+        "Default 0 plays all test games at once, or a quarter of them at a "
+        "time with the test.",
+    )
     parser.add_argument(
         "--test_threshold",
         type=float,
@@ -130,12 +201,21 @@ def get_args():
         help="Minimum score (exclusive) to become new best agent. "
         "Default is 0.5",
     )
+    parser.add_argument(
+        "--virtual_loss",
+        type=float,
+        default=1.0,
+        help="Evaluation against a search until its evaluation arrives. "
+        "Smaller values suit larger --searches_per_eval. "
+        "Default is 1.0, the evaluation of a loss.",
+    )
 
     # Dictionary of flag values
     args = vars(parser.parse_args())
 
     # Process and validate the values
     args["anneal_factor"] = max(0.0, min(1.0, args["anneal_factor"]))
+    args["autotune"] = 1 if args["autotune"] else 0
     args["batch_size"] = max(1, args["batch_size"])
     args["c_puct"] = max(0.0, args["c_puct"])
     args["epochs"] = max(1, args["epochs"])
@@ -143,6 +223,7 @@ def get_args():
     args["learning_rate"] = max(0.0, args["learning_rate"])
     args["max_searches"] = max(2, args["max_searches"])
     args["num_games"] = max(1, args["num_games"])
+    args["game_slots"] = max(0, min(args["num_games"], args["game_slots"]))
     args["num_logged"] = max(0, args["num_logged"])
     args["num_old_gens"] = max(0, args["num_old_gens"])
     # Enforce even number (first player bias)
@@ -151,13 +232,31 @@ def get_args():
         args["num_threads"] if args["num_threads"] > 0 else 2 * cpu_count()
     )
     args["patience"] = max(1, min(args["epochs"], args["patience"]))
+    args["pipeline"] = 1 if args["pipeline"] else 0
     args["searches_per_eval"] = min(
         args["max_searches"] - 1, max(1, args["searches_per_eval"])
     )
+    # Batches need room for the requests of one game
+    if args["eval_batch_size"] > 0 and not args["pipeline"]:
+        args["eval_batch_size"] = max(
+            args["searches_per_eval"], args["eval_batch_size"]
+        )
+    else:
+        args["eval_batch_size"] = 0
+    if args["pipeline"] or args["eval_batch_size"] > 0:
+        args["autotune"] = 0
+    args["stop_futile"] = 1 if args["stop_futile"] else 0
+    args["target_samples"] = max(0, args["target_samples"])
+    args["test_slots"] = 2 * (
+        max(0, min(args["num_test_games"], args["test_slots"])) // 2
+    )
+    if args["test_slots"] == 0 and args["sprt_elo1"] > args["sprt_elo0"]:
+        args["test_slots"] = 2 * max(1, args["num_test_games"] // 8)
     args["test_threshold"] = min(
         (args["num_test_games"] - 0.5) / args["num_test_games"],
         max(0.5, args["test_threshold"]),
     )
+    args["virtual_loss"] = max(0.0, args["virtual_loss"])
     return args
 
 
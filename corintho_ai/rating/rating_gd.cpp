@@ -1,157 +1,306 @@
 #include <cmath>
 #include <cstdio>
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include <omp.h>
 
+#include "bradleyterry.h"
+
 using namespace std;
 
-double compute_linear(const vector<double> &ratings, int p1, int p2,
-                      double b) {
-  return ratings[p1] - ratings[p2] + b;
-}
+// The ratings follow the Bradley-Terry model of bradleyterry.h. The last
+// player is the anchor and keeps the rating it is given in ratings.txt.
+//
+// The ratings are fit by Newton's method on the log-likelihood over the
+// list of matchups that were played. Each step solves a system the size of
+// the number of players, so the fit converges in a few dozen iterations.
+// The gradient and Hessian are built in parallel, one player per thread.
+//
+// Build with
+// g++ -O2 -fopenmp rating_gd.cpp ../cpp/src/bradleyterry.cpp -I../cpp/include
+
+// Added to the diagonal of the Hessian so a player without games does not
+// make it singular
+const double kRidge = 1e-9;
+const int kMaxIterations = 100;
+const double kTolerance = 1e-10;
+const int kNumBootstraps = 200;
+
+struct Matchup {
+  int p1;
+  int p2;
+  int wins;
+  int draws;
+  int losses;
+};
 
 double get_expected_score(const vector<double> &ratings, int p1, int p2,
                           double b) {
-  double linear = compute_linear(ratings, p1, p2, b);
-  return 1 / (1 + exp(-linear));
+  return 1 / (1 + exp(-(ratings[p1] - ratings[p2] + b)));
 }
 
-double compute_contribution(const vector<double> &ratings,
-                            const vector<int> &matchup, int p1, int p2,
-                            double b) {
-  double linear = compute_linear(ratings, p1, p2, b);
-  double s = matchup[0] + (double)matchup[1] / 2;
-  int n = matchup[0] + matchup[1] + matchup[2];
-  return s * linear - (double)n * log(1 + exp(linear));
-}
+class Solver {
+ public:
+  explicit Solver(const vector<double> &ratings)
+      : ratings_(ratings), by_player_(ratings.size()) {}
+
+  const vector<double> &ratings() const { return ratings_; }
+  double b() const { return b_; }
+  // Whether the last solve converged within kMaxIterations
+  bool converged() const { return converged_; }
+  const vector<Matchup> &matchups() const { return matchups_; }
 
-double compute_log_likelihood(const vector<double> &ratings,
-                              const vector<vector<vector<int>>> &matchups,
-                              double b) {
-  double log_likelihood = 0;
-  for (size_t i = 0; i < matchups.size(); ++i) {
-    for (size_t j = 0; j < matchups[i].size(); ++j) {
-      log_likelihood += compute_contribution(ratings, matchups[i][j], i, j, b);
+  // Add the results of a pair of players, merging them with earlier results
+  // of the same pair
+  void add_result(int p1, int p2, int wins, int draws, int losses) {
+    auto [it, inserted] =
+        index_.try_emplace(make_pair(p1, p2), (int)matchups_.size());
+    if (inserted) {
+      matchups_.push_back(Matchup{p1, p2, 0, 0, 0});
+      by_player_[p1].push_back(it->second);
+      by_player_[p2].push_back(it->second);
     }
+    Matchup &matchup = matchups_[it->second];
+    matchup.wins += wins;
+    matchup.draws += draws;
+    matchup.losses += losses;
   }
-  return log_likelihood;
-}
 
-double compute_gradient_matchup(const vector<double> &ratings,
-                                const vector<int> &matchup, int p1, int p2,
-                                double b, float dL) {
-  double linear = compute_linear(ratings, p1, p2, b);
-  double s = matchup[0] + (double)matchup[1] / 2;
-  int n = matchup[0] + matchup[1] + matchup[2];
-  return s * dL - (double)n * dL * exp(linear) / (1 + exp(linear));
-}
-
-double compute_gradient_r(const vector<double> &ratings,
-                          const vector<vector<vector<int>>> &matchups, int p,
-                          double b) {
-  double gradient = 0;
-  for (size_t i = 0; i < matchups[p].size(); ++i) {
-    gradient += compute_gradient_matchup(ratings, matchups[p][i], p, i, b, 1);
-  }
-  for (size_t i = 0; i < matchups.size(); ++i) {
-    if (i == p)
-      continue;
-    gradient += compute_gradient_matchup(ratings, matchups[i][p], i, p, b, -1);
+  // Replace the results with a resample of the same number of games in each
+  // matchup
+  void resample(mt19937 &generator) {
+    for (Matchup &matchup : matchups_) {
+      // Draw the multinomial counts as two binomials
+      int n = matchup.wins + matchup.draws + matchup.losses;
+      if (n == 0) {
+        continue;
+      }
+      int rest = matchup.draws + matchup.losses;
+      int wins = binomial_distribution<int>{n, (double)matchup.wins / n}(
+          generator);
+      int draws =
+          rest == 0 ? 0
+                    : binomial_distribution<int>{
+                          n - wins, (double)matchup.draws / rest}(generator);
+      matchup.wins = wins;
+      matchup.draws = draws;
+      matchup.losses = n - wins - draws;
+    }
   }
-  return gradient;
-}
 
-double compute_gradient_b(const vector<double> &ratings,
-                          const vector<vector<vector<int>>> &matchups,
-                          double b) {
-  double gradient = 0;
-  for (size_t i = 0; i < matchups.size(); ++i) {
-    for (size_t j = 0; j < matchups[i].size(); ++j) {
-      if (i == j)
-        continue;
-      gradient +=
-          compute_gradient_matchup(ratings, matchups[i][j], i, j, b, 1);
+  double log_likelihood() const {
+    double log_likelihood = 0;
+#pragma omp parallel for reduction(+ : log_likelihood)
+    for (size_t k = 0; k < matchups_.size(); ++k) {
+      const Matchup &m = matchups_[k];
+      double linear = ratings_[m.p1] - ratings_[m.p2] + b_;
+      double s = m.wins + (double)m.draws / 2;
+      int n = m.wins + m.draws + m.losses;
+      log_likelihood += s * linear - n * log(1 + exp(linear));
     }
+    return log_likelihood;
   }
-  return gradient;
-}
 
-double update_ratings(vector<double> &ratings,
-                      const vector<vector<vector<int>>> &matchups, double &b,
-                      double lr) {
-  vector<double> r_grad(ratings.size());
-  for (size_t i = 0; i < ratings.size() - 1; ++i) {
-    r_grad[i] = compute_gradient_r(ratings, matchups, i, b);
+  // Run Newton's method from the current ratings and return the number of
+  // iterations
+  int solve(bool verbose) {
+    int num_iterations = 0;
+    converged_ = false;
+    while (num_iterations < kMaxIterations) {
+      ++num_iterations;
+      double max_step = step();
+      if (verbose) {
+        printf("Iteration %d\t%f\t%f\t%g\n", num_iterations, log_likelihood(),
+               b_ * kEloPerUnit, max_step);
+      }
+      if (max_step < kTolerance) {
+        converged_ = true;
+        break;
+      }
+    }
+    return num_iterations;
   }
-  double b_grad = compute_gradient_b(ratings, matchups, b);
-  for (size_t i = 0; i < ratings.size() - 1; ++i) {
-    ratings[i] += lr * r_grad[i];
+
+ private:
+  // Take one Newton step and return the largest change of a parameter
+  double step() {
+    // The parameters are the ratings of every player but the anchor, then b
+    const int num_players = ratings_.size();
+    const int m = num_players;
+    const int anchor = num_players - 1;
+    const int bi = m - 1;
+    vector<double> hessian(m * m, 0);
+    vector<double> gradient(m, 0);
+    // Each thread builds the rows of its players, so no two threads write to
+    // the same entry
+#pragma omp parallel for schedule(dynamic, 4)
+    for (int p = 0; p < anchor; ++p) {
+      hessian[p * m + p] = kRidge;
+      for (int k : by_player_[p]) {
+        const Matchup &matchup = matchups_[k];
+        double sign = matchup.p1 == p ? 1 : -1;
+        int q = matchup.p1 == p ? matchup.p2 : matchup.p1;
+        double e = get_expected_score(ratings_, matchup.p1, matchup.p2, b_);
+        double s = matchup.wins + (double)matchup.draws / 2;
+        int n = matchup.wins + matchup.draws + matchup.losses;
+        double weight = n * e * (1 - e);
+        gradient[p] += sign * (s - n * e);
+        hessian[p * m + p] += weight;
+        if (q != anchor) {
+          hessian[p * m + q] -= weight;
+        }
+        hessian[p * m + bi] += sign * weight;
+      }
+    }
+    double b_gradient = 0;
+    double b_weight = 0;
+#pragma omp parallel for reduction(+ : b_gradient, b_weight)
+    for (size_t k = 0; k < matchups_.size(); ++k) {
+      const Matchup &matchup = matchups_[k];
+      double e = get_expected_score(ratings_, matchup.p1, matchup.p2, b_);
+      double s = matchup.wins + (double)matchup.draws / 2;
+      int n = matchup.wins + matchup.draws + matchup.losses;
+      b_gradient += s - n * e;
+      b_weight += n * e * (1 - e);
+    }
+    gradient[bi] = b_gradient;
+    hessian[bi * m + bi] = b_weight + kRidge;
+    for (int p = 0; p < anchor; ++p) {
+      hessian[bi * m + p] = hessian[p * m + bi];
+    }
+
+    double max_step = newtonStep(hessian, gradient, m);
+    for (int i = 0; i < anchor; ++i) {
+      ratings_[i] += gradient[i];
+    }
+    b_ += gradient[bi];
+    return max_step;
   }
-  b += lr * b_grad;
 
-  double ll = compute_log_likelihood(ratings, matchups, b);
+  vector<double> ratings_;
+  double b_{0};
+  bool converged_{false};
+  vector<Matchup> matchups_{};
+  // The matchups of each player
+  vector<vector<int>> by_player_;
+  map<pair<int, int>, int> index_{};
+};
 
-  return ll;
+// Read results in the format "p1 p2 wins draws losses"
+vector<Matchup> read_results(const string &filename) {
+  vector<Matchup> results;
+  ifstream fin(filename);
+  Matchup matchup;
+  while (fin >> matchup.p1 >> matchup.p2 >> matchup.wins >> matchup.draws >>
+         matchup.losses) {
+    results.push_back(matchup);
+  }
+  return results;
 }
 
-int main() {
-  vector<double> ratings(97, 0);
-  std::ifstream fin("ratings.txt");
-  for (size_t i = 0; i < ratings.size(); ++i) {
-    fin >> ratings[i];
-    ratings[i] *= log(10) / 400;
+// Usage: rating_gd [results files...]
+// The results files are added in order, and the ratings are refit from the
+// previous ones after each file, so new results only need a few iterations.
+int main(int argc, char *argv[]) {
+  vector<string> filenames;
+  for (int i = 1; i < argc; ++i) {
+    filenames.push_back(argv[i]);
+  }
+  if (filenames.empty()) {
+    filenames.push_back("results.txt");
+  }
+  vector<vector<Matchup>> results;
+  int num_players = 0;
+  for (const string &filename : filenames) {
+    results.push_back(read_results(filename));
+    for (const Matchup &matchup : results.back()) {
+      num_players = max(num_players, max(matchup.p1, matchup.p2) + 1);
+    }
+  }
+
+  vector<double> ratings(num_players, 0);
+  ifstream fin("ratings.txt");
+  for (size_t i = 0; i < ratings.size() && fin >> ratings[i]; ++i) {
+    ratings[i] /= kEloPerUnit;
   }
   fin.close();
-  vector<vector<vector<int>>> matchups(
-      97, vector<vector<int>>(97, vector<int>(3, 0)));
-  std::ifstream fin2("results.txt");
-  int p1, p2, w, d, l;
-  while (fin2 >> p1 >> p2 >> w >> d >> l) {
-    matchups[p1][p2][0] = w;
-    matchups[p1][p2][1] = d;
-    matchups[p1][p2][2] = l;
-  }
-  fin2.close();
-  double b = 0;
-  double lr = 2e-6;
-  double best_ll = update_ratings(ratings, matchups, b, lr);
-  int updates_since_best = 0;
-  for (int i = 0; i < 1000000; ++i) {
-    double ll = update_ratings(ratings, matchups, b, lr);
-    if (ll > best_ll) {
-      best_ll = ll;
-      updates_since_best = 0;
-    } else {
-      ++updates_since_best;
-      if (updates_since_best > 30) {
-        lr /= 2;
-        updates_since_best = 0;
-      }
+
+  Solver solver{ratings};
+  double start = omp_get_wtime();
+  for (size_t f = 0; f < filenames.size(); ++f) {
+    for (const Matchup &matchup : results[f]) {
+      solver.add_result(matchup.p1, matchup.p2, matchup.wins, matchup.draws,
+                        matchup.losses);
+    }
+    int num_iterations = solver.solve(true);
+    printf("%s: %d iterations, %f s\n", filenames[f].c_str(), num_iterations,
+           omp_get_wtime() - start);
+    if (!solver.converged()) {
+      printf("Warning: the fit did not converge in %d iterations\n",
+             kMaxIterations);
+    }
+  }
+  ratings = solver.ratings();
+  double b = solver.b();
+
+  // Bootstrap the results of each matchup, starting from the fitted ratings
+  start = omp_get_wtime();
+  vector<vector<double>> replicates(kNumBootstraps);
+#pragma omp parallel for schedule(dynamic)
+  for (int k = 0; k < kNumBootstraps; ++k) {
+    mt19937 generator{(unsigned)k};
+    Solver sample = solver;
+    sample.resample(generator);
+    sample.solve(false);
+    // A replicate that has not converged has no meaningful ratings
+    if (sample.converged()) {
+      replicates[k] = sample.ratings();
     }
-    if (i % 1000 == 0) {
-      printf("Iteration %d\t%f\t%f\t%f\n", i, ll, b / log(10) * 400, lr);
+  }
+  vector<vector<double>> samples(num_players);
+  for (const vector<double> &replicate : replicates) {
+    for (size_t i = 0; i < replicate.size(); ++i) {
+      samples[i].push_back(replicate[i]);
     }
   }
+  const int num_converged = num_players == 0 ? 0 : samples[0].size();
+  printf("%d bootstraps: %f s\n", kNumBootstraps, omp_get_wtime() - start);
+  if (num_converged < kNumBootstraps) {
+    printf("Warning: %d bootstraps did not converge and are skipped\n",
+           kNumBootstraps - num_converged);
+  }
+
   std::ofstream fout("gd_ratings.txt");
   for (size_t i = 0; i < ratings.size(); ++i) {
-    fout << ratings[i] * 400 / log(10) << endl;
+    fout << ratings[i] * kEloPerUnit << endl;
+  }
+  // The 95% confidence interval of each rating, relative to the anchor
+  std::ofstream fout3("gd_intervals.txt");
+  for (int i = 0; i < num_players && num_converged > 0; ++i) {
+    sort(samples[i].begin(), samples[i].end());
+    fout3 << samples[i][num_converged * 25 / 1000] * kEloPerUnit << " "
+          << samples[i][num_converged * 975 / 1000] * kEloPerUnit << endl;
   }
   std::ofstream fout2("validation.txt");
-  for (size_t i = 0; i < matchups.size(); ++i) {
-    for (size_t j = 0; j < matchups[i].size(); ++j) {
-      if (i == j)
-        continue;
-      double actual_score =
-          (matchups[i][j][0] + (double)matchups[i][j][1] / 2) /
-          (matchups[i][j][0] + matchups[i][j][1] + matchups[i][j][2]);
-      fout2 << i << " " << j << " " << ratings[i] / log(10) * 400 << " "
-            << ratings[j] / log(10) * 400 << " " << actual_score << " "
-            << get_expected_score(ratings, i, j, b) << endl;
+  for (const Matchup &matchup : solver.matchups()) {
+    int i = matchup.p1;
+    int j = matchup.p2;
+    int n = matchup.wins + matchup.draws + matchup.losses;
+    if (n == 0) {
+      continue;
     }
+    double actual_score = (matchup.wins + (double)matchup.draws / 2) / n;
+    fout2 << i << " " << j << " " << ratings[i] * kEloPerUnit << " "
+          << ratings[j] * kEloPerUnit << " " << actual_score << " "
+          << get_expected_score(ratings, i, j, b) << endl;
   }
   return 0;
-}
\ No newline at end of file
+}
@@ -3,7 +3,7 @@ import heapq
 import os
 from multiprocessing import Pool, cpu_count
 
-from tourney import run
+from tourney import run, run_adaptive
 
 
 def run_helper(args):
@@ -17,11 +17,12 @@ def run_helper(args):
         match_file,
         log_folder,
         num_threads,
+        max_active,
         folder,
         id,
     ) = args
 
-    run(model_paths, players_file, match_file, log_folder, num_threads)
+    run(model_paths, players_file, match_file, log_folder, num_threads, max_active)
 
     with open(os.path.join(folder, f"done_{id}.txt"), "w") as f:
         f.write(match_file)
@@ -57,6 +58,23 @@ def get_args():
         default=1,
         help="Number of threads to use",
     )
+    parser.add_argument(
+        "--max_active",
+        type=int,
+        default=0,
+        help="Most matches played at a time by each process, or 0 for no limit",
+    )
+    parser.add_argument(
+        "--adaptive",
+        action="store_true",
+        help="Choose matches from the ratings so far in a single process",
+    )
+    parser.add_argument(
+        "--target_sd",
+        type=float,
+        default=30.0,
+        help="Rating standard deviation in Elo at which adaptive rounds stop",
+    )
 
     args = vars(parser.parse_args())
 
@@ -88,12 +106,9 @@ def get_variance(n1, m1, n2, m2):
     ) * (m2 + 1) / ((n2 + m2 + 2) ** 2 * (n2 + m2 + 3))
 
 
-def write_games(
-    num_players, num_games, folder, round_folder, num_logged=10, num_threads=1
-):
+def get_results(folder):
     """
-    Collects all game results from result_folder
-    Chooses num_games matches based on score variance
+    Collects all game results from the rounds in folder
     """
 
     results = []
@@ -112,6 +127,19 @@ def write_games(
                     ]
                 results.extend(scores)
 
+    return results
+
+
+def write_games(
+    num_players, num_games, folder, round_folder, num_logged=10, num_threads=1
+):
+    """
+    Collects all game results from result_folder
+    Chooses num_games matches based on score variance
+    """
+
+    results = get_results(folder)
+
     scores = {}
     for result in results:
         if result[0] not in scores:
@@ -386,26 +414,36 @@ def write_ratings(folder, round_folder):
         f.write(out_string)
 
 
-def main():
-    args = get_args()
-
-    model_paths = get_models(args["folder"])
+def play_adaptive_round(args, model_paths, num_players, round_folder):
+    """
+    Play matches chosen by MatchScheduler from all results so far
+    """
 
-    current_round = int(
-        open(os.path.join(args["folder"], "current_round.txt"), "r")
-        .read()
-        .strip()
+    log_folder = os.path.join(round_folder, "logs_0")
+    if not os.path.exists(log_folder):
+        os.mkdir(log_folder)
+    results = [
+        (pair[0], pair[1], score) for pair, score in get_results(args["folder"])
+    ]
+    run_adaptive(
+        model_paths,
+        os.path.join(args["folder"], "players.txt"),
+        log_folder,
+        args["num_threads"],
+        args["num_games"],
+        args["target_sd"],
+        num_players,
+        results,
+        args["max_active"],
     )
+    combine_results(round_folder, 1)
+
+
+def play_round(args, model_paths, num_players, current_round, round_folder):
+    """
+    Play matches chosen by score variance in parallel processes
+    """
 
-    with open(os.path.join(args["folder"], "players.txt"), "r") as f:
-        num_players = len(f.readlines()) - 1
-    if not os.path.exists(
-        os.path.join(args["folder"], f"round_{current_round}")
-    ):
-        os.mkdir(os.path.join(args["folder"], f"round_{current_round}"))
-    round_folder = os.path.join(args["folder"], f"round_{current_round}")
-    if not os.path.exists(round_folder):
-        os.mkdir(round_folder)
     write_games(
         num_players,
         args["num_games"],
@@ -434,6 +472,7 @@ def main():
                     f"logs_{i}",
                 ),
                 1,
+                args["max_active"],
                 os.path.join(
                     args["folder"],
                     f"round_{current_round}",
@@ -451,6 +490,33 @@ def main():
         args["num_threads"],
     )
 
+
+def main():
+    args = get_args()
+
+    model_paths = get_models(args["folder"])
+
+    current_round = int(
+        open(os.path.join(args["folder"], "current_round.txt"), "r")
+        .read()
+        .strip()
+    )
+
+    with open(os.path.join(args["folder"], "players.txt"), "r") as f:
+        num_players = len(f.readlines()) - 1
+    if not os.path.exists(
+        os.path.join(args["folder"], f"round_{current_round}")
+    ):
+        os.mkdir(os.path.join(args["folder"], f"round_{current_round}"))
+    round_folder = os.path.join(args["folder"], f"round_{current_round}")
+    if not os.path.exists(round_folder):
+        os.mkdir(round_folder)
+
+    if args["adaptive"]:
+        play_adaptive_round(args, model_paths, num_players, round_folder)
+    else:
+        play_round(args, model_paths, num_players, current_round, round_folder)
+
     # Compute new ratings
     write_ratings(
         args["folder"],
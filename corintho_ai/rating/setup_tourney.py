@@ -17,7 +17,10 @@ setup(
                 [
                     os.path.join(current_dir, "tourney.pyx"),
                     os.path.join(current_dir, "../cpp/src/match.cpp"),
+                    os.path.join(current_dir, "../cpp/src/bradleyterry.cpp"),
+                    os.path.join(current_dir, "../cpp/src/threadpool.cpp"),
                     os.path.join(current_dir, "../cpp/src/trainmc.cpp"),
+                    os.path.join(current_dir, "../cpp/src/treefile.cpp"),
                     os.path.join(current_dir, "../cpp/src/node.cpp"),
                     os.path.join(current_dir, "../cpp/src/game.cpp"),
                     os.path.join(current_dir, "../cpp/src/move.cpp"),
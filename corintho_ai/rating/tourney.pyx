@@ -8,18 +8,22 @@ import tflite_runtime.interpreter as tflite
 cimport numpy as np
 from libcpp cimport bool
 from libcpp.string cimport string
+from libcpp.vector cimport vector
 
 _NUM_MOVES = 96
 _GAME_STATE_SIZE = 70
 
 cdef extern from "../cpp/src/tourney.cpp":
     cdef cppclass Tourney:
-        Tourney(int num_threads, string log_folder) except +
+        Tourney(int num_threads, string log_folder, int max_active) except +
         bool all_done() except +
-        int num_requests(int id) except +
+        # id -1 is all models at once
+        int num_requests(int id=*) except +
+        int offset(int id) except +
+        vector[int] model_ids() except +
         void writeScores(string filename) except +
-        void writeRequests(float *game_states, int id) except +
-        void doIteration(float *eval, float *probs, int id) except +
+        void writeRequests(float *game_states, int id=*) except +
+        void doIteration(float *eval, float *probs, int id=*) except +
         void addPlayer(
             int player_id,
             int model_id,
@@ -27,9 +31,19 @@ cdef extern from "../cpp/src/tourney.cpp":
             int searches_per_eval,
             float c_puct,
             float epsilon,
-            bool random) except +
+            bool random,
+            int rollout) except +
         void addMatch(int player1, int player2, bool logging) except +
 
+cdef extern from "../cpp/src/matchscheduler.cpp":
+    cdef cppclass MatchScheduler:
+        MatchScheduler(int num_players) except +
+        bool converged(float target_sd) except +
+        void addResult(int player1, int player2, float score) except +
+        void addResults(Tourney &tourney) except +
+        void fit() except +
+        void schedule(Tourney &tourney, int num_pairings, float target_sd) except +
+
 cpdef format_time(t):
     """Format string
     t is time in seconds"""
@@ -59,16 +73,14 @@ cpdef get_models(model_paths):
 
     return models
 
-cdef get_tourney(Tourney *tourney, player_file, match_file):
+cdef add_players(Tourney *tourney, player_file):
     """
-    Returns a pointer to a Tourney object
-    Reads player and match pairings from filename
+    Adds the players of player_file to the tourney
+    Returns the searches per evaluation and the model of each player
     """
 
     searches_per_evals = {}
     player_models = {}
-    max_model_searches = {}
-    model_ids = set()
 
     with open(player_file, "r") as f:
         # Get players
@@ -85,10 +97,22 @@ cdef get_tourney(Tourney *tourney, player_file, match_file):
                 c_puct,
                 epsilon,
                 True if random == 1.0 else False,
+                # 2 and 3 are players with random and heuristic rollouts
+                random - 1 if random >= 2 else 0,
             )
             searches_per_evals[player_id] = int(searches_per_eval)
             player_models[player_id] = int(model_id)
-            model_ids.add(int(model_id))
+
+    return searches_per_evals, player_models
+
+cdef get_tourney(Tourney *tourney, player_file, match_file, max_active):
+    """
+    Returns a pointer to a Tourney object
+    Reads player and match pairings from filename
+    """
+
+    searches_per_evals, player_models = add_players(tourney, player_file)
+    max_model_searches = {}
 
     # Get matches
     with open(match_file, "r") as f:
@@ -107,9 +131,14 @@ cdef get_tourney(Tourney *tourney, player_file, match_file):
             else:
                 max_model_searches[player_models[player2]] += searches_per_evals[player2]
 
-        return model_ids, max(max_model_searches.values())
+        # The requests of all models share one buffer. Each match that is
+        # playing requests at most searches_per_eval rows at a time
+        max_searches = sum(max_model_searches.values())
+        if max_active > 0:
+            max_searches = min(max_searches, max_active * max(searches_per_evals.values()))
+        return max_searches
 
-cdef play_games(Tourney *tourney, models, model_ids, max_searches, log_folder):
+cdef play_games(Tourney *tourney, models, max_searches, log_folder):
     """
     Main game loop
     """
@@ -125,38 +154,37 @@ cdef play_games(Tourney *tourney, models, model_ids, max_searches, log_folder):
 
     while not tourney.all_done():
 
-        for id in model_ids:
-
-            # Dummy model IDs for random players are negative
-            num_requests = 0
-            if id >= 0:
-                num_requests = tourney.num_requests(id)
+        # The requests of every model are written at once, grouped by model.
+        # Random players and players with rollouts have no requests.
+        if tourney.num_requests() > 0:
 
-            if num_requests > 0:
-            
-                tourney.writeRequests(&game_states[0,0], id)
+            tourney.writeRequests(&game_states[0,0])
 
-                pred_start = time.perf_counter()
-                input_data = game_states[:num_requests].astype(np.float32)
+            pred_start = time.perf_counter()
+            for id in tourney.model_ids():
+                start = tourney.offset(id)
+                end = start + tourney.num_requests(id)
+                input_data = game_states[start:end].astype(np.float32)
                 # Resize the input tensor depending on the number of requests
                 # This is needed in TFLite models
                 model = models[id]
                 input_details = model.get_input_details()
                 output_details = model.get_output_details()
-                input_shape = input_details[0]['shape']
                 input_shape = list(input_details[0]['shape'])
-                input_shape[0] = num_requests
+                input_shape[0] = end - start
                 model.resize_tensor_input(input_details[0]['index'], input_shape)
                 model.allocate_tensors()
                 model.set_tensor(input_details[0]['index'], input_data)
                 model.invoke()
-                eval = model.get_tensor(output_details[1]['index']).flatten()
-                probs = model.get_tensor(output_details[0]['index'])
-                predict_time += time.perf_counter() - pred_start
+                # Each model fills its own region of the evaluations
+                eval[start:end] = model.get_tensor(output_details[1]['index']).flatten()
+                probs[start:end] = model.get_tensor(output_details[0]['index'])
+            predict_time += time.perf_counter() - pred_start
 
-            play_start = time.perf_counter()
-            tourney.doIteration(&eval[0], &probs[0,0], id)
-            play_time += time.perf_counter() - play_start
+        # Every match advances in one pass
+        play_start = time.perf_counter()
+        tourney.doIteration(&eval[0], &probs[0,0])
+        play_time += time.perf_counter() - play_start
 
         evals_done += 1
 
@@ -173,23 +201,62 @@ cdef play_games(Tourney *tourney, models, model_ids, max_searches, log_folder):
             last_time = time.perf_counter()
 
             
-def run(model_paths, player_file, match_file, log_folder, num_threads):
+def run(model_paths, player_file, match_file, log_folder, num_threads, max_active=0):
     """
     models is a list of model paths (TFLite)
     Reads pairings from filename
+    max_active is the most matches played at a time, or 0 for no limit
     """
 
     # Load models
     models = get_models(model_paths)
 
     # Create tournament and load pairings
-    cdef Tourney *tourney = new Tourney(num_threads, log_folder.encode())
-    model_ids, max_searches = get_tourney(tourney, player_file, match_file)
+    cdef Tourney *tourney = new Tourney(num_threads, log_folder.encode(), max_active)
+    max_searches = get_tourney(tourney, player_file, match_file, max_active)
 
     # Play games
-    play_games(tourney, models, model_ids, max_searches, log_folder)
+    play_games(tourney, models, max_searches, log_folder)
 
     # Save results
     tourney.writeScores(f"{log_folder}/scores.txt".encode())
 
-    del tourney
\ No newline at end of file
+    del tourney
+
+def run_adaptive(model_paths, player_file, log_folder, num_threads, num_games,
+                 target_sd, round_size, results=(), max_active=0):
+    """
+    Plays rounds of round_size matches chosen by MatchScheduler, until every
+    rating has a standard deviation of at most target_sd Elo or num_games
+    matches are played
+    results is a list of earlier (player1, player2, score) results
+    max_active is the most matches played at a time, or 0 for no limit
+    """
+
+    models = get_models(model_paths)
+
+    cdef Tourney *tourney = new Tourney(num_threads, log_folder.encode(), max_active)
+    searches_per_evals, _ = add_players(tourney, player_file)
+    cdef MatchScheduler *scheduler = new MatchScheduler(len(searches_per_evals))
+    for player1, player2, score in results:
+        scheduler.addResult(player1, player2, score)
+    scheduler.fit()
+
+    # Each match that is playing requests at most searches_per_eval rows
+    max_matches = round_size if max_active == 0 else min(round_size, max_active)
+    max_searches = max_matches * max(searches_per_evals.values())
+
+    num_played = 0
+    while num_played < num_games and not scheduler.converged(target_sd):
+        num_pairings = min(round_size, num_games - num_played)
+        scheduler.schedule(tourney[0], num_pairings, target_sd)
+        play_games(tourney, models, max_searches, log_folder)
+        scheduler.addResults(tourney[0])
+        scheduler.fit()
+        num_played += num_pairings
+
+    # Save results of every round
+    tourney.writeScores(f"{log_folder}/scores.txt".encode())
+
+    del scheduler
+    del tourney
@@ -0,0 +1,150 @@
+#include "engine.h"
+
+#include <bitset>
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+#include "evaluator.h"
+#include "game.h"
+#include "move.h"
+#include "util.h"
+
+namespace {
+
+// Returns the last line of output starting with prefix, without the prefix
+std::string lastReply(const std::ostringstream &out,
+                      const std::string &prefix) {
+  std::istringstream lines{out.str()};
+  std::string line;
+  std::string reply;
+  while (std::getline(lines, line)) {
+    if (line.compare(0, prefix.size(), prefix) == 0) {
+      reply = line.substr(prefix.size());
+    }
+  }
+  return reply;
+}
+
+}  // namespace
+
+TEST(EngineTest, MockEvaluator) {
+  MockEvaluator evaluator{1};
+  float game_states[2 * kGameStateSize];
+  Game game;
+  game.writeGameState(game_states);
+  game.writeGameState(game_states + kGameStateSize);
+  float eval[2];
+  float probs[2 * kNumMoves];
+  evaluator.evaluate(game_states, 2, eval, probs);
+  // The outputs only depend on the game state
+  EXPECT_EQ(eval[0], eval[1]);
+  float sum = 0.0;
+  for (int32_t i = 0; i < kNumMoves; ++i) {
+    EXPECT_EQ(probs[i], probs[kNumMoves + i]);
+    sum += probs[i];
+  }
+  EXPECT_NEAR(sum, 1.0, 1e-4);
+}
+
+TEST(EngineTest, LegalMoves) {
+  MockEvaluator evaluator;
+  std::ostringstream out;
+  Engine engine{&evaluator, out};
+  EXPECT_TRUE(engine.handleCommand("isready"));
+  EXPECT_NE(out.str().find("readyok"), std::string::npos);
+
+  EXPECT_TRUE(engine.handleCommand("position startpos moves Ba4 Cb3"));
+  EXPECT_TRUE(engine.handleCommand("legalmoves"));
+  Game game;
+  game.doMove(parseMove("Ba4"));
+  game.doMove(parseMove("Cb3"));
+  std::bitset<kNumMoves> legal_moves;
+  game.getLegalMoves(legal_moves);
+  std::istringstream reply{lastReply(out, "legalmoves")};
+  std::string move;
+  int32_t num_moves = 0;
+  while (reply >> move) {
+    EXPECT_TRUE(legal_moves[parseMove(move)]);
+    ++num_moves;
+  }
+  EXPECT_EQ(num_moves, legal_moves.count());
+
+  EXPECT_TRUE(engine.handleCommand("position startpos moves Ba4 Ba4"));
+  EXPECT_EQ(lastReply(out, "info string "), "illegal move Ba4");
+  // Each player has at most 4 of each piece
+  std::string empty_board(4 * kBoardSize, '0');
+  EXPECT_TRUE(engine.handleCommand("position state " + empty_board +
+                                   " 0 4 4 4 4 4 5"));
+  EXPECT_EQ(lastReply(out, "info string "), "invalid position");
+  EXPECT_TRUE(engine.handleCommand("position state " + empty_board +
+                                   " 0 4 -1 4 4 4 4"));
+  EXPECT_EQ(lastReply(out, "info string "), "invalid position");
+  EXPECT_TRUE(engine.handleCommand("quit") == false);
+}
+
+TEST(EngineTest, GoNodes) {
+  MockEvaluator evaluator;
+  std::ostringstream out;
+  Engine engine{&evaluator, out, 8};
+  EXPECT_TRUE(engine.handleCommand("position startpos"));
+  EXPECT_TRUE(engine.handleCommand("go nodes 400"));
+  engine.wait();
+  std::string best_move = lastReply(out, "bestmove ");
+  std::bitset<kNumMoves> legal_moves;
+  Game{}.getLegalMoves(legal_moves);
+  int32_t move_id = parseMove(best_move);
+  ASSERT_NE(move_id, -1);
+  EXPECT_TRUE(legal_moves[move_id]);
+
+  // Playing the best move reuses its searches
+  EXPECT_TRUE(engine.handleCommand("position startpos moves " + best_move));
+  EXPECT_TRUE(engine.handleCommand("eval"));
+  EXPECT_NE(lastReply(out, "eval ").find("search"), std::string::npos);
+}
+
+TEST(EngineTest, ReuseAfterReply) {
+  MockEvaluator evaluator;
+  std::ostringstream out;
+  Engine engine{&evaluator, out, 8};
+  EXPECT_TRUE(engine.handleCommand("position startpos"));
+  EXPECT_TRUE(engine.handleCommand("go nodes 400"));
+  engine.wait();
+  // The principal variation starts with our move and the expected reply
+  std::istringstream info{lastReply(out, "info ")};
+  std::string token;
+  while (info >> token && token != "pv") {
+  }
+  std::string best_move;
+  std::string reply;
+  ASSERT_TRUE(info >> best_move >> reply);
+
+  // The position after our move and the reply keeps its searches
+  EXPECT_TRUE(engine.handleCommand("position startpos moves " + best_move +
+                                   " " + reply));
+  EXPECT_TRUE(engine.handleCommand("eval"));
+  EXPECT_NE(lastReply(out, "eval ").find("search"), std::string::npos);
+}
+
+TEST(EngineTest, StopAndPonder) {
+  MockEvaluator evaluator;
+  std::ostringstream out;
+  Engine engine{&evaluator, out};
+  EXPECT_TRUE(engine.handleCommand("go infinite"));
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_TRUE(engine.handleCommand("stop"));
+  EXPECT_NE(parseMove(lastReply(out, "bestmove ")), -1);
+
+  // Pondering does not stop until ponderhit
+  EXPECT_TRUE(engine.handleCommand("position startpos moves Ba4"));
+  size_t output_size = out.str().size();
+  EXPECT_TRUE(engine.handleCommand("go ponder movetime 10"));
+  std::this_thread::sleep_for(std::chrono::milliseconds(30));
+  EXPECT_EQ(out.str().size(), output_size);
+  EXPECT_TRUE(engine.handleCommand("ponderhit"));
+  engine.wait();
+  EXPECT_NE(parseMove(lastReply(out, "bestmove ")), -1);
+}
@@ -0,0 +1,36 @@
+#include "evaltuner.h"
+
+#include <cstdint>
+
+#include "gtest/gtest.h"
+
+// Feed the tuner batches with a fixed overhead and fixed costs per row
+int32_t tune(int32_t num_games, double overhead, double eval_cost,
+             double search_cost) {
+  EvalTuner tuner{1, 64, 0.1};
+  for (int32_t i = 0; i < 200; ++i) {
+    const int32_t num_rows = num_games * tuner.searches_per_eval();
+    tuner.record(num_rows, search_cost * num_rows,
+                 overhead + eval_cost * num_rows, num_games);
+  }
+  return tuner.searches_per_eval();
+}
+
+// Test that the tuner finds the fewest searches that amortize the overhead
+TEST(EvalTunerTest, Converges) {
+  // 0.9 * 0.01 / (0.1 * 0.00006) = 1500 rows, or 15 searches for 100 games
+  EXPECT_EQ(tune(100, 0.01, 0.00001, 0.00005), 15);
+  // More games need fewer searches each
+  EXPECT_EQ(tune(1500, 0.01, 0.00001, 0.00005), 1);
+  // A single game uses the most searches
+  EXPECT_EQ(tune(1, 0.01, 0.00001, 0.00005), 64);
+}
+
+// Test that the searches stay at the bounds if they are equal
+TEST(EvalTunerTest, FixedBounds) {
+  EvalTuner tuner{8, 8};
+  for (int32_t i = 0; i < 10; ++i) {
+    tuner.record(8 * (i + 1), 0.001, 0.01, i + 1);
+    EXPECT_EQ(tuner.searches_per_eval(), 8);
+  }
+}
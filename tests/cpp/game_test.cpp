@@ -2,6 +2,8 @@
 #include "util.h"
 #include "gtest/gtest.h"
 #include <bitset>
+#include <random>
+#include <vector>
 
 TEST(GameTest, DefaultConstructor) {
   // Test that the default constructor creates a game in the starting position
@@ -524,4 +526,35 @@ TEST(GameTest, TwoLines) {
       }
     }
   }
-}
\ No newline at end of file
+}
+
+TEST(GameTest, ExpandGameStates) {
+  // Packed game states expand to the neural network input
+  std::mt19937 generator(12345);
+  std::vector<Game> games;
+  Game game;
+  for (int32_t turn = 0; turn < 20; ++turn) {
+    std::bitset<kNumMoves> legal_moves;
+    game.getLegalMoves(legal_moves);
+    if (legal_moves.none()) {
+      break;
+    }
+    std::vector<int32_t> moves;
+    for (int32_t i = 0; i < kNumMoves; ++i) {
+      if (legal_moves[i]) {
+        moves.push_back(i);
+      }
+    }
+    game.doMove(moves[generator() % moves.size()]);
+    games.push_back(game);
+  }
+  std::vector<PackedGame> packed;
+  std::vector<float> expected(games.size() * kGameStateSize);
+  for (size_t i = 0; i < games.size(); ++i) {
+    packed.push_back(games[i].pack());
+    games[i].writeGameState(expected.data() + i * kGameStateSize);
+  }
+  std::vector<float> game_states(games.size() * kGameStateSize);
+  expandGameStates(packed.data(), packed.size(), game_states.data());
+  EXPECT_EQ(game_states, expected);
+}
@@ -120,4 +120,21 @@ TEST(MatchTest, FullGame) {
       }
     }
   }
-}
\ No newline at end of file
+}
+
+// Test that a player with playouts beats a random player without a model
+TEST(MatchTest, Rollout) {
+  float score = 0.0;
+  for (int32_t seed = 0; seed < 10; ++seed) {
+    Player player1{0, -1, 200, 16, 1.0, 0.0, false,
+                   TrainMC::Rollout::kRandom};
+    Player player2{1, -2, 200, 16, 1.0, 0.0, true};
+    // Alternate who moves first
+    Match match = seed % 2 == 0 ? Match{seed, player1, player2}
+                                : Match{seed, player2, player1};
+    EXPECT_TRUE(match.doIteration());
+    EXPECT_EQ(match.num_requests(), 0);
+    score += seed % 2 == 0 ? match.score() : 1.0 - match.score();
+  }
+  EXPECT_GE(score, 7.0);
+}
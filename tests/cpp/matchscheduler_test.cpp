@@ -0,0 +1,141 @@
+#include "matchscheduler.h"
+
+#include <cmath>
+#include <cstdint>
+
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "evaluator.h"
+#include "tourney.h"
+#include "util.h"
+
+namespace {
+
+// Play a game between players with the given Elo ratings and return the
+// score of the first player
+float playGame(std::mt19937 &generator, const std::vector<float> &ratings,
+               float advantage, int32_t player1, int32_t player2) {
+  const double p = 1.0 / (1.0 + std::pow(10.0, (ratings[player2] -
+                                                ratings[player1] -
+                                                advantage) /
+                                                   400.0));
+  return std::bernoulli_distribution{p}(generator) ? 1.0 : 0.0;
+}
+
+// Return the number of games until every rating has the target standard
+// deviation, with pairings from the scheduler or in round-robin order
+int32_t gamesToConverge(bool adaptive, const std::vector<float> &ratings,
+                        float target_sd) {
+  const int32_t num_players = ratings.size();
+  std::mt19937 generator{7};
+  MatchScheduler scheduler{num_players};
+  int32_t round = 0;
+  while (!scheduler.converged(target_sd)) {
+    std::vector<std::pair<int32_t, int32_t>> pairings;
+    if (adaptive) {
+      pairings = scheduler.nextPairings(num_players, target_sd);
+    } else {
+      for (int32_t i = 0; i < num_players; ++i) {
+        const int32_t j = (i + round % (num_players - 1) + 1) % num_players;
+        pairings.emplace_back(round % 2 == 0 ? i : j, round % 2 == 0 ? j : i);
+      }
+    }
+    for (const auto &[player1, player2] : pairings) {
+      scheduler.addResult(player1, player2,
+                          playGame(generator, ratings, 30.0, player1,
+                                   player2));
+    }
+    scheduler.fit();
+    ++round;
+  }
+  return scheduler.num_games();
+}
+
+}  // namespace
+
+// Test that the fitted ratings are close to the true ratings
+TEST(MatchSchedulerTest, Fit) {
+  const std::vector<float> ratings = {0.0, 100.0, -150.0, 300.0, 50.0};
+  const float advantage = 40.0;
+  std::mt19937 generator{1};
+  MatchScheduler scheduler{5};
+  for (int32_t i = 0; i < 5; ++i) {
+    for (int32_t j = 0; j < 5; ++j) {
+      for (int32_t k = 0; k < 300 && i != j; ++k) {
+        scheduler.addResult(i, j, playGame(generator, ratings, advantage, i,
+                                           j));
+      }
+    }
+  }
+  scheduler.fit();
+  EXPECT_EQ(scheduler.num_games(), 6000);
+  // The last player is the anchor
+  EXPECT_EQ(scheduler.rating(4), 0.0);
+  EXPECT_EQ(scheduler.stddev(4), 0.0);
+  for (int32_t i = 0; i < 4; ++i) {
+    EXPECT_GT(scheduler.stddev(i), 0.0);
+    EXPECT_LT(scheduler.stddev(i), 20.0);
+    EXPECT_NEAR(scheduler.rating(i), ratings[i] - ratings[4],
+                3 * scheduler.stddev(i));
+  }
+  EXPECT_NEAR(scheduler.first_player_advantage(), advantage, 20.0);
+}
+
+// Test that the scheduler plays a player without games before the others
+TEST(MatchSchedulerTest, PrefersUncertain) {
+  MatchScheduler scheduler{3};
+  for (int32_t k = 0; k < 50; ++k) {
+    scheduler.addResult(1, 2, k % 2);
+    scheduler.addResult(2, 1, k % 2);
+  }
+  scheduler.fit();
+  EXPECT_LT(scheduler.stddev(1), scheduler.stddev(0));
+  const auto pairings = scheduler.nextPairings(1);
+  ASSERT_EQ(pairings.size(), 1);
+  EXPECT_TRUE(pairings[0].first == 0 || pairings[0].second == 0);
+}
+
+// Test that adaptive pairings reach the target with fewer games than a
+// round robin when many outcomes are nearly certain
+TEST(MatchSchedulerTest, FewerGames) {
+  const std::vector<float> ratings = {0.0,    300.0,  600.0,  900.0,
+                                      1200.0, 1500.0, 1800.0, 2100.0};
+  const int32_t adaptive = gamesToConverge(true, ratings, 100.0);
+  const int32_t round_robin = gamesToConverge(false, ratings, 100.0);
+  EXPECT_LT(adaptive, round_robin);
+}
+
+// Test scheduling matches in a tourney and reading its results
+TEST(MatchSchedulerTest, Tourney) {
+  Tourney tourney{1, ""};
+  for (int32_t i = 0; i < 3; ++i) {
+    tourney.addPlayer(i, i, 8, 4);
+  }
+  MatchScheduler scheduler{3};
+  MockEvaluator evaluators[3] = {MockEvaluator{0}, MockEvaluator{1},
+                                 MockEvaluator{2}};
+  float game_states[6 * 4 * kGameStateSize];
+  float eval[6 * 4];
+  float probs[6 * 4 * kNumMoves];
+  for (int32_t round = 0; round < 2; ++round) {
+    scheduler.schedule(tourney, 6);
+    while (!tourney.all_done()) {
+      tourney.writeRequests(game_states);
+      for (int32_t id : tourney.model_ids()) {
+        const int32_t offset = tourney.offset(id);
+        evaluators[id].evaluate(game_states + offset * kGameStateSize,
+                                tourney.num_requests(id), eval + offset,
+                                probs + offset * kNumMoves);
+      }
+      tourney.doIteration(eval, probs);
+    }
+    scheduler.addResults(tourney);
+    scheduler.fit();
+    EXPECT_EQ(scheduler.num_games(), 6 * (round + 1));
+  }
+  EXPECT_LT(scheduler.stddev(1), 400.0);
+}
@@ -64,3 +64,17 @@ TEST(MoveTest, PrintMove) {
   ss << move0;
   EXPECT_EQ(ss.str(), "a4R");
 }
+
+TEST(MoveTest, ParseMove) {
+  // Test that parsing a printed move returns the same move
+  for (int32_t id = 0; id < kNumMoves; ++id) {
+    std::stringstream ss;
+    ss << Move{id};
+    EXPECT_EQ(parseMove(ss.str()), id);
+  }
+  EXPECT_EQ(parseMove("Ba4"), encodePlace(Space{0, 0}, kBase));
+  EXPECT_EQ(parseMove("a4L"), -1);
+  EXPECT_EQ(parseMove("e1R"), -1);
+  EXPECT_EQ(parseMove("Ba5"), -1);
+  EXPECT_EQ(parseMove("b2"), -1);
+}
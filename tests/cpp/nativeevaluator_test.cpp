@@ -0,0 +1,168 @@
+#include "nativeevaluator.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "util.h"
+
+namespace {
+
+// Make a layer with random weights
+DenseLayer randomLayer(std::mt19937 &generator, int32_t num_inputs,
+                       int32_t num_outputs) {
+  std::uniform_real_distribution<float> dist(-0.5, 0.5);
+  DenseLayer layer;
+  layer.num_inputs = num_inputs;
+  layer.num_outputs = num_outputs;
+  for (int32_t i = 0; i < num_inputs * num_outputs; ++i) {
+    layer.weights.push_back(dist(generator));
+  }
+  for (int32_t i = 0; i < num_outputs; ++i) {
+    layer.bias.push_back(dist(generator));
+  }
+  return layer;
+}
+
+// Make a network whose widths are not multiples of the blocks
+std::vector<DenseLayer> randomNetwork(std::mt19937 &generator) {
+  return {randomLayer(generator, kGameStateSize, 20),
+          randomLayer(generator, 20, 33), randomLayer(generator, 33, 1),
+          randomLayer(generator, 33, kNumMoves)};
+}
+
+// Compute the outputs of one state without blocking
+void reference(const std::vector<DenseLayer> &layers, const float state[],
+               float &eval, float probs[]) {
+  std::vector<double> values(state, state + kGameStateSize);
+  const size_t num_hidden = layers.size() - 2;
+  for (size_t i = 0; i < num_hidden; ++i) {
+    std::vector<double> out(layers[i].bias.begin(), layers[i].bias.end());
+    for (int32_t k = 0; k < layers[i].num_inputs; ++k) {
+      for (int32_t j = 0; j < layers[i].num_outputs; ++j) {
+        out[j] += values[k] * layers[i].weights[k * layers[i].num_outputs + j];
+      }
+    }
+    for (double &value : out) {
+      value = std::max(value, 0.0);
+    }
+    values = out;
+  }
+  const DenseLayer &value = layers[num_hidden];
+  const DenseLayer &policy = layers[num_hidden + 1];
+  double value_sum = value.bias[0];
+  std::vector<double> logits(policy.bias.begin(), policy.bias.end());
+  for (int32_t k = 0; k < value.num_inputs; ++k) {
+    value_sum += values[k] * value.weights[k];
+    for (int32_t j = 0; j < kNumMoves; ++j) {
+      logits[j] += values[k] * policy.weights[k * kNumMoves + j];
+    }
+  }
+  eval = std::tanh(value_sum);
+  double sum = 0.0;
+  for (int32_t j = 0; j < kNumMoves; ++j) {
+    sum += std::exp(logits[j]);
+  }
+  for (int32_t j = 0; j < kNumMoves; ++j) {
+    probs[j] = std::exp(logits[j]) / sum;
+  }
+}
+
+}  // namespace
+
+// Test that a saved network is loaded unchanged
+TEST(NativeEvaluatorTest, SaveLoad) {
+  std::mt19937 generator{1};
+  const std::vector<DenseLayer> layers = randomNetwork(generator);
+  const std::string filename = "nativeevaluator_test_save.bin";
+  ASSERT_TRUE(saveNetwork(layers, filename));
+  std::vector<DenseLayer> loaded;
+  ASSERT_TRUE(loadNetwork(filename, loaded));
+  ASSERT_EQ(loaded.size(), layers.size());
+  for (size_t i = 0; i < layers.size(); ++i) {
+    EXPECT_EQ(loaded[i].num_inputs, layers[i].num_inputs);
+    EXPECT_EQ(loaded[i].num_outputs, layers[i].num_outputs);
+    EXPECT_EQ(loaded[i].weights, layers[i].weights);
+    EXPECT_EQ(loaded[i].bias, layers[i].bias);
+  }
+  std::remove(filename.c_str());
+}
+
+// Test that files that do not describe a network are rejected
+TEST(NativeEvaluatorTest, Invalid) {
+  EXPECT_FALSE(NativeEvaluator{"nativeevaluator_test_missing.bin"}.is_open());
+  std::mt19937 generator{2};
+  const std::string filename = "nativeevaluator_test_invalid.bin";
+  // The first layer must read the game state
+  std::vector<DenseLayer> layers = randomNetwork(generator);
+  layers[0] = randomLayer(generator, kGameStateSize + 1, 20);
+  ASSERT_TRUE(saveNetwork(layers, filename));
+  EXPECT_FALSE(NativeEvaluator{filename}.is_open());
+  // The policy head must have an output for each move
+  layers = randomNetwork(generator);
+  layers[3] = randomLayer(generator, 33, kNumMoves - 1);
+  ASSERT_TRUE(saveNetwork(layers, filename));
+  EXPECT_FALSE(NativeEvaluator{filename}.is_open());
+  // The file must be complete
+  layers = randomNetwork(generator);
+  ASSERT_TRUE(saveNetwork(layers, filename));
+  std::vector<DenseLayer> loaded;
+  ASSERT_TRUE(loadNetwork(filename, loaded));
+  std::string contents;
+  {
+    std::ifstream in{filename, std::ifstream::binary};
+    contents.assign(std::istreambuf_iterator<char>{in}, {});
+  }
+  {
+    std::ofstream out{filename, std::ofstream::binary};
+    out.write(contents.data(), contents.size() - 4);
+  }
+  EXPECT_FALSE(loadNetwork(filename, loaded));
+  EXPECT_TRUE(loaded.empty());
+  std::remove(filename.c_str());
+}
+
+// Test that batches give the same outputs as a plain forward pass
+TEST(NativeEvaluatorTest, Evaluate) {
+  std::mt19937 generator{3};
+  const std::vector<DenseLayer> layers = randomNetwork(generator);
+  const std::string filename = "nativeevaluator_test_evaluate.bin";
+  ASSERT_TRUE(saveNetwork(layers, filename));
+  NativeEvaluator evaluator{filename};
+  ASSERT_TRUE(evaluator.is_open());
+  std::bernoulli_distribution bit(0.3);
+  // Batches smaller than, equal to and not a multiple of the row block
+  for (int32_t num_states : {1, 4, 9, 64}) {
+    std::vector<float> game_states(num_states * kGameStateSize);
+    for (float &entry : game_states) {
+      entry = bit(generator) ? 1.0 : 0.0;
+    }
+    std::vector<float> eval(num_states);
+    std::vector<float> probs(num_states * kNumMoves);
+    evaluator.evaluate(game_states.data(), num_states, eval.data(),
+                       probs.data());
+    for (int32_t i = 0; i < num_states; ++i) {
+      float expected_eval = 0.0;
+      float expected_probs[kNumMoves];
+      reference(layers, game_states.data() + i * kGameStateSize,
+                expected_eval, expected_probs);
+      EXPECT_NEAR(eval[i], expected_eval, 1e-5);
+      float sum = 0.0;
+      for (int32_t j = 0; j < kNumMoves; ++j) {
+        EXPECT_NEAR(probs[i * kNumMoves + j], expected_probs[j], 1e-5);
+        sum += probs[i * kNumMoves + j];
+      }
+      EXPECT_NEAR(sum, 1.0, 1e-5);
+    }
+  }
+  std::remove(filename.c_str());
+}
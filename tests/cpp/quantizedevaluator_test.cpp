@@ -0,0 +1,115 @@
+#include "quantizedevaluator.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "nativeevaluator.h"
+#include "util.h"
+
+namespace {
+
+// Make a layer with random weights scaled for its number of inputs
+DenseLayer randomLayer(std::mt19937 &generator, int32_t num_inputs,
+                       int32_t num_outputs) {
+  std::normal_distribution<float> dist(0.0, 1.0 / std::sqrt(num_inputs));
+  DenseLayer layer;
+  layer.num_inputs = num_inputs;
+  layer.num_outputs = num_outputs;
+  for (int32_t i = 0; i < num_inputs * num_outputs; ++i) {
+    layer.weights.push_back(dist(generator));
+  }
+  for (int32_t i = 0; i < num_outputs; ++i) {
+    layer.bias.push_back(dist(generator));
+  }
+  return layer;
+}
+
+// Make game states with entries that are multiples of 0.25
+std::vector<float> randomStates(std::mt19937 &generator, int32_t num_states) {
+  std::bernoulli_distribution bit(0.3);
+  std::uniform_int_distribution<int32_t> pieces(0, 4);
+  std::vector<float> game_states(num_states * kGameStateSize);
+  for (int32_t i = 0; i < num_states; ++i) {
+    for (int32_t j = 0; j < kGameStateSize; ++j) {
+      game_states[i * kGameStateSize + j] =
+          j < 4 * kBoardSize ? (bit(generator) ? 1.0 : 0.0)
+                             : pieces(generator) * 0.25;
+    }
+  }
+  return game_states;
+}
+
+}  // namespace
+
+// Test that the quantized network is close to the float network
+TEST(QuantizedEvaluatorTest, MatchesFloat) {
+  std::mt19937 generator{1};
+  const std::vector<DenseLayer> layers = {
+      randomLayer(generator, kGameStateSize, 50),
+      randomLayer(generator, 50, 50), randomLayer(generator, 50, 1),
+      randomLayer(generator, 50, kNumMoves)};
+  const std::string filename = "quantizedevaluator_test.bin";
+  ASSERT_TRUE(saveNetwork(layers, filename));
+  NativeEvaluator native{filename};
+  std::remove(filename.c_str());
+  ASSERT_TRUE(native.is_open());
+  const std::vector<float> calibration = randomStates(generator, 256);
+  QuantizedEvaluator quantized{layers, calibration.data(), 256};
+
+  const int32_t num_states = 64;
+  const std::vector<float> game_states = randomStates(generator, num_states);
+  std::vector<float> eval(num_states);
+  std::vector<float> probs(num_states * kNumMoves);
+  std::vector<float> float_eval(num_states);
+  std::vector<float> float_probs(num_states * kNumMoves);
+  quantized.evaluate(game_states.data(), num_states, eval.data(),
+                     probs.data());
+  native.evaluate(game_states.data(), num_states, float_eval.data(),
+                  float_probs.data());
+  for (int32_t i = 0; i < num_states; ++i) {
+    EXPECT_NEAR(eval[i], float_eval[i], 0.05);
+    float sum = 0.0;
+    double divergence = 0.0;
+    for (int32_t j = 0; j < kNumMoves; ++j) {
+      const float p = float_probs[i * kNumMoves + j];
+      sum += probs[i * kNumMoves + j];
+      divergence += p * std::log(p / probs[i * kNumMoves + j]);
+    }
+    EXPECT_NEAR(sum, 1.0, 1e-5);
+    EXPECT_LT(divergence, 0.01);
+  }
+}
+
+// Test that the outputs of a state do not depend on the batch
+TEST(QuantizedEvaluatorTest, BatchInvariant) {
+  std::mt19937 generator{2};
+  const std::vector<DenseLayer> layers = {
+      randomLayer(generator, kGameStateSize, 30),
+      randomLayer(generator, 30, 1), randomLayer(generator, 30, kNumMoves)};
+  const std::vector<float> calibration = randomStates(generator, 64);
+  QuantizedEvaluator quantized{layers, calibration.data(), 64};
+  // Full blocks of rows and the remaining rows use different kernels
+  const int32_t num_states = 9;
+  const std::vector<float> game_states = randomStates(generator, num_states);
+  std::vector<float> eval(num_states);
+  std::vector<float> probs(num_states * kNumMoves);
+  quantized.evaluate(game_states.data(), num_states, eval.data(),
+                     probs.data());
+  for (int32_t i = 0; i < num_states; ++i) {
+    float single_eval = 0.0;
+    float single_probs[kNumMoves];
+    quantized.evaluate(game_states.data() + i * kGameStateSize, 1,
+                       &single_eval, single_probs);
+    EXPECT_EQ(single_eval, eval[i]);
+    for (int32_t j = 0; j < kNumMoves; ++j) {
+      EXPECT_EQ(single_probs[j], probs[i * kNumMoves + j]);
+    }
+  }
+}
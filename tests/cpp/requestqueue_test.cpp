@@ -0,0 +1,59 @@
+#include "requestqueue.h"
+
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+// Test that batches keep the order of the requests and do not split them
+TEST(RequestQueueTest, PopBatch) {
+  RequestQueue queue;
+  for (int32_t i = 0; i < 10; ++i) {
+    queue.push(i, i % 4 + 1);
+  }
+  EXPECT_EQ(queue.size(), 10);
+  EXPECT_EQ(queue.num_rows(), 23);
+  std::vector<RequestQueue::Request> batch;
+  // Rows 1, 2, 3 fit in 8 but 4 more do not
+  EXPECT_EQ(queue.popBatch(8, batch), 6);
+  ASSERT_EQ(batch.size(), 3);
+  for (int32_t i = 0; i < 3; ++i) {
+    EXPECT_EQ(batch[i].id, i);
+  }
+  EXPECT_EQ(queue.num_rows(), 17);
+  // A request larger than the batch stays in the queue
+  EXPECT_EQ(queue.popBatch(3, batch), 0);
+  EXPECT_TRUE(batch.empty());
+  EXPECT_EQ(queue.popBatch(100, batch), 17);
+  EXPECT_EQ(batch.size(), 7);
+  EXPECT_EQ(queue.size(), 0);
+}
+
+// Test pushing from many threads
+TEST(RequestQueueTest, MultipleProducers) {
+  RequestQueue queue;
+  std::vector<std::thread> threads;
+  for (int32_t t = 0; t < 4; ++t) {
+    threads.emplace_back([&queue, t] {
+      for (int32_t i = 0; i < 1000; ++i) {
+        queue.push(t * 1000 + i, 2);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(queue.size(), 4000);
+  std::vector<bool> seen(4000, false);
+  std::vector<RequestQueue::Request> batch;
+  while (queue.popBatch(64, batch) > 0) {
+    EXPECT_EQ(batch.size(), 32);
+    for (const auto &request : batch) {
+      EXPECT_FALSE(seen[request.id]);
+      seen[request.id] = true;
+    }
+  }
+  for (bool s : seen) {
+    EXPECT_TRUE(s);
+  }
+}
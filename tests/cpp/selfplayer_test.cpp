@@ -265,3 +265,18 @@ TEST(SelfPlayerTest, FullGame) {
     }
   }
 }
+
+// Test that a game with playouts finishes in one iteration
+TEST(SelfPlayerTest, Rollout) {
+  SelfPlayer selfplayer{12345, 32, 8};
+  selfplayer.set_rollout(TrainMC::Rollout::kRandom);
+  EXPECT_TRUE(selfplayer.doIteration());
+  EXPECT_EQ(selfplayer.num_requests(), 0);
+  EXPECT_GT(selfplayer.num_samples(), 0);
+  // With one search per playout, no leaf waits for an evaluation, so moves
+  // blocked by their known results are not collisions
+  SelfPlayer single{12345, 200, 1};
+  single.set_rollout(TrainMC::Rollout::kHeuristic);
+  EXPECT_TRUE(single.doIteration());
+  EXPECT_EQ(single.num_collisions(), 0);
+}
@@ -0,0 +1,162 @@
+#include "shmtransport.h"
+
+#include <unistd.h>
+
+#include <atomic>
+#include <bitset>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "evaluator.h"
+#include "game.h"
+#include "util.h"
+
+namespace {
+
+// Make packed game states from a random game
+std::vector<PackedGame> randomGames(int32_t num_games, uint32_t seed) {
+  std::mt19937 generator(seed);
+  std::vector<PackedGame> packed;
+  Game game;
+  while (static_cast<int32_t>(packed.size()) < num_games) {
+    std::bitset<kNumMoves> legal_moves;
+    game.getLegalMoves(legal_moves);
+    if (legal_moves.none()) {
+      game = Game{};
+      continue;
+    }
+    std::vector<int32_t> moves;
+    for (int32_t i = 0; i < kNumMoves; ++i) {
+      if (legal_moves[i]) {
+        moves.push_back(i);
+      }
+    }
+    game.doMove(moves[generator() % moves.size()]);
+    packed.push_back(game.pack());
+  }
+  return packed;
+}
+
+// Return a segment name that no other test process uses
+std::string segmentName() {
+  return "/corintho_test_" + std::to_string(getpid());
+}
+
+}  // namespace
+
+// Test that workers get the same evaluations as the evaluator gives directly
+TEST(ShmTransportTest, Evaluate) {
+  const int32_t num_workers = 3;
+  const int32_t num_rows = 50;
+  ShmServer server{segmentName(), num_workers, 2, 8};
+  ASSERT_TRUE(server.is_open());
+  MockEvaluator evaluator;
+  std::thread serving{[&server, &evaluator] {
+    while (!server.all_done()) {
+      if (server.serve(evaluator, 16) == 0) {
+        std::this_thread::yield();
+      }
+    }
+  }};
+  std::vector<std::thread> workers;
+  std::atomic<int32_t> num_mismatches{0};
+  for (int32_t w = 0; w < num_workers; ++w) {
+    workers.emplace_back([w, &num_mismatches] {
+      ShmClient client{segmentName(), w};
+      ASSERT_TRUE(client.is_open());
+      // More rows than fit in the rings at once
+      const std::vector<PackedGame> packed = randomGames(num_rows, w);
+      std::vector<float> eval(num_rows);
+      std::vector<float> probs(num_rows * kNumMoves);
+      client.evaluate(packed.data(), num_rows, eval.data(), probs.data());
+      client.finish();
+      std::vector<float> game_states(num_rows * kGameStateSize);
+      expandGameStates(packed.data(), num_rows, game_states.data());
+      std::vector<float> expected_eval(num_rows);
+      std::vector<float> expected_probs(num_rows * kNumMoves);
+      MockEvaluator{}.evaluate(game_states.data(), num_rows,
+                               expected_eval.data(), expected_probs.data());
+      if (eval != expected_eval || probs != expected_probs) {
+        ++num_mismatches;
+      }
+    });
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  serving.join();
+  EXPECT_EQ(num_mismatches, 0);
+}
+
+// Test that a full ring stops the worker and that a full response ring stops
+// the server from taking more requests
+TEST(ShmTransportTest, BackPressure) {
+  const std::vector<PackedGame> packed = randomGames(4, 1);
+  ShmServer server{segmentName(), 1, 2, 4};
+  ASSERT_TRUE(server.is_open());
+  ShmClient client{segmentName(), 0};
+  ASSERT_TRUE(client.is_open());
+  EXPECT_TRUE(client.trySend(packed.data(), 4));
+  EXPECT_TRUE(client.trySend(packed.data(), 4));
+  EXPECT_FALSE(client.trySend(packed.data(), 4));
+  MockEvaluator evaluator;
+  // Both requests fit in the batch
+  EXPECT_EQ(server.serve(evaluator, 8), 8);
+  EXPECT_TRUE(client.trySend(packed.data(), 4));
+  // The responses of the first two requests fill the response ring
+  EXPECT_EQ(server.serve(evaluator, 8), 0);
+  float eval[4];
+  float probs[4 * kNumMoves];
+  EXPECT_EQ(client.tryReceive(eval, probs), 4);
+  EXPECT_EQ(server.serve(evaluator, 8), 4);
+  EXPECT_EQ(client.tryReceive(eval, probs), 4);
+  EXPECT_EQ(client.tryReceive(eval, probs), 4);
+  EXPECT_EQ(client.tryReceive(eval, probs), 0);
+}
+
+// Test that a restarted worker does not receive the results of the old one
+TEST(ShmTransportTest, Restart) {
+  const std::vector<PackedGame> packed = randomGames(6, 2);
+  ShmServer server{segmentName(), 1, 4, 6};
+  ASSERT_TRUE(server.is_open());
+  MockEvaluator evaluator;
+  {
+    ShmClient old_client{segmentName(), 0};
+    ASSERT_TRUE(old_client.is_open());
+    // One request is answered and one is waiting when the worker stops
+    EXPECT_TRUE(old_client.trySend(packed.data(), 5));
+    EXPECT_EQ(server.serve(evaluator, 6), 5);
+    EXPECT_TRUE(old_client.trySend(packed.data(), 5));
+  }
+  ShmClient client{segmentName(), 0};
+  ASSERT_TRUE(client.is_open());
+  EXPECT_FALSE(server.all_done());
+  EXPECT_TRUE(client.trySend(packed.data() + 5, 1));
+  // The waiting request of the old worker is dropped
+  EXPECT_EQ(server.serve(evaluator, 6), 1);
+  float eval = 0.0;
+  float probs[kNumMoves];
+  EXPECT_EQ(client.tryReceive(&eval, probs), 1);
+  float game_state[kGameStateSize];
+  float expected_eval = 0.0;
+  float expected_probs[kNumMoves];
+  expandGameStates(packed.data() + 5, 1, game_state);
+  evaluator.evaluate(game_state, 1, &expected_eval, expected_probs);
+  EXPECT_EQ(eval, expected_eval);
+  EXPECT_EQ(client.tryReceive(&eval, probs), 0);
+  client.finish();
+  EXPECT_TRUE(server.all_done());
+}
+
+// Test that workers cannot attach to a missing segment or channel
+TEST(ShmTransportTest, Invalid) {
+  EXPECT_FALSE(ShmClient(segmentName(), 0).is_open());
+  ShmServer server{segmentName(), 2, 2, 2};
+  ASSERT_TRUE(server.is_open());
+  EXPECT_TRUE(ShmClient(segmentName(), 1).is_open());
+  EXPECT_FALSE(ShmClient(segmentName(), 2).is_open());
+}
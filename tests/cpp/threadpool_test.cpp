@@ -0,0 +1,73 @@
+#include "threadpool.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+// Test that every task runs exactly once
+TEST(ThreadPoolTest, RunsEveryTask) {
+  for (int32_t num_threads = 1; num_threads <= 4; ++num_threads) {
+    ThreadPool pool{num_threads};
+    EXPECT_EQ(pool.num_threads(), num_threads);
+    // Reuse the pool for many batches of different sizes
+    for (int32_t num_tasks : {0, 1, 3, 100, 1000}) {
+      std::vector<std::atomic<int32_t>> runs(num_tasks);
+      pool.parallelFor(num_tasks, [&runs](int32_t i) { ++runs[i]; });
+      for (int32_t i = 0; i < num_tasks; ++i) {
+        EXPECT_EQ(runs[i], 1);
+      }
+    }
+  }
+}
+
+// Test that idle threads steal tasks when costs are uneven
+TEST(ThreadPoolTest, StealsUnevenTasks) {
+  ThreadPool pool{4};
+  std::atomic<int32_t> done{0};
+  std::vector<std::thread::id> thread_ids(64);
+  // The first block of tasks is much slower than the others
+  pool.parallelFor(64, [&](int32_t i) {
+    if (i < 16) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    thread_ids[i] = std::this_thread::get_id();
+    ++done;
+  });
+  EXPECT_EQ(done, 64);
+  // Some slow tasks were run by a thread other than their owner
+  int32_t owner_runs = 0;
+  for (int32_t i = 0; i < 16; ++i) {
+    if (thread_ids[i] == thread_ids[0]) {
+      ++owner_runs;
+    }
+  }
+  EXPECT_LT(owner_runs, 16);
+}
+
+// Test that a batch started without waiting runs while the caller works
+TEST(ThreadPoolTest, StartAndWait) {
+  for (int32_t num_threads = 1; num_threads <= 3; ++num_threads) {
+    ThreadPool pool{num_threads};
+    for (int32_t batch = 0; batch < 10; ++batch) {
+      std::vector<std::atomic<int32_t>> runs(50);
+      pool.start(50, [&runs](int32_t i) { ++runs[i]; });
+      pool.wait();
+      for (int32_t i = 0; i < 50; ++i) {
+        EXPECT_EQ(runs[i], 1);
+      }
+    }
+  }
+  // The caller does not run the tasks
+  ThreadPool pool{2};
+  std::vector<std::thread::id> thread_ids(8);
+  pool.start(8, [&thread_ids](int32_t i) {
+    thread_ids[i] = std::this_thread::get_id();
+  });
+  pool.wait();
+  for (const auto &id : thread_ids) {
+    EXPECT_NE(id, std::this_thread::get_id());
+  }
+}
@@ -1,9 +1,22 @@
 #include "tourney.h"
 
 #include <cstdint>
+#include <cstdio>
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gsl/gsl>
 
 #include "gtest/gtest.h"
 
+#include "evaluator.h"
+#include "match.h"
 #include "util.h"
 
 TEST(TourneyTest, Constructor) {
@@ -148,4 +161,150 @@ TEST(TourneyTest, FullGameMultiThreaded) {
       tourney.doIteration(eval, probs, i);
     }
   }
-}
\ No newline at end of file
+}
+namespace {
+
+// Check that the logged matches of a tourney between players i % 2 and
+// 1 - i % 2 are the same as playing each match alone, and return the average
+// score of player 0
+float expectSameAsSingleMatches(int32_t num_matches,
+                                MockEvaluator evaluators[2]) {
+  std::mt19937 generator{};
+  std::vector<float> game_states(4 * kGameStateSize);
+  std::vector<float> eval(4);
+  std::vector<float> probs(4 * kNumMoves);
+  float score = 0.0;
+  for (int32_t i = 0; i < num_matches; ++i) {
+    const std::string log_name = "./match_" + std::to_string(i % 2) + "_" +
+                                 std::to_string(1 - i % 2) + "_" +
+                                 std::to_string(i) + ".txt";
+    const std::string single_name = "tourney_test_single.txt";
+    {
+      // Use the seeds the tourney used
+      Match match{gsl::narrow_cast<int32_t>(generator()),
+                  Player{i % 2, i % 2, 32, 4, 1.0, 0.25},
+                  Player{1 - i % 2, 1 - i % 2, 32, 4, 1.0, 0.25},
+                  std::make_unique<std::ofstream>(single_name)};
+      bool done = false;
+      while (!done) {
+        const int32_t num_requests = match.num_requests();
+        match.writeRequests(game_states.data());
+        evaluators[match.to_play()].evaluate(
+            game_states.data(), num_requests, eval.data(), probs.data());
+        done = match.doIteration(eval.data(), probs.data());
+      }
+      score += i % 2 == 0 ? match.score() : 1.0 - match.score();
+    }
+    std::ifstream log_file{log_name};
+    std::ifstream single_file{single_name};
+    const std::string log{std::istreambuf_iterator<char>{log_file}, {}};
+    const std::string single{std::istreambuf_iterator<char>{single_file}, {}};
+    EXPECT_FALSE(log.empty());
+    EXPECT_EQ(log, single);
+    std::remove(log_name.c_str());
+    std::remove(single_name.c_str());
+  }
+  return score / num_matches;
+}
+
+}  // namespace
+
+// Test that each match receives the evaluations of its own requests
+TEST(TourneyTest, Offsets) {
+  Tourney tourney{1, "."};
+  tourney.addPlayer(0, 0, 32, 4);
+  tourney.addPlayer(1, 1, 32, 4);
+  const int32_t num_matches = 4;
+  for (int32_t i = 0; i < num_matches; ++i) {
+    tourney.addMatch(i % 2, 1 - i % 2, true);
+  }
+  MockEvaluator evaluators[2] = {MockEvaluator{0}, MockEvaluator{1}};
+  float game_states[num_matches * 4 * kGameStateSize];
+  float eval[num_matches * 4];
+  float probs[num_matches * 4 * kNumMoves];
+  while (!tourney.all_done()) {
+    for (int32_t id = 0; id < 2; ++id) {
+      const int32_t num_requests = tourney.num_requests(id);
+      tourney.writeRequests(game_states, id);
+      evaluators[id].evaluate(game_states, num_requests, eval, probs);
+      tourney.doIteration(eval, probs, id);
+    }
+  }
+  const float score = expectSameAsSingleMatches(num_matches, evaluators);
+  EXPECT_FLOAT_EQ(tourney.score(0), score);
+  EXPECT_FLOAT_EQ(tourney.score(1), 1.0 - score);
+}
+
+// Test advancing the matches of all models at once, with the requests of
+// each model in its own region
+TEST(TourneyTest, AllModels) {
+  Tourney tourney{2, "."};
+  tourney.addPlayer(0, 0, 32, 4);
+  tourney.addPlayer(1, 1, 32, 4);
+  const int32_t num_matches = 6;
+  for (int32_t i = 0; i < num_matches; ++i) {
+    tourney.addMatch(i % 2, 1 - i % 2, true);
+  }
+  MockEvaluator evaluators[2] = {MockEvaluator{0}, MockEvaluator{1}};
+  float game_states[num_matches * 4 * kGameStateSize];
+  float eval[num_matches * 4];
+  float probs[num_matches * 4 * kNumMoves];
+  int32_t num_shared_rounds = 0;
+  while (!tourney.all_done()) {
+    tourney.writeRequests(game_states);
+    int32_t num_rows = 0;
+    for (int32_t id : tourney.model_ids()) {
+      const int32_t offset = tourney.offset(id);
+      EXPECT_EQ(offset, num_rows);
+      num_rows += tourney.num_requests(id);
+      evaluators[id].evaluate(game_states + offset * kGameStateSize,
+                              tourney.num_requests(id), eval + offset,
+                              probs + offset * kNumMoves);
+    }
+    EXPECT_EQ(num_rows, tourney.num_requests());
+    if (tourney.model_ids().size() == 2) {
+      ++num_shared_rounds;
+    }
+    tourney.doIteration(eval, probs);
+  }
+  // Both models are evaluated in the same rounds
+  EXPECT_GT(num_shared_rounds, 0);
+  const float score = expectSameAsSingleMatches(num_matches, evaluators);
+  EXPECT_FLOAT_EQ(tourney.score(0), score);
+  EXPECT_FLOAT_EQ(tourney.score(1), 1.0 - score);
+}
+
+// Test that at most max_active matches are played at a time, with the same
+// results as playing them all at once
+TEST(TourneyTest, Window) {
+  const int32_t max_active = 2;
+  Tourney tourney{2, ".", max_active};
+  tourney.addPlayer(0, 0, 32, 4);
+  tourney.addPlayer(1, 1, 32, 4);
+  const int32_t num_matches = 5;
+  for (int32_t i = 0; i < num_matches; ++i) {
+    tourney.addMatch(i % 2, 1 - i % 2, true);
+  }
+  MockEvaluator evaluators[2] = {MockEvaluator{0}, MockEvaluator{1}};
+  float game_states[max_active * 4 * kGameStateSize];
+  float eval[max_active * 4];
+  float probs[max_active * 4 * kNumMoves];
+  int32_t max_seen = 0;
+  while (!tourney.all_done()) {
+    EXPECT_LE(tourney.num_active(), max_active);
+    max_seen = std::max(max_seen, tourney.num_active());
+    tourney.writeRequests(game_states);
+    for (int32_t id : tourney.model_ids()) {
+      const int32_t offset = tourney.offset(id);
+      evaluators[id].evaluate(game_states + offset * kGameStateSize,
+                              tourney.num_requests(id), eval + offset,
+                              probs + offset * kNumMoves);
+    }
+    tourney.doIteration(eval, probs);
+  }
+  EXPECT_EQ(max_seen, max_active);
+  EXPECT_EQ(tourney.num_active(), 0);
+  const float score = expectSameAsSingleMatches(num_matches, evaluators);
+  EXPECT_FLOAT_EQ(tourney.score(0), score);
+  EXPECT_FLOAT_EQ(tourney.score(1), 1.0 - score);
+}
@@ -1,7 +1,18 @@
 #include "trainer.h"
 
+#include <cmath>
+#include <cstdio>
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
 #include "gtest/gtest.h"
 
+#include "evaluator.h"
+#include "game.h"
+
 // Test the default constructor
 TEST(TrainerTest, DefaultConstructor) {
   Trainer trainer;
@@ -173,3 +184,306 @@ TEST(TrainerTest, FullGameTesting) {
     }
   }
 }
+
+// Test that the games write their requests straight into the batch
+TEST(TrainerTest, RequestsBatch) {
+  const int32_t num_games = 3;
+  const int32_t searches_per_eval = 4;
+  Trainer trainer{num_games, "test", 12345, 16, searches_per_eval,
+                  1.0,       0.25,   0,     2,  false};
+  float game_states[num_games * searches_per_eval * kGameStateSize];
+  float eval[num_games * searches_per_eval];
+  float probs[num_games * searches_per_eval * kNumMoves];
+  std::mt19937 generator(12345);
+  std::uniform_real_distribution<float> prob_dist(0.0, 1.0);
+  std::uniform_real_distribution<float> eval_dist(-1.0, 1.0);
+  int32_t iterations = 0;
+  while (!trainer.doIteration(eval, probs) && iterations < 100) {
+    int32_t num_requests = trainer.num_requests();
+    EXPECT_GT(num_requests, 0);
+    EXPECT_LE(num_requests, num_games * searches_per_eval);
+    // The copy is the same as the batch
+    trainer.writeRequests(game_states);
+    const float *requests = trainer.requests();
+    for (int32_t i = 0; i < num_requests * kGameStateSize; ++i) {
+      EXPECT_EQ(game_states[i], requests[i]);
+      EXPECT_TRUE(requests[i] >= 0.0 && requests[i] <= 1.0);
+    }
+    // The packed requests expand to the same rows
+    PackedGame packed[num_games * searches_per_eval];
+    trainer.writePackedRequests(packed);
+    float expanded[num_games * searches_per_eval * kGameStateSize];
+    expandGameStates(packed, num_requests, expanded);
+    // The requests are packed, so every row is a request
+    for (int32_t i = 0; i < num_requests * kGameStateSize; ++i) {
+      EXPECT_EQ(expanded[i], game_states[i]);
+    }
+    for (int32_t i = 0; i < num_requests; ++i) {
+      for (int32_t j = 0; j < kNumMoves; ++j) {
+        probs[i * kNumMoves + j] = prob_dist(generator);
+      }
+      eval[i] = eval_dist(generator);
+    }
+    ++iterations;
+  }
+  EXPECT_GT(iterations, 0);
+}
+
+namespace {
+
+// Return the training samples of a trainer, with the game states, then the
+// evaluations, then the probabilities
+std::vector<float> writeSamples(const Trainer &trainer) {
+  const int32_t num_rows = trainer.num_samples() * kNumSymmetries;
+  std::vector<float> samples(num_rows * (kGameStateSize + 1 + kNumMoves));
+  float *game_states = samples.data();
+  float *evals = game_states + num_rows * kGameStateSize;
+  trainer.writeSamples(game_states, evals, evals + num_rows);
+  return samples;
+}
+
+}  // namespace
+
+// Test that games split into cohorts play the same games
+TEST(TrainerTest, Cohorts) {
+  const int32_t num_games = 5;
+  const int32_t searches_per_eval = 4;
+  MockEvaluator evaluator;
+  std::vector<float> samples[2];
+  for (int32_t num_cohorts = 1; num_cohorts <= 2; ++num_cohorts) {
+    Trainer trainer{num_games, "test", 12345, 16,   searches_per_eval,
+                    1.0,       0.25,   0,     2,    false,
+                    false,     num_cohorts};
+    const int32_t rows = num_games * searches_per_eval;
+    float eval[2][rows];
+    float probs[2][rows * kNumMoves];
+    for (int32_t c = 0; c < num_cohorts; ++c) {
+      trainer.submit(c, eval[c], probs[c]);
+    }
+    // Evaluate one cohort while the other searches
+    bool done[2] = {false, num_cohorts == 1};
+    int32_t c = 0;
+    while (!done[0] || !done[1]) {
+      if (!done[c]) {
+        done[c] = trainer.complete(c);
+        if (!done[c]) {
+          ASSERT_GT(trainer.batch_size(c), 0);
+          evaluator.evaluate(trainer.requests(c), trainer.batch_size(c),
+                             eval[c], probs[c]);
+          trainer.submit(c, eval[c], probs[c]);
+        }
+      }
+      c = (c + 1) % num_cohorts;
+    }
+    ASSERT_GT(trainer.num_samples(), 0);
+    samples[num_cohorts - 1] = writeSamples(trainer);
+  }
+  EXPECT_EQ(samples[0], samples[1]);
+}
+
+TEST(TrainerTest, QueuedBatches) {
+  const int32_t num_games = 5;
+  const int32_t searches_per_eval = 4;
+  const int32_t rows = num_games * searches_per_eval;
+  MockEvaluator evaluator;
+  std::vector<float> samples[2];
+  for (int32_t queued = 0; queued < 2; ++queued) {
+    Trainer trainer{num_games, "test", 12345, 16, searches_per_eval, 1.0,
+                    0.25,      0,      2};
+    if (queued == 1) {
+      trainer.set_batch_size(2 * searches_per_eval + 1);
+    }
+    float eval[rows];
+    float probs[rows * kNumMoves];
+    while (!trainer.doIteration(eval, probs)) {
+      const int32_t batch_size = trainer.num_requests();
+      ASSERT_GT(batch_size, 0);
+      if (queued == 1) {
+        ASSERT_LE(batch_size, 2 * searches_per_eval + 1);
+      }
+      evaluator.evaluate(trainer.requests(), batch_size, eval, probs);
+    }
+    ASSERT_GT(trainer.num_samples(), 0);
+    samples[queued] = writeSamples(trainer);
+  }
+  EXPECT_EQ(samples[0], samples[1]);
+}
+
+// Test that games start in free slots and play the same as all at once
+TEST(TrainerTest, GameSlots) {
+  const int32_t num_games = 7;
+  const int32_t num_slots = 3;
+  const int32_t searches_per_eval = 4;
+  const int32_t rows = num_slots * searches_per_eval;
+  MockEvaluator evaluator;
+  std::vector<float> samples[3];
+  // All at once, in slots, and in slots with the request queue
+  for (int32_t mode = 0; mode < 3; ++mode) {
+    Trainer trainer{num_games, "test", 12345, 16,    searches_per_eval,
+                    1.0,       0.25,   0,     2,     false,
+                    false,     1,      mode == 0 ? 0 : num_slots};
+    if (mode == 2) {
+      trainer.set_batch_size(searches_per_eval + 1);
+    }
+    EXPECT_LE(trainer.num_games(), num_slots);
+    float eval[num_games * searches_per_eval];
+    float probs[num_games * searches_per_eval * kNumMoves];
+    while (!trainer.doIteration(eval, probs)) {
+      ASSERT_GT(trainer.num_requests(), 0);
+      if (mode > 0) {
+        ASSERT_LE(trainer.num_requests(), rows);
+      }
+      evaluator.evaluate(trainer.requests(), trainer.num_requests(), eval,
+                         probs);
+    }
+    EXPECT_EQ(trainer.num_games(), num_games);
+    samples[mode] = writeSamples(trainer);
+  }
+  EXPECT_EQ(samples[0], samples[1]);
+  EXPECT_EQ(samples[0], samples[2]);
+}
+
+// Test that no games start once there are enough samples
+TEST(TrainerTest, TargetSamples) {
+  const int32_t searches_per_eval = 4;
+  MockEvaluator evaluator;
+  Trainer trainer{20,    "test", 12345, 16, searches_per_eval, 1.0, 0.25, 0,
+                  1,     false,  false, 1,  2};
+  trainer.set_target_samples(1);
+  float eval[2 * searches_per_eval];
+  float probs[2 * searches_per_eval * kNumMoves];
+  while (!trainer.doIteration(eval, probs)) {
+    evaluator.evaluate(trainer.requests(), trainer.num_requests(), eval,
+                       probs);
+  }
+  // The first game to finish stops new games, but the other slot finishes
+  EXPECT_GE(trainer.num_samples(), 1);
+  EXPECT_LT(trainer.num_games(), 20);
+}
+
+// Test that games finish while the searches per evaluation change
+TEST(TrainerTest, Autotune) {
+  const int32_t num_games = 4;
+  const int32_t searches_per_eval = 8;
+  MockEvaluator evaluator;
+  Trainer trainer{num_games, "test", 12345, 32, searches_per_eval, 1.0, 0.25,
+                  0,         1};
+  trainer.set_autotune(true);
+  float eval[num_games * searches_per_eval];
+  float probs[num_games * searches_per_eval * kNumMoves];
+  while (!trainer.doIteration(eval, probs)) {
+    ASSERT_GT(trainer.num_requests(), 0);
+    ASSERT_LE(trainer.num_requests(), num_games * searches_per_eval);
+    evaluator.evaluate(trainer.requests(), trainer.num_requests(), eval,
+                       probs);
+  }
+  EXPECT_EQ(trainer.num_games(), num_games);
+  EXPECT_GT(trainer.num_samples(), 0);
+}
+
+// Test that run plays the same games with one cohort, two cohorts and the
+// request queue
+TEST(TrainerTest, Run) {
+  const int32_t num_games = 5;
+  const int32_t searches_per_eval = 4;
+  MockEvaluator evaluator;
+  std::vector<float> samples[3];
+  for (int32_t mode = 0; mode < 3; ++mode) {
+    Trainer trainer{num_games, "test", 12345, 16,   searches_per_eval,
+                    1.0,       0.25,   0,     2,    false,
+                    false,     mode == 1 ? 2 : 1};
+    if (mode == 2) {
+      trainer.set_batch_size(2 * searches_per_eval + 1);
+    }
+    trainer.run(evaluator);
+    EXPECT_EQ(trainer.num_games(), num_games);
+    ASSERT_GT(trainer.num_samples(), 0);
+    samples[mode] = writeSamples(trainer);
+  }
+  EXPECT_EQ(samples[0], samples[1]);
+  EXPECT_EQ(samples[0], samples[2]);
+}
+
+// Test that run plays testing games to the end with two networks
+TEST(TrainerTest, RunTesting) {
+  const int32_t num_games = 4;
+  MockEvaluator first{1};
+  MockEvaluator second{2};
+  Trainer trainer{num_games, "test", 12345, 32, 8, 1.0, 0.25, 0, 2, true};
+  trainer.run(first, second);
+  EXPECT_EQ(trainer.num_games(), num_games);
+  EXPECT_GE(trainer.score(), 0.0);
+  EXPECT_LE(trainer.score(), 1.0);
+}
+
+// Test that a sequential probability ratio test stops testing early
+TEST(TrainerTest, Sprt) {
+  const int32_t num_games = 40;
+  MockEvaluator first{1};
+  MockEvaluator second{2};
+  Trainer trainer{num_games, "test", 12345, 16, 4, 1.0, 0.25, 0,
+                  2,         true,   false, 1,  4};
+  EXPECT_EQ(trainer.sprt_result(), 0);
+  // A model that is not 1000 Elo stronger is rejected after a few games
+  trainer.set_sprt(0.0, 1000.0, 0.2, 0.2);
+  trainer.run(first, second);
+  EXPECT_EQ(trainer.sprt_result(), -1);
+  EXPECT_LE(trainer.llr(), std::log(0.2 / 0.8));
+  EXPECT_LT(trainer.num_games(), num_games);
+  EXPECT_GE(trainer.score(), 0.0);
+  EXPECT_LE(trainer.score(), 1.0);
+}
+
+// Test that the test counts whole colour pairs in order of game index, even
+// when later games finish first
+TEST(TrainerTest, SprtOrder) {
+  const int32_t num_games = 40;
+  const int32_t num_slots = 8;
+  const int32_t searches_per_eval = 4;
+  MockEvaluator evaluators[2]{MockEvaluator{1}, MockEvaluator{2}};
+  Trainer trainer{num_games, "test", 12345, 16,   searches_per_eval,
+                  1.0,       0.25,   0,     1,    true,
+                  false,     1,      num_slots};
+  trainer.set_sprt(0.0, 1000.0, 0.05, 0.05);
+  float game_states[num_slots * searches_per_eval * kGameStateSize];
+  float eval[num_slots * searches_per_eval];
+  float probs[num_slots * searches_per_eval * kNumMoves];
+  bool out_of_order = false;
+  int32_t to_play = 0;
+  while (!trainer.doIteration(eval, probs, to_play)) {
+    const int32_t num_counted = trainer.sprt_num_games();
+    EXPECT_EQ(num_counted % 2, 0);
+    // A game starts in each slot that frees up, so at least this many
+    // games have finished. More than the next pair means a later game
+    // finished first.
+    if (trainer.num_games() - num_slots > num_counted + 2) {
+      out_of_order = true;
+    }
+    if (trainer.num_requests(to_play) == 0) {
+      to_play = 1 - to_play;
+      continue;
+    }
+    trainer.writeRequests(game_states, to_play);
+    evaluators[to_play].evaluate(game_states, trainer.num_requests(to_play),
+                                 eval, probs);
+  }
+  EXPECT_TRUE(out_of_order);
+  EXPECT_EQ(trainer.sprt_result(), -1);
+  EXPECT_LT(trainer.sprt_num_games(), num_games);
+  // The scores are of the counted games, the same number in each colour
+  const std::string filename = "trainer_test_scores.txt";
+  trainer.writeScores(filename);
+  std::ifstream file{filename};
+  std::string line;
+  int32_t num_lines = 0;
+  while (std::getline(file, line)) {
+    const size_t slash = line.find(" / ");
+    ASSERT_NE(slash, std::string::npos);
+    EXPECT_EQ(std::stoi(line.substr(slash + 3)),
+              trainer.sprt_num_games() / 2);
+    ++num_lines;
+  }
+  EXPECT_EQ(num_lines, 6);
+  file.close();
+  std::remove(filename.c_str());
+}
@@ -1,10 +1,14 @@
 #include "trainmc.h"
 
+#include <algorithm>
 #include <bitset>
+#include <chrono>
 #include <random>
+#include <vector>
 
 #include "gtest/gtest.h"
 
+#include "evaluator.h"
 #include "game.h"
 #include "move.h"
 #include "node.h"
@@ -149,4 +153,267 @@ TEST(TrainMCTest, FullGame) {
     }
     EXPECT_TRUE(trainmc.done());
   }
-}
\ No newline at end of file
+}
+// Test moving to a position sent by the web app
+TEST(TrainMCTest, ReceivePosition) {
+  std::mt19937 generator(12345);
+  float to_eval[16 * kGameStateSize];
+  float eval[16];
+  float probs[16 * kNumMoves];
+  std::uniform_real_distribution<float> dist(0.0, 1.0);
+  TrainMC trainmc(&generator, to_eval, 400, 16, 1.0, 0.25, true);
+  trainmc.createRoot(Game(), 0);
+  while (!trainmc.doIteration(eval, probs)) {
+    for (int32_t i = 0; i < 16; ++i) {
+      eval[i] = dist(generator);
+    }
+    for (int32_t i = 0; i < 16 * kNumMoves; ++i) {
+      probs[i] = dist(generator);
+    }
+  }
+  // The root position is kept
+  int32_t num_nodes = trainmc.num_nodes();
+  EXPECT_TRUE(trainmc.receivePosition(trainmc.root()->get_game()));
+  EXPECT_EQ(trainmc.num_nodes(), num_nodes);
+
+  // A searched reply keeps its subtree
+  Node *child = trainmc.root()->first_child();
+  ASSERT_NE(child, nullptr);
+  int32_t visits = child->visits();
+  EXPECT_TRUE(trainmc.receivePosition(child->get_game()));
+  EXPECT_EQ(trainmc.root()->depth(), 1);
+  EXPECT_EQ(trainmc.root()->visits(), visits);
+
+  // An unrelated position starts a new tree
+  Game game;
+  game.doMove(encodePlace(Space(3, 3), kCapital));
+  EXPECT_FALSE(trainmc.receivePosition(game));
+  EXPECT_EQ(trainmc.num_nodes(), 1);
+  EXPECT_EQ(trainmc.doIteration(eval, probs), false);
+  EXPECT_EQ(trainmc.num_requests(), 1);
+}
+
+// Test discarding requests in the middle of a search
+TEST(TrainMCTest, DiscardRequests) {
+  std::mt19937 generator(12345);
+  float to_eval[16 * kGameStateSize];
+  float eval[16];
+  float probs[16 * kNumMoves];
+  std::uniform_real_distribution<float> dist(0.0, 1.0);
+  TrainMC trainmc(&generator, to_eval, 1600, 16, 1.0, 0.25, true);
+
+  // Discarding the root request
+  EXPECT_EQ(trainmc.doIteration(eval, probs), false);
+  trainmc.discardRequests();
+  EXPECT_EQ(trainmc.num_requests(), 0);
+  EXPECT_EQ(trainmc.doIteration(eval, probs), false);
+  EXPECT_EQ(trainmc.num_requests(), 1);
+
+  for (int32_t iteration = 0; iteration < 20; ++iteration) {
+    for (int32_t i = 0; i < 16; ++i) {
+      eval[i] = dist(generator);
+    }
+    for (int32_t i = 0; i < 16 * kNumMoves; ++i) {
+      probs[i] = dist(generator);
+    }
+    ASSERT_EQ(trainmc.doIteration(eval, probs), false);
+  }
+  int32_t num_requests = trainmc.num_requests();
+  ASSERT_GT(num_requests, 0);
+  int32_t num_nodes = trainmc.num_nodes();
+  int32_t visits = trainmc.root()->visits();
+  float evaluation = trainmc.root()->evaluation();
+  trainmc.discardRequests();
+  EXPECT_EQ(trainmc.num_requests(), 0);
+  EXPECT_EQ(trainmc.num_nodes(), num_nodes - num_requests);
+  EXPECT_EQ(trainmc.root()->visits(), visits - num_requests);
+  EXPECT_NEAR(trainmc.root()->evaluation(), evaluation - num_requests, 1e-3);
+
+  // Search continues normally
+  while (!trainmc.doIteration(eval, probs)) {
+    for (int32_t i = 0; i < 16; ++i) {
+      eval[i] = dist(generator);
+    }
+    for (int32_t i = 0; i < 16 * kNumMoves; ++i) {
+      probs[i] = dist(generator);
+    }
+  }
+  std::bitset<kNumMoves> legal_moves;
+  trainmc.root()->getLegalMoves(legal_moves);
+  EXPECT_TRUE(legal_moves[trainmc.chooseMove()]);
+}
+
+// Test stopping at a deadline and a search budget
+TEST(TrainMCTest, DeadlineAndBudget) {
+  std::mt19937 generator(12345);
+  float to_eval[16 * kGameStateSize];
+  float eval[16];
+  float probs[16 * kNumMoves];
+  std::uniform_real_distribution<float> dist(0.0, 1.0);
+  TrainMC trainmc(&generator, to_eval, 1600, 16, 1.0, 0.25, true);
+  // The root is evaluated even if the deadline has passed
+  trainmc.set_deadline(std::chrono::steady_clock::now());
+  EXPECT_EQ(trainmc.doIteration(eval, probs), false);
+  EXPECT_EQ(trainmc.num_requests(), 1);
+  for (int32_t i = 0; i < kNumMoves; ++i) {
+    probs[i] = dist(generator);
+  }
+  eval[0] = 0.5;
+  EXPECT_EQ(trainmc.doIteration(eval, probs), true);
+  EXPECT_EQ(trainmc.num_requests(), 0);
+  EXPECT_EQ(trainmc.root()->visits(), 1);
+  EXPECT_FLOAT_EQ(trainmc.value(), trainmc.root()->evaluation());
+
+  trainmc.clear_deadline();
+  trainmc.set_search_budget(100);
+  while (!trainmc.doIteration(eval, probs)) {
+    for (int32_t i = 0; i < 16; ++i) {
+      eval[i] = dist(generator);
+    }
+    for (int32_t i = 0; i < 16 * kNumMoves; ++i) {
+      probs[i] = dist(generator);
+    }
+    // The value excludes pending searches
+    EXPECT_GE(trainmc.value(), -1.0);
+    EXPECT_LE(trainmc.value(), 1.0);
+  }
+  EXPECT_EQ(trainmc.searches_done(), 100);
+  EXPECT_FLOAT_EQ(trainmc.value(),
+                  trainmc.root()->evaluation() / trainmc.root()->visits());
+
+  // The principal variation is a legal line starting with the best move
+  std::vector<int32_t> line = trainmc.principalVariation();
+  ASSERT_GT(line.size(), 1);
+  EXPECT_EQ(line[0], trainmc.bestMove());
+  Game game = trainmc.root()->get_game();
+  for (int32_t move_id : line) {
+    std::bitset<kNumMoves> legal_moves;
+    game.getLegalMoves(legal_moves);
+    EXPECT_TRUE(legal_moves[move_id]);
+    game.doMove(move_id);
+  }
+  EXPECT_EQ(trainmc.chooseMove(), line[0]);
+}
+
+// Test that stopping futile searches does not change the chosen move
+TEST(TrainMCTest, StopFutile) {
+  MockEvaluator evaluator;
+  int32_t total_searches[2] = {0, 0};
+  Game game;
+  for (int32_t turn = 0; turn < 8; ++turn) {
+    int32_t moves[2];
+    // Search the same position with the same random seed
+    for (int32_t stop_futile = 0; stop_futile <= 1; ++stop_futile) {
+      std::mt19937 generator(12345);
+      float to_eval[16 * kGameStateSize];
+      float eval[16];
+      float probs[16 * kNumMoves];
+      TrainMC trainmc(&generator, to_eval, 800, 16, 1.0, 0.25, true);
+      trainmc.set_stop_futile(stop_futile == 1);
+      trainmc.createRoot(game, turn);
+      while (!trainmc.doIteration(eval, probs)) {
+        evaluator.evaluate(to_eval, trainmc.num_requests(), eval, probs);
+      }
+      total_searches[stop_futile] += trainmc.searches_done();
+      moves[stop_futile] = trainmc.chooseMove();
+    }
+    EXPECT_EQ(moves[0], moves[1]);
+    game.doMove(moves[0]);
+  }
+  EXPECT_LT(total_searches[1], total_searches[0]);
+}
+
+// Test that priors for legal moves only give the same search
+TEST(TrainMCTest, SparsePriors) {
+  MockEvaluator evaluator;
+  std::mt19937 generators[2] = {std::mt19937(12345), std::mt19937(12345)};
+  float to_eval[2][16 * kGameStateSize];
+  float eval[2][16];
+  float probs[2][16 * kNumMoves];
+  uint32_t legal_masks[16 * kMoveMaskWords];
+  TrainMC dense(&generators[0], to_eval[0], 400, 16);
+  TrainMC sparse(&generators[1], to_eval[1], 400, 16);
+  sparse.set_sparse_priors(true);
+  dense.createRoot(Game{}, 0);
+  sparse.createRoot(Game{}, 0);
+  bool done = false;
+  while (!done) {
+    done = dense.doIteration(eval[0], probs[0]);
+    EXPECT_EQ(sparse.doIteration(eval[1], probs[1]), done);
+    ASSERT_EQ(sparse.num_requests(), dense.num_requests());
+    evaluator.evaluate(to_eval[0], dense.num_requests(), eval[0], probs[0]);
+    // The masks have one bit per prior
+    int32_t num_priors = sparse.writeLegalMasks(legal_masks);
+    int32_t num_legal = 0;
+    for (int32_t i = 0; i < sparse.num_requests(); ++i) {
+      for (int32_t j = 0; j < kGameStateSize; ++j) {
+        EXPECT_EQ(to_eval[1][i * kGameStateSize + j],
+                  to_eval[0][i * kGameStateSize + j]);
+      }
+      for (int32_t j = 0; j < kNumMoves; ++j) {
+        if (legal_masks[i * kMoveMaskWords + j / 32] >> (j % 32) & 1) {
+          ++num_legal;
+        }
+      }
+    }
+    EXPECT_EQ(num_priors, num_legal);
+    evaluator.evaluateLegal(to_eval[1], legal_masks, sparse.num_requests(),
+                            eval[1], probs[1]);
+  }
+  EXPECT_EQ(sparse.root()->visits(), dense.root()->visits());
+  EXPECT_EQ(sparse.num_nodes(), dense.num_nodes());
+  EXPECT_FLOAT_EQ(sparse.root()->evaluation(), dense.root()->evaluation());
+  EXPECT_EQ(sparse.principalVariation(), dense.principalVariation());
+}
+
+// Test that the virtual loss is reverted and collisions are counted
+TEST(TrainMCTest, VirtualLoss) {
+  const int32_t searches_per_eval = 256;
+  std::mt19937 generator(12345);
+  float to_eval[searches_per_eval * kGameStateSize];
+  float eval[searches_per_eval] = {0.0};
+  float probs[searches_per_eval * kNumMoves];
+  std::fill(probs, probs + searches_per_eval * kNumMoves, 1.0);
+  TrainMC trainmc(&generator, to_eval, 1600, searches_per_eval);
+  trainmc.set_virtual_loss(0.25);
+  trainmc.createRoot(Game{}, 0);
+  EXPECT_FALSE(trainmc.doIteration(eval, probs));
+  EXPECT_EQ(trainmc.num_collisions(), 0);
+  // Every child of the root waits for an evaluation, so the next search
+  // collides
+  EXPECT_FALSE(trainmc.doIteration(eval, probs));
+  EXPECT_LT(trainmc.num_requests(), searches_per_eval);
+  EXPECT_EQ(trainmc.num_requests(), trainmc.root()->num_legal_moves());
+  EXPECT_EQ(trainmc.num_collisions(), 1);
+  EXPECT_FLOAT_EQ(trainmc.value(), 0.0);
+  // All evaluations are 0, so nothing is left once they are received
+  trainmc.doIteration(eval, probs);
+  trainmc.discardRequests();
+  EXPECT_NEAR(trainmc.root()->evaluation(), 0.0, 1e-4);
+  for (Node *child = trainmc.root()->first_child(); child != nullptr;
+       child = child->next_sibling()) {
+    EXPECT_NEAR(child->evaluation(), 0.0, 1e-4);
+  }
+}
+
+// Test that playouts search a whole turn without requests
+TEST(TrainMCTest, Rollout) {
+  for (auto rollout :
+       {TrainMC::Rollout::kRandom, TrainMC::Rollout::kHeuristic}) {
+    std::mt19937 generator(12345);
+    TrainMC trainmc(&generator, nullptr, 200, 16, 1.0, 0.25, true);
+    trainmc.set_rollout(rollout, 2);
+    EXPECT_TRUE(trainmc.doIteration());
+    EXPECT_EQ(trainmc.num_requests(), 0);
+    // Testing stops searching once the move cannot change
+    EXPECT_GT(trainmc.searches_done(), 1);
+    EXPECT_LE(trainmc.searches_done(), 200);
+    EXPECT_GE(trainmc.value(), -1.0);
+    EXPECT_LE(trainmc.value(), 1.0);
+    // The opponent's move is searched, so the next turn needs no requests
+    const int32_t choice = trainmc.chooseMove();
+    EXPECT_GE(choice, 0);
+    EXPECT_LT(choice, kNumMoves);
+    EXPECT_TRUE(trainmc.doIteration());
+  }
+}
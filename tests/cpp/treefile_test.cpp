@@ -0,0 +1,205 @@
+#include "treefile.h"
+
+#include <cstdio>
+
+#include <bitset>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "game.h"
+#include "node.h"
+#include "trainmc.h"
+#include "util.h"
+
+namespace {
+
+// Generate random evaluations for the requests of a TrainMC
+void randomEvals(std::mt19937 &generator, int32_t num_requests, float eval[],
+                 float probs[]) {
+  std::uniform_real_distribution<float> dist(0.0, 1.0);
+  for (int32_t i = 0; i < num_requests; ++i) {
+    eval[i] = dist(generator) * 2.0 - 1.0;
+    for (int32_t j = 0; j < kNumMoves; ++j) {
+      probs[i * kNumMoves + j] = dist(generator);
+    }
+  }
+}
+
+// Check that two trees have the same structure and statistics
+void expectSameTree(const Node *a, const Node *b) {
+  ASSERT_EQ(a->child_id(), b->child_id());
+  EXPECT_EQ(a->depth(), b->depth());
+  EXPECT_EQ(a->visits(), b->visits());
+  EXPECT_FLOAT_EQ(a->evaluation(), b->evaluation());
+  EXPECT_EQ(a->result(), b->result());
+  EXPECT_EQ(a->all_visited(), b->all_visited());
+  EXPECT_EQ(a->get_game().pack().board, b->get_game().pack().board);
+  ASSERT_EQ(a->num_legal_moves(), b->num_legal_moves());
+  for (int32_t i = 0; i < a->num_legal_moves(); ++i) {
+    EXPECT_EQ(a->packed_edge(i), b->packed_edge(i));
+  }
+  const Node *a_child = a->first_child();
+  const Node *b_child = b->first_child();
+  while (a_child != nullptr && b_child != nullptr) {
+    EXPECT_EQ(b_child->parent(), b);
+    expectSameTree(a_child, b_child);
+    a_child = a_child->next_sibling();
+    b_child = b_child->next_sibling();
+  }
+  EXPECT_EQ(a_child, nullptr);
+  EXPECT_EQ(b_child, nullptr);
+}
+
+}  // namespace
+
+TEST(TreeFileTest, PackGame) {
+  Game game;
+  game.doMove(encodePlace(Space{1, 2}, kColumn));
+  game.doMove(encodePlace(Space{3, 0}, kBase));
+  Game unpacked{game.pack()};
+  PackedGame a = game.pack();
+  PackedGame b = unpacked.pack();
+  EXPECT_EQ(a.board, b.board);
+  EXPECT_EQ(a.to_play, b.to_play);
+  for (int32_t i = 0; i < 6; ++i) {
+    EXPECT_EQ(a.pieces[i], b.pieces[i]);
+  }
+}
+
+TEST(TreeFileTest, MissingFile) {
+  TreeFile tree_file{"missing_tree.bin"};
+  EXPECT_FALSE(tree_file.is_open());
+  EXPECT_EQ(tree_file.num_nodes(), 0);
+}
+
+TEST(TreeFileTest, SaveAndRestore) {
+  const std::string filename = "treefile_test.bin";
+  std::mt19937 generator(12345);
+  float to_eval[16 * kGameStateSize];
+  float eval[16];
+  float probs[16 * kNumMoves];
+  TrainMC trainmc{&generator, to_eval, 400, 16};
+  while (!trainmc.doIteration(eval, probs)) {
+    randomEvals(generator, trainmc.num_requests(), eval, probs);
+  }
+  ASSERT_TRUE(trainmc.saveTree(filename));
+
+  TreeFile tree_file{filename};
+  ASSERT_TRUE(tree_file.is_open());
+  EXPECT_EQ(tree_file.num_nodes(), trainmc.num_nodes());
+  // Records are read in place
+  EXPECT_EQ(tree_file.record(0).visits, trainmc.root()->visits());
+  EXPECT_EQ(tree_file.record(0).num_legal_moves,
+            trainmc.root()->num_legal_moves());
+  for (int32_t i = 0; i < trainmc.root()->num_legal_moves(); ++i) {
+    EXPECT_EQ(tree_file.move_id(0, i), trainmc.root()->move_id(i));
+    EXPECT_NEAR(tree_file.probability(0, i), trainmc.root()->probability(i),
+                1e-6);
+  }
+  Node *restored = tree_file.restore();
+  expectSameTree(trainmc.root(), restored);
+  delete restored;
+  std::remove(filename.c_str());
+}
+
+TEST(TreeFileTest, ContinueSearch) {
+  const std::string filename = "treefile_test_continue.bin";
+  std::mt19937 generator(12345);
+  float to_eval[16 * kGameStateSize];
+  float eval[16];
+  float probs[16 * kNumMoves];
+  {
+    TrainMC trainmc{&generator, to_eval, 200, 16};
+    while (!trainmc.doIteration(eval, probs)) {
+      randomEvals(generator, trainmc.num_requests(), eval, probs);
+    }
+    ASSERT_TRUE(trainmc.saveTree(filename));
+  }
+  // Play out a game from the saved tree
+  TrainMC trainmc{&generator, to_eval, 200, 16, 1.0, 0.25, true};
+  ASSERT_TRUE(trainmc.loadTree(filename));
+  int32_t visits = trainmc.root()->visits();
+  while (!trainmc.done()) {
+    while (!trainmc.doIteration(eval, probs)) {
+      randomEvals(generator, trainmc.num_requests(), eval, probs);
+    }
+    if (visits > 0) {
+      // Search extended the saved tree
+      EXPECT_GT(trainmc.root()->visits(), visits);
+      visits = 0;
+    }
+    std::bitset<kNumMoves> legal_moves;
+    trainmc.root()->getLegalMoves(legal_moves);
+    EXPECT_TRUE(legal_moves[trainmc.chooseMove()]);
+  }
+  std::remove(filename.c_str());
+}
+
+// Test that truncated and corrupt files are not opened
+TEST(TreeFileTest, CorruptFile) {
+  const std::string filename = "treefile_test_corrupt.bin";
+  std::mt19937 generator(12345);
+  float to_eval[16 * kGameStateSize];
+  float eval[16];
+  float probs[16 * kNumMoves];
+  TrainMC trainmc{&generator, to_eval, 400, 16};
+  while (!trainmc.doIteration(eval, probs)) {
+    randomEvals(generator, trainmc.num_requests(), eval, probs);
+  }
+  ASSERT_TRUE(trainmc.saveTree(filename));
+  std::string saved;
+  {
+    std::ifstream file{filename, std::ifstream::binary};
+    saved.assign(std::istreambuf_iterator<char>{file},
+                 std::istreambuf_iterator<char>{});
+  }
+  ASSERT_TRUE(TreeFile{filename}.is_open());
+  const int32_t num_nodes = trainmc.num_nodes();
+  ASSERT_GT(num_nodes, 2);
+
+  // Write the saved tree with one change and check it is rejected
+  auto expectRejected = [&](auto change) {
+    std::string data = saved;
+    TreeFile::Record *records = reinterpret_cast<TreeFile::Record *>(
+        &data[sizeof(TreeFile::Header)]);
+    change(data, records);
+    {
+      std::ofstream file{filename, std::ofstream::binary};
+      file.write(data.data(), data.size());
+    }
+    EXPECT_FALSE(TreeFile{filename}.is_open());
+  };
+  expectRejected([](std::string &data, TreeFile::Record *) {
+    data.resize(data.size() - 1);
+  });
+  // A child before its parent
+  expectRejected([&](std::string &, TreeFile::Record *records) {
+    for (int32_t i = 1; i < num_nodes; ++i) {
+      if (records[i].num_children > 0) {
+        records[i].first_child = 1;
+        return;
+      }
+    }
+    FAIL() << "No internal node below the root";
+  });
+  expectRejected([&](std::string &, TreeFile::Record *records) {
+    records[0].first_child = num_nodes;
+  });
+  expectRejected([&](std::string &, TreeFile::Record *records) {
+    records[0].first_edge = 0xFFFFFFFF;
+  });
+  expectRejected([](std::string &, TreeFile::Record *records) {
+    records[0].num_legal_moves = kNumMoves + 1;
+  });
+  expectRejected([](std::string &, TreeFile::Record *records) {
+    records[1].game.pieces[2] = 5;
+  });
+  expectRejected([](std::string &, TreeFile::Record *records) {
+    records[1].game.to_play = 2;
+  });
+  std::remove(filename.c_str());
+}